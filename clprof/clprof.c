@@ -0,0 +1,835 @@
+///
+//  OpenCL API call profiler, preloaded into any OpenCL program:
+//
+//    LD_PRELOAD=../clprof/build/libclprof.so ./build/saxpy saxpy.cl
+//
+//  Every intercepted entry point forwards to the next definition (the ICD
+//  loader), counting the calls, their host latency and the bytes they move.
+//  The summary is printed at exit. Disabled (CLPROF=0), a call costs one
+//  branch on top of the forwarding.
+//
+//  Env vars:
+//  - CLPROF: (int) 1|0 to record the calls (default 1)
+//  - CLPROF_OUT: (str) file to write the summary to (default stderr)
+//
+#define _GNU_SOURCE
+#define CL_TARGET_OPENCL_VERSION 300
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "cltime.h"
+
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Intercepted entry points, in the order of the enum of their statistics
+#define PROF_CALLS(X)                                                          \
+  X(clCreateContext)                                                           \
+  X(clCreateContextFromType)                                                   \
+  X(clCreateCommandQueue)                                                      \
+  X(clCreateCommandQueueWithProperties)                                        \
+  X(clCreateBuffer)                                                            \
+  X(clCreateSubBuffer)                                                         \
+  X(clCreateProgramWithSource)                                                 \
+  X(clCreateProgramWithBinary)                                                 \
+  X(clBuildProgram)                                                            \
+  X(clCreateKernel)                                                            \
+  X(clCreateKernelsInProgram)                                                  \
+  X(clCreateUserEvent)                                                         \
+  X(clEnqueueReadBuffer)                                                       \
+  X(clEnqueueWriteBuffer)                                                      \
+  X(clEnqueueReadBufferRect)                                                   \
+  X(clEnqueueWriteBufferRect)                                                  \
+  X(clEnqueueCopyBuffer)                                                       \
+  X(clEnqueueCopyBufferRect)                                                   \
+  X(clEnqueueFillBuffer)                                                       \
+  X(clEnqueueMapBuffer)                                                        \
+  X(clEnqueueUnmapMemObject)                                                   \
+  X(clEnqueueMigrateMemObjects)                                                \
+  X(clEnqueueNDRangeKernel)                                                    \
+  X(clEnqueueMarkerWithWaitList)                                               \
+  X(clEnqueueBarrierWithWaitList)                                              \
+  X(clEnqueueSVMMap)                                                           \
+  X(clEnqueueSVMUnmap)                                                         \
+  X(clEnqueueSVMMemcpy)                                                        \
+  X(clEnqueueSVMMemFill)                                                       \
+  X(clWaitForEvents)                                                           \
+  X(clFlush)                                                                   \
+  X(clFinish)
+
+#define PROF_ENUM(fn) PROF_##fn,
+#define PROF_NAME(fn) #fn,
+
+enum ProfCall
+{
+  PROF_CALLS(PROF_ENUM) PROF_N_CALLS
+};
+
+static const char* prof_names[PROF_N_CALLS] = { PROF_CALLS(PROF_NAME) };
+
+struct ProfStat
+{
+  uint64_t calls;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t bytes;
+};
+
+// Updated with atomics: calls come from any thread
+static struct ProfStat prof_stats[PROF_N_CALLS];
+static bool prof_on = false;
+static double prof_origin;
+
+///
+//  Start of an intercepted call: real, a function-local pointer to the next
+//  definition of fn, resolved on the first call; prof_start the host time
+//  if recording
+//
+#define PROF_BEGIN(fn)                                                         \
+  static __typeof__(&fn) real = NULL;                                          \
+  if (__atomic_load_n(&real, __ATOMIC_ACQUIRE) == NULL) {                      \
+    __atomic_store_n(                                                          \
+      &real, (__typeof__(&fn))prof_resolve(#fn), __ATOMIC_RELEASE);            \
+  }                                                                            \
+  double prof_start = prof_on ? now_ns() : 0
+
+#define PROF_END(fn, bytes)                                                    \
+  if (prof_on) {                                                               \
+    prof_record(PROF_##fn, prof_start, (bytes));                               \
+  }
+
+static void*
+prof_resolve(const char* name)
+{
+  void* fn = dlsym(RTLD_NEXT, name);
+  if (fn == NULL) {
+    fprintf(stderr, "clprof: %s not found in the OpenCL library\n", name);
+    abort();
+  }
+  return fn;
+}
+
+static void
+prof_record(enum ProfCall call, double start_ns, uint64_t bytes)
+{
+  uint64_t ns = (uint64_t)(now_ns() - start_ns);
+  struct ProfStat* stat = &prof_stats[call];
+  __atomic_fetch_add(&stat->calls, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stat->total_ns, ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&stat->bytes, bytes, __ATOMIC_RELAXED);
+  uint64_t max = __atomic_load_n(&stat->max_ns, __ATOMIC_RELAXED);
+  while (ns > max && !__atomic_compare_exchange_n(&stat->max_ns,
+                                                  &max,
+                                                  ns,
+                                                  true,
+                                                  __ATOMIC_RELAXED,
+                                                  __ATOMIC_RELAXED)) {
+  }
+}
+
+static size_t
+prof_region(const size_t* region)
+{
+  return region != NULL ? region[0] * region[1] * region[2] : 0;
+}
+
+static int
+prof_by_total(const void* a, const void* b)
+{
+  uint64_t x = prof_stats[*(const int*)a].total_ns;
+  uint64_t y = prof_stats[*(const int*)b].total_ns;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+///
+//  One line per entry point called, by total time
+//
+static void
+prof_summary(void)
+{
+  double wall_ns = now_ns() - prof_origin;
+  FILE* out = stderr;
+  char* path = getenv("CLPROF_OUT");
+  if (path != NULL && (out = fopen(path, "w")) == NULL) {
+    fprintf(stderr, "clprof: failed to open %s\n", path);
+    out = stderr;
+  }
+
+  int order[PROF_N_CALLS];
+  uint64_t calls = 0;
+  uint64_t total_ns = 0;
+  for (int i = 0; i < PROF_N_CALLS; i++) {
+    order[i] = i;
+    calls += prof_stats[i].calls;
+    total_ns += prof_stats[i].total_ns;
+  }
+  qsort(order, PROF_N_CALLS, sizeof(order[0]), prof_by_total);
+
+  fprintf(out,
+          "clprof: %lu calls, %lg ns in OpenCL (%.1f%% of %lg ns)\n",
+          calls,
+          (double)total_ns,
+          wall_ns > 0 ? 100.0 * total_ns / wall_ns : 0.0,
+          wall_ns);
+  fprintf(out,
+          "%-36s %10s %14s %12s %12s %14s\n",
+          "call",
+          "count",
+          "total(ns)",
+          "mean(ns)",
+          "max(ns)",
+          "bytes");
+  for (int i = 0; i < PROF_N_CALLS; i++) {
+    const struct ProfStat* stat = &prof_stats[order[i]];
+    if (stat->calls == 0) {
+      continue;
+    }
+    fprintf(out,
+            "%-36s %10lu %14lu %12.0f %12lu %14lu\n",
+            prof_names[order[i]],
+            stat->calls,
+            stat->total_ns,
+            (double)stat->total_ns / stat->calls,
+            stat->max_ns,
+            stat->bytes);
+  }
+  if (out != stderr) {
+    fclose(out);
+  }
+}
+
+__attribute__((constructor)) static void
+prof_init(void)
+{
+  char* on = getenv("CLPROF");
+  if (on != NULL && atoi(on) == 0) {
+    return;
+  }
+  prof_origin = now_ns();
+  prof_on = true;
+  atexit(prof_summary);
+}
+
+// Contexts, queues and memory objects
+
+CL_API_ENTRY cl_context CL_API_CALL
+clCreateContext(const cl_context_properties* properties,
+                cl_uint num_devices,
+                const cl_device_id* devices,
+                void(CL_CALLBACK* pfn_notify)(const char*,
+                                              const void*,
+                                              size_t,
+                                              void*),
+                void* user_data,
+                cl_int* errcode_ret)
+{
+  PROF_BEGIN(clCreateContext);
+  cl_context ret = real(
+    properties, num_devices, devices, pfn_notify, user_data, errcode_ret);
+  PROF_END(clCreateContext, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_context CL_API_CALL
+clCreateContextFromType(const cl_context_properties* properties,
+                        cl_device_type device_type,
+                        void(CL_CALLBACK* pfn_notify)(const char*,
+                                                      const void*,
+                                                      size_t,
+                                                      void*),
+                        void* user_data,
+                        cl_int* errcode_ret)
+{
+  PROF_BEGIN(clCreateContextFromType);
+  cl_context ret =
+    real(properties, device_type, pfn_notify, user_data, errcode_ret);
+  PROF_END(clCreateContextFromType, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_command_queue CL_API_CALL
+clCreateCommandQueue(cl_context context,
+                     cl_device_id device,
+                     cl_command_queue_properties properties,
+                     cl_int* errcode_ret)
+{
+  PROF_BEGIN(clCreateCommandQueue);
+  cl_command_queue ret = real(context, device, properties, errcode_ret);
+  PROF_END(clCreateCommandQueue, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_command_queue CL_API_CALL
+clCreateCommandQueueWithProperties(cl_context context,
+                                   cl_device_id device,
+                                   const cl_queue_properties* properties,
+                                   cl_int* errcode_ret)
+{
+  PROF_BEGIN(clCreateCommandQueueWithProperties);
+  cl_command_queue ret = real(context, device, properties, errcode_ret);
+  PROF_END(clCreateCommandQueueWithProperties, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_mem CL_API_CALL
+clCreateBuffer(cl_context context,
+               cl_mem_flags flags,
+               size_t size,
+               void* host_ptr,
+               cl_int* errcode_ret)
+{
+  PROF_BEGIN(clCreateBuffer);
+  cl_mem ret = real(context, flags, size, host_ptr, errcode_ret);
+  // Bytes allocated; copied too with CL_MEM_COPY_HOST_PTR
+  PROF_END(clCreateBuffer, size);
+  return ret;
+}
+
+CL_API_ENTRY cl_mem CL_API_CALL
+clCreateSubBuffer(cl_mem buffer,
+                  cl_mem_flags flags,
+                  cl_buffer_create_type buffer_create_type,
+                  const void* buffer_create_info,
+                  cl_int* errcode_ret)
+{
+  PROF_BEGIN(clCreateSubBuffer);
+  cl_mem ret =
+    real(buffer, flags, buffer_create_type, buffer_create_info, errcode_ret);
+  PROF_END(clCreateSubBuffer,
+           buffer_create_type == CL_BUFFER_CREATE_TYPE_REGION &&
+               buffer_create_info != NULL
+             ? ((const cl_buffer_region*)buffer_create_info)->size
+             : 0);
+  return ret;
+}
+
+// Programs and kernels
+
+CL_API_ENTRY cl_program CL_API_CALL
+clCreateProgramWithSource(cl_context context,
+                          cl_uint count,
+                          const char** strings,
+                          const size_t* lengths,
+                          cl_int* errcode_ret)
+{
+  PROF_BEGIN(clCreateProgramWithSource);
+  cl_program ret = real(context, count, strings, lengths, errcode_ret);
+  PROF_END(clCreateProgramWithSource, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_program CL_API_CALL
+clCreateProgramWithBinary(cl_context context,
+                          cl_uint num_devices,
+                          const cl_device_id* device_list,
+                          const size_t* lengths,
+                          const unsigned char** binaries,
+                          cl_int* binary_status,
+                          cl_int* errcode_ret)
+{
+  PROF_BEGIN(clCreateProgramWithBinary);
+  cl_program ret = real(context,
+                        num_devices,
+                        device_list,
+                        lengths,
+                        binaries,
+                        binary_status,
+                        errcode_ret);
+  uint64_t bytes = 0;
+  for (cl_uint i = 0; lengths != NULL && i < num_devices; i++) {
+    bytes += lengths[i];
+  }
+  PROF_END(clCreateProgramWithBinary, bytes);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clBuildProgram(cl_program program,
+               cl_uint num_devices,
+               const cl_device_id* device_list,
+               const char* options,
+               void(CL_CALLBACK* pfn_notify)(cl_program program,
+                                             void* user_data),
+               void* user_data)
+{
+  PROF_BEGIN(clBuildProgram);
+  cl_int ret =
+    real(program, num_devices, device_list, options, pfn_notify, user_data);
+  PROF_END(clBuildProgram, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_kernel CL_API_CALL
+clCreateKernel(cl_program program, const char* kernel_name, cl_int* errcode_ret)
+{
+  PROF_BEGIN(clCreateKernel);
+  cl_kernel ret = real(program, kernel_name, errcode_ret);
+  PROF_END(clCreateKernel, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clCreateKernelsInProgram(cl_program program,
+                         cl_uint num_kernels,
+                         cl_kernel* kernels,
+                         cl_uint* num_kernels_ret)
+{
+  PROF_BEGIN(clCreateKernelsInProgram);
+  cl_int ret = real(program, num_kernels, kernels, num_kernels_ret);
+  PROF_END(clCreateKernelsInProgram, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_event CL_API_CALL
+clCreateUserEvent(cl_context context, cl_int* errcode_ret)
+{
+  PROF_BEGIN(clCreateUserEvent);
+  cl_event ret = real(context, errcode_ret);
+  PROF_END(clCreateUserEvent, 0);
+  return ret;
+}
+
+// Transfers
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueReadBuffer(cl_command_queue command_queue,
+                    cl_mem buffer,
+                    cl_bool blocking_read,
+                    size_t offset,
+                    size_t size,
+                    void* ptr,
+                    cl_uint num_events_in_wait_list,
+                    const cl_event* event_wait_list,
+                    cl_event* event)
+{
+  PROF_BEGIN(clEnqueueReadBuffer);
+  cl_int ret = real(command_queue,
+                    buffer,
+                    blocking_read,
+                    offset,
+                    size,
+                    ptr,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueReadBuffer, size);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueWriteBuffer(cl_command_queue command_queue,
+                     cl_mem buffer,
+                     cl_bool blocking_write,
+                     size_t offset,
+                     size_t size,
+                     const void* ptr,
+                     cl_uint num_events_in_wait_list,
+                     const cl_event* event_wait_list,
+                     cl_event* event)
+{
+  PROF_BEGIN(clEnqueueWriteBuffer);
+  cl_int ret = real(command_queue,
+                    buffer,
+                    blocking_write,
+                    offset,
+                    size,
+                    ptr,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueWriteBuffer, size);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueReadBufferRect(cl_command_queue command_queue,
+                        cl_mem buffer,
+                        cl_bool blocking_read,
+                        const size_t* buffer_origin,
+                        const size_t* host_origin,
+                        const size_t* region,
+                        size_t buffer_row_pitch,
+                        size_t buffer_slice_pitch,
+                        size_t host_row_pitch,
+                        size_t host_slice_pitch,
+                        void* ptr,
+                        cl_uint num_events_in_wait_list,
+                        const cl_event* event_wait_list,
+                        cl_event* event)
+{
+  PROF_BEGIN(clEnqueueReadBufferRect);
+  cl_int ret = real(command_queue,
+                    buffer,
+                    blocking_read,
+                    buffer_origin,
+                    host_origin,
+                    region,
+                    buffer_row_pitch,
+                    buffer_slice_pitch,
+                    host_row_pitch,
+                    host_slice_pitch,
+                    ptr,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueReadBufferRect, prof_region(region));
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueWriteBufferRect(cl_command_queue command_queue,
+                         cl_mem buffer,
+                         cl_bool blocking_write,
+                         const size_t* buffer_origin,
+                         const size_t* host_origin,
+                         const size_t* region,
+                         size_t buffer_row_pitch,
+                         size_t buffer_slice_pitch,
+                         size_t host_row_pitch,
+                         size_t host_slice_pitch,
+                         const void* ptr,
+                         cl_uint num_events_in_wait_list,
+                         const cl_event* event_wait_list,
+                         cl_event* event)
+{
+  PROF_BEGIN(clEnqueueWriteBufferRect);
+  cl_int ret = real(command_queue,
+                    buffer,
+                    blocking_write,
+                    buffer_origin,
+                    host_origin,
+                    region,
+                    buffer_row_pitch,
+                    buffer_slice_pitch,
+                    host_row_pitch,
+                    host_slice_pitch,
+                    ptr,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueWriteBufferRect, prof_region(region));
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueCopyBuffer(cl_command_queue command_queue,
+                    cl_mem src_buffer,
+                    cl_mem dst_buffer,
+                    size_t src_offset,
+                    size_t dst_offset,
+                    size_t size,
+                    cl_uint num_events_in_wait_list,
+                    const cl_event* event_wait_list,
+                    cl_event* event)
+{
+  PROF_BEGIN(clEnqueueCopyBuffer);
+  cl_int ret = real(command_queue,
+                    src_buffer,
+                    dst_buffer,
+                    src_offset,
+                    dst_offset,
+                    size,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueCopyBuffer, size);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueCopyBufferRect(cl_command_queue command_queue,
+                        cl_mem src_buffer,
+                        cl_mem dst_buffer,
+                        const size_t* src_origin,
+                        const size_t* dst_origin,
+                        const size_t* region,
+                        size_t src_row_pitch,
+                        size_t src_slice_pitch,
+                        size_t dst_row_pitch,
+                        size_t dst_slice_pitch,
+                        cl_uint num_events_in_wait_list,
+                        const cl_event* event_wait_list,
+                        cl_event* event)
+{
+  PROF_BEGIN(clEnqueueCopyBufferRect);
+  cl_int ret = real(command_queue,
+                    src_buffer,
+                    dst_buffer,
+                    src_origin,
+                    dst_origin,
+                    region,
+                    src_row_pitch,
+                    src_slice_pitch,
+                    dst_row_pitch,
+                    dst_slice_pitch,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueCopyBufferRect, prof_region(region));
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueFillBuffer(cl_command_queue command_queue,
+                    cl_mem buffer,
+                    const void* pattern,
+                    size_t pattern_size,
+                    size_t offset,
+                    size_t size,
+                    cl_uint num_events_in_wait_list,
+                    const cl_event* event_wait_list,
+                    cl_event* event)
+{
+  PROF_BEGIN(clEnqueueFillBuffer);
+  cl_int ret = real(command_queue,
+                    buffer,
+                    pattern,
+                    pattern_size,
+                    offset,
+                    size,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueFillBuffer, size);
+  return ret;
+}
+
+CL_API_ENTRY void* CL_API_CALL
+clEnqueueMapBuffer(cl_command_queue command_queue,
+                   cl_mem buffer,
+                   cl_bool blocking_map,
+                   cl_map_flags map_flags,
+                   size_t offset,
+                   size_t size,
+                   cl_uint num_events_in_wait_list,
+                   const cl_event* event_wait_list,
+                   cl_event* event,
+                   cl_int* errcode_ret)
+{
+  PROF_BEGIN(clEnqueueMapBuffer);
+  void* ret = real(command_queue,
+                   buffer,
+                   blocking_map,
+                   map_flags,
+                   offset,
+                   size,
+                   num_events_in_wait_list,
+                   event_wait_list,
+                   event,
+                   errcode_ret);
+  PROF_END(clEnqueueMapBuffer, size);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueUnmapMemObject(cl_command_queue command_queue,
+                        cl_mem memobj,
+                        void* mapped_ptr,
+                        cl_uint num_events_in_wait_list,
+                        const cl_event* event_wait_list,
+                        cl_event* event)
+{
+  PROF_BEGIN(clEnqueueUnmapMemObject);
+  cl_int ret = real(command_queue,
+                    memobj,
+                    mapped_ptr,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueUnmapMemObject, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueMigrateMemObjects(cl_command_queue command_queue,
+                           cl_uint num_mem_objects,
+                           const cl_mem* mem_objects,
+                           cl_mem_migration_flags flags,
+                           cl_uint num_events_in_wait_list,
+                           const cl_event* event_wait_list,
+                           cl_event* event)
+{
+  PROF_BEGIN(clEnqueueMigrateMemObjects);
+  cl_int ret = real(command_queue,
+                    num_mem_objects,
+                    mem_objects,
+                    flags,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueMigrateMemObjects, 0);
+  return ret;
+}
+
+// Kernels and synchronization
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueNDRangeKernel(cl_command_queue command_queue,
+                       cl_kernel kernel,
+                       cl_uint work_dim,
+                       const size_t* global_work_offset,
+                       const size_t* global_work_size,
+                       const size_t* local_work_size,
+                       cl_uint num_events_in_wait_list,
+                       const cl_event* event_wait_list,
+                       cl_event* event)
+{
+  PROF_BEGIN(clEnqueueNDRangeKernel);
+  cl_int ret = real(command_queue,
+                    kernel,
+                    work_dim,
+                    global_work_offset,
+                    global_work_size,
+                    local_work_size,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueNDRangeKernel, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueMarkerWithWaitList(cl_command_queue command_queue,
+                            cl_uint num_events_in_wait_list,
+                            const cl_event* event_wait_list,
+                            cl_event* event)
+{
+  PROF_BEGIN(clEnqueueMarkerWithWaitList);
+  cl_int ret =
+    real(command_queue, num_events_in_wait_list, event_wait_list, event);
+  PROF_END(clEnqueueMarkerWithWaitList, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueBarrierWithWaitList(cl_command_queue command_queue,
+                             cl_uint num_events_in_wait_list,
+                             const cl_event* event_wait_list,
+                             cl_event* event)
+{
+  PROF_BEGIN(clEnqueueBarrierWithWaitList);
+  cl_int ret =
+    real(command_queue, num_events_in_wait_list, event_wait_list, event);
+  PROF_END(clEnqueueBarrierWithWaitList, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clWaitForEvents(cl_uint num_events, const cl_event* event_list)
+{
+  PROF_BEGIN(clWaitForEvents);
+  cl_int ret = real(num_events, event_list);
+  PROF_END(clWaitForEvents, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clFlush(cl_command_queue command_queue)
+{
+  PROF_BEGIN(clFlush);
+  cl_int ret = real(command_queue);
+  PROF_END(clFlush, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clFinish(cl_command_queue command_queue)
+{
+  PROF_BEGIN(clFinish);
+  cl_int ret = real(command_queue);
+  PROF_END(clFinish, 0);
+  return ret;
+}
+
+// Shared virtual memory (OpenCL 2.0)
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueSVMMap(cl_command_queue command_queue,
+                cl_bool blocking_map,
+                cl_map_flags flags,
+                void* svm_ptr,
+                size_t size,
+                cl_uint num_events_in_wait_list,
+                const cl_event* event_wait_list,
+                cl_event* event)
+{
+  PROF_BEGIN(clEnqueueSVMMap);
+  cl_int ret = real(command_queue,
+                    blocking_map,
+                    flags,
+                    svm_ptr,
+                    size,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueSVMMap, size);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueSVMUnmap(cl_command_queue command_queue,
+                  void* svm_ptr,
+                  cl_uint num_events_in_wait_list,
+                  const cl_event* event_wait_list,
+                  cl_event* event)
+{
+  PROF_BEGIN(clEnqueueSVMUnmap);
+  cl_int ret = real(
+    command_queue, svm_ptr, num_events_in_wait_list, event_wait_list, event);
+  PROF_END(clEnqueueSVMUnmap, 0);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueSVMMemcpy(cl_command_queue command_queue,
+                   cl_bool blocking_copy,
+                   void* dst_ptr,
+                   const void* src_ptr,
+                   size_t size,
+                   cl_uint num_events_in_wait_list,
+                   const cl_event* event_wait_list,
+                   cl_event* event)
+{
+  PROF_BEGIN(clEnqueueSVMMemcpy);
+  cl_int ret = real(command_queue,
+                    blocking_copy,
+                    dst_ptr,
+                    src_ptr,
+                    size,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueSVMMemcpy, size);
+  return ret;
+}
+
+CL_API_ENTRY cl_int CL_API_CALL
+clEnqueueSVMMemFill(cl_command_queue command_queue,
+                    void* svm_ptr,
+                    const void* pattern,
+                    size_t pattern_size,
+                    size_t size,
+                    cl_uint num_events_in_wait_list,
+                    const cl_event* event_wait_list,
+                    cl_event* event)
+{
+  PROF_BEGIN(clEnqueueSVMMemFill);
+  cl_int ret = real(command_queue,
+                    svm_ptr,
+                    pattern,
+                    pattern_size,
+                    size,
+                    num_events_in_wait_list,
+                    event_wait_list,
+                    event);
+  PROF_END(clEnqueueSVMMemFill, size);
+  return ret;
+}
@@ -0,0 +1,162 @@
+/*
+ *  clserve: send requests for one operation to the kernel server, print
+ *  the result and the client and server side timing, and CHECK it against
+ *  the host engine
+ */
+
+#include "clhost.hpp"
+#include "clserve.h"
+#include "cltime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+static enum clrt::HostOp
+HostEngineOp(enum ServeOp op)
+{
+  switch (op) {
+    case SERVE_SAXPY:
+      return clrt::HOST_SAXPY;
+    case SERVE_DSUM:
+      return clrt::HOST_DSUM;
+    case SERVE_DMUL:
+      return clrt::HOST_DMUL;
+    case SERVE_VECADD:
+      return clrt::HOST_VECADD;
+    default:
+      return clrt::HOST_VECMUL;
+  }
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2) {
+    printf("usage: <saxpy|dsum|dmul|vecadd|vecmul>\n");
+    exit(1);
+  }
+  enum ServeOp op;
+  if (!clserve_parse_op(argv[1], &op)) {
+    printf("not recognized operation (saxpy|dsum|dmul|vecadd|vecmul)\n");
+    exit(1);
+  }
+  size_t vector_len = 1024;
+  char* vector_str = getenv("VECTOR");
+  if (vector_str != NULL && atol(vector_str) > 0) {
+    vector_len = atol(vector_str);
+  }
+  float factor = 3.14;
+  char* factor_str = getenv("FACTOR");
+  if (factor_str != NULL) {
+    factor = atof(factor_str);
+  }
+  char* check_str = getenv("CHECK");
+  bool check_res = check_str != NULL && atoi(check_str) > 0;
+  int requests = 1;
+  char* iterations_str = getenv("ITERATIONS");
+  if (iterations_str != NULL && atoi(iterations_str) > 0) {
+    requests = atoi(iterations_str);
+  }
+  printf("operation: %s vector_len: %ld requests: %d\n",
+         clserve_op_name(op),
+         vector_len,
+         requests);
+
+  const char* path = clserve_socket_path();
+  double connect_start = now_ns();
+  int sock = clserve_connect(path);
+  if (sock < 0) {
+    return 1;
+  }
+  printf("connect(ns):%lg\n", now_ns() - connect_start);
+
+  // The vectors, back to back (see clserve.h)
+  int vectors = clserve_op_vectors(op);
+  float* shm;
+  int fd = clserve_shm(sizeof(float) * vectors * vector_len, (void**)&shm);
+  if (fd < 0) {
+    return 1;
+  }
+  float* a = shm;
+  float* b = shm + vector_len;
+  float* out = shm + (vectors - 1) * vector_len;
+
+  enum clrt::HostIsa host_isa;
+  int host_threads;
+  if (!clrt::host_config(&host_isa, &host_threads)) {
+    printf("not recognized host isa (AUTO|SCALAR|AVX2|AVX512|NEON)\n");
+    exit(1);
+  }
+  clrt::HostEngine host(host_isa, host_threads);
+  struct clrt::VerifyConfig verify;
+  clrt::verify_config(&verify);
+  host.set_verify(verify);
+  std::vector<float> src(vectors == 3 ? 0 : vector_len);
+
+  struct ServeReply reply;
+  for (int i = 0; i < requests; i++) {
+    for (size_t k = 0; k < vector_len; k++) {
+      a[k] = ((float)rand() / (float)(RAND_MAX)) * 100.0;
+    }
+    if (vectors == 3) {
+      for (size_t k = 0; k < vector_len; k++) {
+        b[k] = ((float)rand() / (float)(RAND_MAX)) * 100.0;
+      }
+    } else {
+      // dst starts from zero: the kernels add to it
+      memcpy(src.data(), a, sizeof(float) * vector_len);
+      memset(out, 0, sizeof(float) * vector_len);
+    }
+
+    struct ServeRequest req;
+    memset(&req, 0, sizeof(req));
+    req.magic = CLSERVE_MAGIC;
+    req.op = op;
+    req.id = i;
+    req.n = vector_len;
+    req.factor = factor;
+    double start = now_ns();
+    int unused;
+    // The shared memory goes with the first request only
+    if (!clserve_send(sock, &req, sizeof(req), i == 0 ? fd : -1) ||
+        !clserve_recv(sock, &reply, sizeof(reply), &unused)) {
+      fprintf(stderr, "clserve: connection lost\n");
+      return 1;
+    }
+    double round_trip = now_ns() - start;
+    if (reply.status != SERVE_OK) {
+      printf("request %d failed: %s\n",
+             i,
+             clserve_status_name(reply.status));
+      return 1;
+    }
+    printf("request %d: round trip(ns):%lg server(ns):%lg write(ns):%lg "
+           "kernel(ns):%lg read(ns):%lg\n",
+           i,
+           round_trip,
+           reply.server_ns,
+           reply.write_ns,
+           reply.kernel_ns,
+           reply.read_ns);
+    if (check_res) {
+      struct clrt::VerifyReport report;
+      host.verify(HostEngineOp(op),
+                  vectors == 3 ? a : src.data(),
+                  b,
+                  factor,
+                  out,
+                  vector_len,
+                  &report);
+      host.print_report(clserve_op_name(op), &report);
+    }
+  }
+  for (size_t k = 0; k < vector_len && k < 3; k++) {
+    printf("[%ld] %.6f\n", k, out[k]);
+  }
+  close(sock);
+  close(fd);
+  return host.failures() > 0 ? 1 : 0;
+}
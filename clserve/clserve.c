@@ -0,0 +1,199 @@
+#define _GNU_SOURCE
+#include "clserve.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char* op_names[SERVE_OPS] = {
+  "saxpy", "dsum", "dmul", "vecadd", "vecmul",
+};
+
+const char*
+clserve_socket_path(void)
+{
+  char* path = getenv("CLSERVE_SOCKET");
+  return path != NULL ? path : CLSERVE_SOCKET_DEFAULT;
+}
+
+bool
+clserve_parse_op(const char* name, enum ServeOp* op)
+{
+  for (int i = 0; i < SERVE_OPS; i++) {
+    if (strncmp(name, op_names[i], strlen(op_names[i])) == 0) {
+      *op = (enum ServeOp)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char*
+clserve_op_name(enum ServeOp op)
+{
+  return op < SERVE_OPS ? op_names[op] : "unknown";
+}
+
+const char*
+clserve_status_name(int status)
+{
+  switch (status) {
+    case SERVE_OK:
+      return "ok";
+    case SERVE_BAD_REQUEST:
+      return "bad request";
+    case SERVE_NO_KERNEL:
+      return "no kernel for the op";
+    case SERVE_NO_MEMORY:
+      return "no shared memory for the vectors";
+    case SERVE_TOO_LARGE:
+      return "vectors too large for the device";
+    case SERVE_DEVICE_ERROR:
+      return "device error";
+  }
+  return "unknown";
+}
+
+int
+clserve_op_vectors(enum ServeOp op)
+{
+  return op == SERVE_VECADD || op == SERVE_VECMUL ? 3 : 2;
+}
+
+static bool
+socket_address(const char* path, struct sockaddr_un* addr)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    fprintf(stderr, "clserve: socket path too long: %s\n", path);
+    return false;
+  }
+  strcpy(addr->sun_path, path);
+  return true;
+}
+
+int
+clserve_listen(const char* path)
+{
+  struct sockaddr_un addr;
+  if (!socket_address(path, &addr)) {
+    return -1;
+  }
+  int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    perror("clserve: socket");
+    return -1;
+  }
+  unlink(path);
+  if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(sock, SOMAXCONN) != 0) {
+    perror("clserve: bind");
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+int
+clserve_connect(const char* path)
+{
+  struct sockaddr_un addr;
+  if (!socket_address(path, &addr)) {
+    return -1;
+  }
+  int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    perror("clserve: socket");
+    return -1;
+  }
+  if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    perror("clserve: connect");
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+bool
+clserve_send(int sock, const void* msg, size_t size, int fd)
+{
+  struct iovec iov = { (void*)msg, size };
+  struct msghdr hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.msg_iov = &iov;
+  hdr.msg_iovlen = 1;
+  char control[CMSG_SPACE(sizeof(int))];
+  if (fd >= 0) {
+    memset(control, 0, sizeof(control));
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+  return sendmsg(sock, &hdr, MSG_NOSIGNAL) == (ssize_t)size;
+}
+
+bool
+clserve_recv(int sock, void* msg, size_t size, int* fd)
+{
+  struct iovec iov = { msg, size };
+  struct msghdr hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.msg_iov = &iov;
+  hdr.msg_iovlen = 1;
+  char control[CMSG_SPACE(sizeof(int))];
+  hdr.msg_control = control;
+  hdr.msg_controllen = sizeof(control);
+  ssize_t received = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC);
+  *fd = -1;
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+  if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS) {
+    memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+  if (received != (ssize_t)size || (hdr.msg_flags & MSG_TRUNC)) {
+    if (*fd >= 0) {
+      close(*fd);
+      *fd = -1;
+    }
+    return false;
+  }
+  return true;
+}
+
+int
+clserve_shm(size_t bytes, void** addr)
+{
+  int fd = memfd_create("clserve", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    perror("clserve: memfd_create");
+    return -1;
+  }
+  if (ftruncate(fd, bytes) != 0) {
+    perror("clserve: ftruncate");
+    close(fd);
+    return -1;
+  }
+  // The server maps it: shrinking it under the mapping would fault there
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK) != 0) {
+    perror("clserve: F_ADD_SEALS");
+    close(fd);
+    return -1;
+  }
+  *addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (*addr == MAP_FAILED) {
+    perror("clserve: mmap");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
@@ -0,0 +1,134 @@
+#ifndef CLSERVE_H
+#define CLSERVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CLSERVE_SOCKET_DEFAULT "/tmp/clserve.sock"
+#define CLSERVE_MAGIC 0x76736c63 // "clsv"
+
+///
+//  Operations the kernel server runs, each from a kernel file named after it
+//
+enum ServeOp
+{
+  SERVE_SAXPY,
+  SERVE_DSUM,
+  SERVE_DMUL,
+  SERVE_VECADD,
+  SERVE_VECMUL,
+  SERVE_OPS,
+};
+
+enum ServeStatus
+{
+  SERVE_OK,
+  SERVE_BAD_REQUEST,  // wrong magic or unknown op
+  SERVE_NO_KERNEL,    // the server was not started with a kernel for the op
+  SERVE_NO_MEMORY,    // no sealed shared memory attached, or too small for n
+  SERVE_TOO_LARGE,    // n over the int range or the device allocation limit
+  SERVE_DEVICE_ERROR, // an OpenCL call failed (the connection stays up)
+};
+
+///
+//  One request on a connection (SOCK_SEQPACKET: one message each). Its
+//  vectors are in the shared memory of the connection: the memfd attached
+//  (SCM_RIGHTS) to a request replaces it, requests without one reuse it.
+//  The memfd must be sealed against shrinking (F_SEAL_SHRINK, see
+//  clserve_shm): the server reads and writes it until it is replaced.
+//  It holds the vectors back to back, n floats each: src then dst for
+//  saxpy, dsum and dmul (dst is added to and returned), a, b then c for
+//  vecadd and vecmul.
+//
+struct ServeRequest
+{
+  uint32_t magic;
+  uint32_t op;
+  uint64_t id; // echoed in the reply
+  uint64_t n;  // elements per vector
+  float factor;
+};
+
+///
+//  The reply once the output is back in the shared memory. Times are
+//  server-side: the profiled commands and the wall time from receiving the
+//  request to the output being read back.
+//
+struct ServeReply
+{
+  uint32_t magic;
+  int32_t status;
+  uint64_t id;
+  double server_ns;
+  double write_ns;
+  double kernel_ns;
+  double read_ns;
+};
+
+///
+//  Env var CLSERVE_SOCKET: (str) path of the server socket (default
+//  CLSERVE_SOCKET_DEFAULT)
+//
+const char*
+clserve_socket_path(void);
+
+///
+//  Operation named by the prefix of name (a kernel file, or the op itself)
+//
+bool
+clserve_parse_op(const char* name, enum ServeOp* op);
+
+const char*
+clserve_op_name(enum ServeOp op);
+
+const char*
+clserve_status_name(int status);
+
+///
+//  Vectors in the shared memory of a request of op (inputs and output)
+//
+int
+clserve_op_vectors(enum ServeOp op);
+
+///
+//  Listening socket bound to path (a stale socket file is replaced), or -1
+//
+int
+clserve_listen(const char* path);
+
+///
+//  Connection to the server at path, or -1
+//
+int
+clserve_connect(const char* path);
+
+///
+//  Send a message of size bytes, with fd attached unless it is -1
+//
+bool
+clserve_send(int sock, const void* msg, size_t size, int fd);
+
+///
+//  Receive a message of exactly size bytes, and the fd attached to it (-1
+//  if none). False on errors, short messages or a closed connection.
+//
+bool
+clserve_recv(int sock, void* msg, size_t size, int* fd);
+
+///
+//  Shared memory of bytes bytes (memfd, sealed against shrinking), mapped
+//  at *addr. Returns its fd, -1 on errors.
+//
+int
+clserve_shm(size_t bytes, void** addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
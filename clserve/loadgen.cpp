@@ -0,0 +1,233 @@
+/*
+ *  clserve-load: closed-loop load on the kernel server. At each concurrency
+ *  level that many clients, each with its own connection and shared memory,
+ *  send requests back to back; the request latency percentiles and the
+ *  throughput of the level are reported.
+ */
+
+#include "clbench.h"
+#include "clserve.h"
+#include "cltime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+///
+//  One client of a level: its timed requests (host wall clock, queued =
+//  submit = start at the send) and the server time of each
+//
+struct LoadClient
+{
+  enum ServeOp op;
+  size_t vector_len;
+  int requests;
+  int warmup;
+  std::atomic<int>* ready;
+  std::atomic<bool>* go;
+  std::vector<struct BenchSample> samples;
+  std::vector<double> server_ns;
+  bool failed;
+};
+
+static void
+RunClient(struct LoadClient* client)
+{
+  client->failed = true;
+  int sock = clserve_connect(clserve_socket_path());
+  int vectors = clserve_op_vectors(client->op);
+  float* shm = NULL;
+  int fd = -1;
+  if (sock >= 0) {
+    fd = clserve_shm(sizeof(float) * vectors * client->vector_len,
+                     (void**)&shm);
+  }
+  bool ok = sock >= 0 && fd >= 0;
+  if (ok) {
+    for (size_t k = 0; k < vectors * client->vector_len; k++) {
+      shm[k] = (float)(k % 1024);
+    }
+  }
+
+  struct ServeRequest req;
+  memset(&req, 0, sizeof(req));
+  req.magic = CLSERVE_MAGIC;
+  req.op = client->op;
+  req.n = client->vector_len;
+  req.factor = 2.0f;
+  struct ServeReply reply;
+  bool counted = false;
+  int total = client->warmup + client->requests;
+  for (int i = 0; ok && i < total; i++) {
+    // The warmup requests run before the level starts
+    if (i == client->warmup) {
+      (*client->ready)++;
+      counted = true;
+      while (!*client->go) {
+        std::this_thread::yield();
+      }
+    }
+    req.id = i;
+    int unused;
+    cl_ulong start = (cl_ulong)now_ns();
+    ok = clserve_send(sock, &req, sizeof(req), i == 0 ? fd : -1) &&
+         clserve_recv(sock, &reply, sizeof(reply), &unused) &&
+         reply.status == SERVE_OK;
+    cl_ulong end = (cl_ulong)now_ns();
+    if (ok && i >= client->warmup) {
+      struct BenchSample s = { start, start, start, end };
+      client->samples.push_back(s);
+      client->server_ns.push_back(reply.server_ns);
+    }
+  }
+  if (!ok) {
+    fprintf(stderr,
+            "clserve-load: request failed: %s\n",
+            sock < 0 || fd < 0 ? "no connection"
+                               : clserve_status_name(reply.status));
+  }
+  // A client failing before the level starts still lets it start
+  if (!counted) {
+    (*client->ready)++;
+  }
+  client->failed = !ok;
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (sock >= 0) {
+    close(sock);
+  }
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2) {
+    printf("usage: <saxpy|dsum|dmul|vecadd|vecmul>\n");
+    exit(1);
+  }
+  enum ServeOp op;
+  if (!clserve_parse_op(argv[1], &op)) {
+    printf("not recognized operation (saxpy|dsum|dmul|vecadd|vecmul)\n");
+    exit(1);
+  }
+  size_t vector_len = 1024;
+  char* vector_str = getenv("VECTOR");
+  if (vector_str != NULL && atol(vector_str) > 0) {
+    vector_len = atol(vector_str);
+  }
+  int requests = 1000;
+  char* requests_str = getenv("REQUESTS");
+  if (requests_str != NULL && atoi(requests_str) > 0) {
+    requests = atoi(requests_str);
+  }
+  int warmup = 10;
+  char* warmup_str = getenv("WARMUP");
+  if (warmup_str != NULL) {
+    warmup = atoi(warmup_str);
+  }
+  std::vector<int> levels;
+  char* concurrency_str = getenv("CONCURRENCY");
+  const char* spec = concurrency_str != NULL ? concurrency_str : "1,2,4,8";
+  for (const char* p = spec; *p != '\0';) {
+    int level = atoi(p);
+    if (level <= 0) {
+      printf("not recognized concurrency (comma-separated clients)\n");
+      exit(1);
+    }
+    levels.push_back(level);
+    p = strchr(p, ',');
+    p = p != NULL ? p + 1 : "";
+  }
+  printf("operation: %s vector_len: %ld requests: %d per client "
+         "(+%d warmup)\n",
+         clserve_op_name(op),
+         vector_len,
+         requests,
+         warmup);
+
+  std::vector<struct BenchResult> results(levels.size());
+  std::vector<std::vector<struct BenchSample>> samples(levels.size());
+  bool failed = false;
+  size_t n_run = 0;
+  for (size_t l = 0; l < levels.size() && !failed; l++) {
+    int level = levels[l];
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<struct LoadClient> clients(level);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < level; c++) {
+      clients[c].op = op;
+      clients[c].vector_len = vector_len;
+      clients[c].requests = requests;
+      clients[c].warmup = warmup;
+      clients[c].ready = &ready;
+      clients[c].go = &go;
+      threads.push_back(std::thread(RunClient, &clients[c]));
+    }
+    while (ready < level) {
+      std::this_thread::yield();
+    }
+    double start = now_ns();
+    go = true;
+    for (int c = 0; c < level; c++) {
+      threads[c].join();
+    }
+    double elapsed = now_ns() - start;
+    n_run++;
+
+    std::vector<double> server_ns;
+    for (int c = 0; c < level; c++) {
+      failed = failed || clients[c].failed;
+      samples[l].insert(samples[l].end(),
+                        clients[c].samples.begin(),
+                        clients[c].samples.end());
+      server_ns.insert(server_ns.end(),
+                       clients[c].server_ns.begin(),
+                       clients[c].server_ns.end());
+    }
+    std::sort(server_ns.begin(), server_ns.end());
+
+    // Per request: the inputs written and the output read back
+    char label[64];
+    snprintf(label, sizeof(label), "clserve x%d", level);
+    struct BenchResult* r = &results[l];
+    clbench_result(r,
+                   NULL,
+                   clserve_op_name(op),
+                   label,
+                   vector_len,
+                   3.0 * sizeof(float) * vector_len,
+                   1.0 * vector_len,
+                   samples[l].data(),
+                   samples[l].size(),
+                   warmup);
+    snprintf(r->device, sizeof(r->device), "%s", clserve_socket_path());
+    printf("concurrency %d: %ld requests, %.0f req/s\n",
+           level,
+           r->exec.runs,
+           elapsed > 0 ? 1e9 * r->exec.runs / elapsed : 0);
+    printf("  latency(ns): min %.0f  median %.0f  p95 %.0f  p99 %.0f  "
+           "max %.0f\n",
+           r->exec.min,
+           r->exec.median,
+           r->exec.p95,
+           r->exec.p99,
+           r->exec.max);
+    if (server_ns.size() > 0) {
+      printf("  server(ns): median %.0f\n", server_ns[server_ns.size() / 2]);
+    }
+  }
+
+  char* bench_out = getenv("BENCH_OUT");
+  if (bench_out != NULL &&
+      !clbench_write(bench_out, results.data(), n_run)) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", bench_out);
+  }
+  return failed ? 1 : 0;
+}
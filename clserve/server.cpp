@@ -0,0 +1,533 @@
+/*
+ *  clserved: a long-running kernel server. It sets up one device once
+ *  (context, programs, buffer pool) and runs the element-wise kernels for
+ *  the requests of its clients over a Unix domain socket (see clserve.h).
+ */
+
+#include <CL/cl.h>
+
+#include "clbench.h"
+#include "clcache.h"
+#include "clcheck.h"
+#include "clrt.hpp"
+#include "clserve.h"
+#include "cltime.h"
+#include "cltune.h"
+
+#include <atomic>
+#include <fcntl.h>
+#include <limits.h>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+///
+//  The program serving an op, built at startup from a kernel file
+//
+struct ServeKernel
+{
+  clrt::Program program;
+  char label[256]; // kernel file and build options
+  int width;       // elements per work-item (*.vec.cl)
+  bool grid_stride;
+};
+
+///
+//  State shared by the connections. The programs are only read once the
+//  server is up; the pool is shared under pool_mutex.
+//
+struct Server
+{
+  clrt::Runtime* rt;
+  cl_ulong max_alloc; // CL_DEVICE_MAX_MEM_ALLOC_SIZE
+  struct ServeKernel kernels[SERVE_OPS];
+  std::mutex pool_mutex;
+  std::mutex conn_mutex;
+  std::vector<int> conns;    // open connections, shut down on exit
+  std::vector<int> finished; // connections whose thread is done, to join
+  std::atomic<size_t> connections;
+  std::atomic<size_t> requests;
+  std::atomic<size_t> errors;
+};
+
+///
+//  One client connection: its own queue, kernels and device buffers (grown
+//  to the largest request), and the shared memory it attached
+//
+struct Session
+{
+  clrt::Queue queue;
+  clrt::Kernel kernels[SERVE_OPS];
+  clrt::Mem bufs[3];
+  size_t capacity; // bytes of each buffer
+  void* shm;
+  size_t shm_size;
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static void
+OnSignal(int)
+{
+  stop = 1;
+}
+
+///
+//  Build kernelfile for the op its name starts with. Its kernel must take
+//  (src, dst, factor, int n) or (a, b, c, int n): the *.batch.cl kernels,
+//  taking job offsets, are rejected.
+//
+static bool
+LoadKernel(struct Server* server, const char* kernelfile)
+{
+  const char* base = strrchr(kernelfile, '/');
+  base = base != NULL ? base + 1 : kernelfile;
+  enum ServeOp op;
+  if (!clserve_parse_op(base, &op)) {
+    printf("not recognized operation (saxpy|dsum|dmul|vecadd|vecmul) in %s\n",
+           kernelfile);
+    return false;
+  }
+  if (strstr(base, ".batch.") != NULL) {
+    printf("%s: batch kernels are not served\n", kernelfile);
+    return false;
+  }
+  clrt::Runtime* rt = server->rt;
+  struct ServeKernel* kern = &server->kernels[op];
+  char options[64] = "";
+  kern->width = 1;
+  kern->grid_stride = strstr(base, ".gs.") != NULL;
+  if (strstr(base, ".vec.") != NULL) {
+    kern->width = cltune_vector_width(rt->device());
+    snprintf(options, sizeof(options), "-DVW=%d", kern->width);
+  }
+  snprintf(kern->label,
+           sizeof(kern->label),
+           "%s%s%s",
+           kernelfile,
+           options[0] ? " " : "",
+           options);
+
+  enum CacheStatus cache_status;
+  double build_start = now_ns();
+  kern->program = rt->programs().get(
+    rt->context(), rt->device(), kernelfile, options, &cache_status);
+  if (kern->program == NULL) {
+    fprintf(stderr, "Failed to build program from %s\n", kernelfile);
+    return false;
+  }
+  // The server launches with the length argument and no local size
+  clrt::Kernel kernel =
+    clrt::create_kernel(kern->program, clserve_op_name(op));
+  cl_uint num_args;
+  CL_CHECK(clGetKernelInfo(
+    kernel, CL_KERNEL_NUM_ARGS, sizeof(num_args), &num_args, NULL));
+  if (num_args != 4) {
+    printf("%s: the kernel does not take (src, dst, factor|c, int n)\n",
+           kernelfile);
+    kern->program.reset();
+    return false;
+  }
+  printf("serving %s: %s build(ns):%lg (cache %s)\n",
+         clserve_op_name(op),
+         kern->label,
+         now_ns() - build_start,
+         clcache_status_name(cache_status));
+  return true;
+}
+
+///
+//  Attach the shared memory of fd to the session, replacing the previous
+//  one. The mapping keeps the memory: fd is closed. Memory that can shrink
+//  under the mapping (no F_SEAL_SHRINK) is not attached: the requests get
+//  SERVE_NO_MEMORY.
+//
+static void
+Attach(struct Session* session, int fd)
+{
+  if (session->shm != NULL) {
+    munmap(session->shm, session->shm_size);
+    session->shm = NULL;
+    session->shm_size = 0;
+  }
+  int seals = fcntl(fd, F_GET_SEALS);
+  struct stat st;
+  if (seals >= 0 && (seals & F_SEAL_SHRINK) && fstat(fd, &st) == 0 &&
+      st.st_size > 0) {
+    void* addr =
+      mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr != MAP_FAILED) {
+      session->shm = addr;
+      session->shm_size = st.st_size;
+    }
+  }
+  close(fd);
+}
+
+// Drop the session buffers (the pool lock held)
+static void
+ReleaseBuffers(struct Server* server, struct Session* session)
+{
+  for (int v = 0; v < 3; v++) {
+    if (session->bufs[v] != NULL) {
+      server->rt->pool().release(session->bufs[v]);
+      session->bufs[v].reset();
+    }
+  }
+  session->capacity = 0;
+}
+
+// Wait for the commands of events and sample them
+static cl_int
+CollectSamples(const clrt::EventTimer& events,
+               std::vector<struct BenchSample>* samples)
+{
+  for (size_t i = 0; i < events.size(); i++) {
+    cl_event event = events[i];
+    cl_int err = clWaitForEvents(1, &event);
+    struct BenchSample sample;
+    if (err == CL_SUCCESS) {
+      err = clbench_sample(event, &sample);
+    }
+    if (err != CL_SUCCESS) {
+      return err;
+    }
+    samples->push_back(sample);
+  }
+  return CL_SUCCESS;
+}
+
+///
+//  Run one request: write its inputs from the shared memory, run the
+//  kernel and read the output back into it (one in-order queue). OpenCL
+//  errors fail the request, not the server: they are logged and the queue
+//  drained, so no command still uses the shared memory.
+//
+static int
+Serve(struct Server* server,
+      struct Session* session,
+      const struct ServeRequest* req,
+      struct ServeReply* reply)
+{
+  if (req->magic != CLSERVE_MAGIC || req->op >= SERVE_OPS) {
+    return SERVE_BAD_REQUEST;
+  }
+  enum ServeOp op = (enum ServeOp)req->op;
+  struct ServeKernel* kern = &server->kernels[op];
+  if (kern->program == NULL) {
+    return SERVE_NO_KERNEL;
+  }
+  // The kernels index with int
+  if (req->n > INT_MAX || sizeof(float) * req->n > server->max_alloc) {
+    return SERVE_TOO_LARGE;
+  }
+  int vectors = clserve_op_vectors(op);
+  size_t bytes = sizeof(float) * req->n;
+  if (session->shm == NULL || req->n == 0 ||
+      req->n > session->shm_size / (vectors * sizeof(float))) {
+    return SERVE_NO_MEMORY;
+  }
+
+  clrt::Runtime* rt = server->rt;
+  cl_int err = CL_SUCCESS;
+  if (bytes > session->capacity) {
+    std::lock_guard<std::mutex> lock(server->pool_mutex);
+    ReleaseBuffers(server, session);
+    for (int v = 0; v < 3 && err == CL_SUCCESS; v++) {
+      session->bufs[v] = rt->pool().acquire(CL_MEM_READ_WRITE, bytes, &err);
+    }
+    if (err != CL_SUCCESS) {
+      ReleaseBuffers(server, session);
+      fprintf(stderr,
+              "clserved: buffers of %lu bytes: error %d\n",
+              (unsigned long)bytes,
+              (int)err);
+      return SERVE_DEVICE_ERROR;
+    }
+    session->capacity = bytes;
+  }
+  if (session->kernels[op] == NULL) {
+    session->kernels[op] = clrt::Kernel(
+      clCreateKernel(kern->program, clserve_op_name(op), &err));
+    if (err != CL_SUCCESS) {
+      fprintf(stderr,
+              "clserved: clCreateKernel %s: error %d\n",
+              clserve_op_name(op),
+              (int)err);
+      return SERVE_DEVICE_ERROR;
+    }
+  }
+
+  // saxpy, dsum, dmul: (src, dst, factor, n), dst added to. vecadd,
+  // vecmul: (a, b, c, n).
+  cl_kernel kernel = session->kernels[op];
+  cl_command_queue queue = session->queue;
+  char* shm = (char*)session->shm;
+  cl_mem bufs[3] = { session->bufs[0], session->bufs[1], session->bufs[2] };
+  cl_int n = (cl_int)req->n;
+  err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &bufs[0]);
+  if (err == CL_SUCCESS) {
+    err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &bufs[1]);
+  }
+  if (err == CL_SUCCESS) {
+    err = vectors == 3
+            ? clSetKernelArg(kernel, 2, sizeof(cl_mem), &bufs[2])
+            : clSetKernelArg(kernel, 2, sizeof(req->factor), &req->factor);
+  }
+  if (err == CL_SUCCESS) {
+    err = clSetKernelArg(kernel, 3, sizeof(n), &n);
+  }
+
+  clrt::EventTimer events;
+  for (int v = 0; v < 2 && err == CL_SUCCESS; v++) {
+    err = clEnqueueWriteBuffer(queue,
+                               bufs[v],
+                               CL_FALSE,
+                               0,
+                               bytes,
+                               shm + v * bytes,
+                               0,
+                               NULL,
+                               events.next());
+  }
+  size_t global = kern->grid_stride
+                    ? cltune_grid_items(rt->device(), req->n)
+                    : (req->n + kern->width - 1) / kern->width;
+  if (err == CL_SUCCESS) {
+    err = clEnqueueNDRangeKernel(
+      queue, kernel, 1, NULL, &global, NULL, 0, NULL, events.next());
+  }
+  int out = vectors - 1;
+  if (err == CL_SUCCESS) {
+    err = clEnqueueReadBuffer(queue,
+                              bufs[out],
+                              CL_TRUE,
+                              0,
+                              bytes,
+                              shm + out * bytes,
+                              0,
+                              NULL,
+                              events.next());
+  }
+  std::vector<struct BenchSample> samples;
+  if (err == CL_SUCCESS) {
+    err = CollectSamples(events, &samples);
+  }
+  if (err != CL_SUCCESS) {
+    clFinish(queue);
+    fprintf(stderr,
+            "clserved: request %lu (%s, n %lu): error %d\n",
+            (unsigned long)req->id,
+            clserve_op_name(op),
+            (unsigned long)req->n,
+            (int)err);
+    return SERVE_DEVICE_ERROR;
+  }
+  reply->write_ns = (double)(samples[0].end - samples[0].start) +
+                    (double)(samples[1].end - samples[1].start);
+  reply->kernel_ns = (double)(samples[2].end - samples[2].start);
+  reply->read_ns = (double)(samples[3].end - samples[3].start);
+  return SERVE_OK;
+}
+
+///
+//  Serve the requests of a connection until it closes or the server stops
+//
+static void
+Converse(struct Server* server, int sock)
+{
+  struct Session session;
+  enum QueueMode mode = QUEUE_BLOCKING;
+  cl_int err;
+  session.queue = clrt::Queue(clbench_create_queue(
+    server->rt->context(), server->rt->device(), &mode, &err));
+  if (err != CL_SUCCESS) {
+    // Refused: the client sees the connection close
+    fprintf(
+      stderr, "clserved: no queue for a connection: error %d\n", (int)err);
+    session.queue.reset();
+  }
+  session.capacity = 0;
+  session.shm = NULL;
+  session.shm_size = 0;
+
+  struct ServeRequest req;
+  int fd;
+  while (session.queue != NULL &&
+         clserve_recv(sock, &req, sizeof(req), &fd)) {
+    double start = now_ns();
+    if (fd >= 0) {
+      Attach(&session, fd);
+    }
+    struct ServeReply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.magic = CLSERVE_MAGIC;
+    reply.id = req.id;
+    reply.status = Serve(server, &session, &req, &reply);
+    reply.server_ns = now_ns() - start;
+    server->requests++;
+    if (reply.status != SERVE_OK) {
+      server->errors++;
+    }
+    if (!clserve_send(sock, &reply, sizeof(reply), -1)) {
+      break;
+    }
+  }
+
+  if (session.shm != NULL) {
+    munmap(session.shm, session.shm_size);
+  }
+  {
+    std::lock_guard<std::mutex> lock(server->pool_mutex);
+    ReleaseBuffers(server, &session);
+  }
+}
+
+///
+//  A connection thread. Its session (queue, kernels) is released before the
+//  connection is marked finished; main then joins it and closes the socket.
+//
+static void
+Connection(struct Server* server, int sock)
+{
+  Converse(server, sock);
+  std::lock_guard<std::mutex> lock(server->conn_mutex);
+  for (size_t i = 0; i < server->conns.size(); i++) {
+    if (server->conns[i] == sock) {
+      server->conns.erase(server->conns.begin() + i);
+      break;
+    }
+  }
+  server->finished.push_back(sock);
+}
+
+///
+//  Join the connection threads that are done and close their sockets
+//
+static void
+Reap(struct Server* server, std::map<int, std::thread>* threads)
+{
+  std::vector<int> finished;
+  {
+    std::lock_guard<std::mutex> lock(server->conn_mutex);
+    finished.swap(server->finished);
+  }
+  for (size_t i = 0; i < finished.size(); i++) {
+    std::map<int, std::thread>::iterator it = threads->find(finished[i]);
+    it->second.join();
+    threads->erase(it);
+    close(finished[i]);
+  }
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2) {
+    printf("usage: <kernel file.cl>...\n");
+    exit(1);
+  }
+  int platformId = 0;
+  int deviceId = 0;
+  char* platform_str = getenv("PLATFORM");
+  if (platform_str != NULL) {
+    platformId = atoi(platform_str);
+  }
+  char* device_str = getenv("DEVICE");
+  if (device_str != NULL) {
+    deviceId = atoi(device_str);
+  }
+  printf("using platform.device: %d.%d\n", platformId, deviceId);
+
+  // Everything a short job would pay for is paid once here
+  double setup_start = now_ns();
+  cl_device_id device = clrt::select_device(platformId, deviceId, true);
+  if (device == NULL) {
+    return 1;
+  }
+  size_t pool_arena;
+  int pool_bench;
+  clrt::pool_config(&pool_arena, &pool_bench);
+  enum QueueMode queue_mode = QUEUE_BLOCKING;
+  clrt::Runtime rt(device, &queue_mode, pool_arena);
+  struct Server server;
+  server.rt = &rt;
+  CL_CHECK(clGetDeviceInfo(device,
+                           CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+                           sizeof(server.max_alloc),
+                           &server.max_alloc,
+                           NULL));
+  server.connections = 0;
+  server.requests = 0;
+  server.errors = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!LoadKernel(&server, argv[i])) {
+      return 1;
+    }
+  }
+  printf("setup(ns):%lg\n", now_ns() - setup_start);
+
+  const char* path = clserve_socket_path();
+  int listener = clserve_listen(path);
+  if (listener < 0) {
+    return 1;
+  }
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = OnSignal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  printf("listening on %s\n", path);
+  fflush(stdout);
+
+  // One thread per connection; SIGINT or SIGTERM stops the server
+  std::map<int, std::thread> threads; // by socket
+  while (!stop) {
+    Reap(&server, &threads);
+    struct pollfd pfd = { listener, POLLIN, 0 };
+    if (poll(&pfd, 1, 200) <= 0) {
+      continue;
+    }
+    int sock = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+    if (sock < 0) {
+      continue;
+    }
+    server.connections++;
+    {
+      std::lock_guard<std::mutex> lock(server.conn_mutex);
+      server.conns.push_back(sock);
+    }
+    threads[sock] = std::thread(Connection, &server, sock);
+  }
+
+  close(listener);
+  unlink(path);
+  {
+    std::lock_guard<std::mutex> lock(server.conn_mutex);
+    for (size_t i = 0; i < server.conns.size(); i++) {
+      shutdown(server.conns[i], SHUT_RDWR);
+    }
+  }
+  for (std::map<int, std::thread>::iterator it = threads.begin();
+       it != threads.end();
+       ++it) {
+    it->second.join();
+    close(it->first);
+  }
+  printf("served %lu requests (%lu failed) on %lu connections\n",
+         (unsigned long)server.requests,
+         (unsigned long)server.errors,
+         (unsigned long)server.connections);
+  rt.pool().print_stats("clserved");
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include "clbatch.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+bool
+clbatch_config(struct BatchConfig* config)
+{
+  config->jobs = 1024;
+  config->min_len = 256;
+  config->max_len = 4096;
+
+  char* jobs_str = getenv("BATCH");
+  if (jobs_str != NULL && atol(jobs_str) > 0) {
+    config->jobs = atol(jobs_str);
+  }
+  char* len_str = getenv("BATCH_LEN");
+  if (len_str != NULL) {
+    unsigned long min, max;
+    if (sscanf(len_str, "%lu:%lu", &min, &max) != 2 || min == 0 ||
+        max < min) {
+      return false;
+    }
+    config->min_len = min;
+    config->max_len = max;
+  }
+  // The kernels take the offsets as int: the longest batch must fit
+  return config->max_len <= INT_MAX / config->jobs;
+}
+
+size_t
+clbatch_pack(const struct BatchConfig* config, cl_int* offsets)
+{
+  size_t span = config->max_len - config->min_len + 1;
+  size_t total = 0;
+  offsets[0] = 0;
+  for (size_t j = 0; j < config->jobs; j++) {
+    total += config->min_len + (size_t)rand() % span;
+    offsets[j + 1] = (cl_int)total;
+  }
+  return total;
+}
+
+size_t
+clbatch_local(cl_kernel kernel,
+              cl_device_id device,
+              const struct LocalConfig* config)
+{
+  size_t local = CLBATCH_LOCAL;
+  if (config->mode == LOCAL_FIXED && config->local > 0) {
+    local = config->local;
+  }
+  size_t max_local;
+  if (clGetKernelWorkGroupInfo(kernel,
+                               device,
+                               CL_KERNEL_WORK_GROUP_SIZE,
+                               sizeof(max_local),
+                               &max_local,
+                               NULL) == CL_SUCCESS &&
+      max_local < local) {
+    local = max_local;
+  }
+  return local;
+}
+
+void
+clbatch_print(const struct BenchResult* batches,
+              size_t jobs,
+              double kernel_ns,
+              double unbatched_ns)
+{
+  double batch_ns = batches->exec.median;
+  printf("batch: %ld jobs, %ld elements\n", jobs, batches->vector_len);
+  printf("batch latency(ns): median %.0f  p99 %.0f  max %.0f\n",
+         batch_ns,
+         batches->exec.p99,
+         batches->exec.max);
+  if (batch_ns <= 0) {
+    return;
+  }
+  printf("batch throughput: %.0f jobs/s, %.3f Gelem/s, %.3f GB/s\n",
+         1e9 * jobs / batch_ns,
+         batches->vector_len / batch_ns,
+         batches->bytes / batch_ns);
+  printf("batch kernel(ns): %.0f (%.1f%% of the batch)\n",
+         kernel_ns,
+         100.0 * kernel_ns / batch_ns);
+  if (unbatched_ns > 0) {
+    printf("unbatched: %.0f jobs/s (%.0f ns per job), batched x%.1f\n",
+           1e9 / unbatched_ns,
+           unbatched_ns,
+           unbatched_ns * jobs / batch_ns);
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef CLBATCH_H
+#define CLBATCH_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "clbench.h"
+#include "cltune.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Local size of the batch kernels, unless LOCAL=<n> asks for less
+#define CLBATCH_LOCAL 256
+
+///
+//  Many small jobs packed into one launch (*.batch.cl kernels): job j is
+//  elements [offsets[j], offsets[j + 1]) of contiguous vectors, and one
+//  work-group runs it
+//
+struct BatchConfig
+{
+  size_t jobs;    // per batch
+  size_t min_len; // elements of a job, drawn uniformly in [min, max]
+  size_t max_len;
+};
+
+///
+//  Env vars:
+//  - BATCH: (int) jobs per batch (default 1024)
+//  - BATCH_LEN: (str) min:max elements of a job (default 256:4096)
+//
+//  Returns false on an invalid BATCH_LEN, or if BATCH jobs of the longest
+//  length would not fit the int offsets of the kernels.
+//
+bool
+clbatch_config(struct BatchConfig* config);
+
+///
+//  Draw the job lengths of a batch into offsets (jobs + 1 entries, from 0).
+//  Returns the elements of the batch.
+//
+size_t
+clbatch_pack(const struct BatchConfig* config, cl_int* offsets);
+
+///
+//  Work-group size of a batch kernel on device: CLBATCH_LOCAL (or LOCAL=<n>)
+//  capped by what the kernel can run
+//
+size_t
+clbatch_local(cl_kernel kernel,
+              cl_device_id device,
+              const struct LocalConfig* config);
+
+///
+//  Jobs/s and per-batch latency (median, p99) of batches, whose samples are
+//  host wall clock from the first write to the read of the outputs, the
+//  kernel share of kernel_ns (median) and the speedup over one launch per
+//  job (unbatched_ns per job, 0 if not measured)
+//
+void
+clbatch_print(const struct BenchResult* batches,
+              size_t jobs,
+              double kernel_ns,
+              double unbatched_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
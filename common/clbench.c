@@ -0,0 +1,504 @@
+#include "clbench.h"
+#include "cltrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void
+clbench_config(int* iterations, int* warmup)
+{
+  *iterations = 1;
+  *warmup = 0;
+  char* iterations_str = getenv("ITERATIONS");
+  if (iterations_str != NULL && atoi(iterations_str) > 0) {
+    *iterations = atoi(iterations_str);
+  }
+  char* warmup_str = getenv("WARMUP");
+  if (warmup_str != NULL && atoi(warmup_str) > 0) {
+    *warmup = atoi(warmup_str);
+  }
+}
+
+bool
+clbench_queue_config(enum QueueMode* mode)
+{
+  *mode = QUEUE_BLOCKING;
+  char* queue_str = getenv("QUEUE");
+  if (queue_str == NULL || strcmp(queue_str, "BLOCKING") == 0) {
+    return true;
+  }
+  if (strcmp(queue_str, "IN_ORDER") == 0) {
+    *mode = QUEUE_IN_ORDER;
+    return true;
+  }
+  if (strcmp(queue_str, "OUT_OF_ORDER") == 0) {
+    *mode = QUEUE_OUT_OF_ORDER;
+    return true;
+  }
+  return false;
+}
+
+const char*
+clbench_queue_name(enum QueueMode mode)
+{
+  switch (mode) {
+    case QUEUE_BLOCKING:
+      return "BLOCKING";
+    case QUEUE_IN_ORDER:
+      return "IN_ORDER";
+    case QUEUE_OUT_OF_ORDER:
+      return "OUT_OF_ORDER";
+  }
+  return "unknown";
+}
+
+cl_command_queue
+clbench_create_queue(cl_context context,
+                     cl_device_id device,
+                     enum QueueMode* mode,
+                     cl_int* err)
+{
+  cl_command_queue_properties props = CL_QUEUE_PROFILING_ENABLE;
+  if (*mode == QUEUE_OUT_OF_ORDER) {
+    cl_command_queue_properties supported = 0;
+    clGetDeviceInfo(device,
+                    CL_DEVICE_QUEUE_ON_HOST_PROPERTIES,
+                    sizeof(supported),
+                    &supported,
+                    NULL);
+    if (supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) {
+      props |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+    } else {
+      printf("queue: no out-of-order execution on the device, using "
+             "IN_ORDER\n");
+      *mode = QUEUE_IN_ORDER;
+    }
+  }
+  const cl_queue_properties properties[] = { CL_QUEUE_PROPERTIES, props, 0 };
+  return clCreateCommandQueueWithProperties(context, device, properties, err);
+}
+
+bool
+clbench_parse_sweep(const char* str, struct SweepRange* range)
+{
+  unsigned long min, max;
+  double factor;
+  if (sscanf(str, "%lu:%lu:%lf", &min, &max, &factor) != 3 || min == 0 ||
+      max < min || factor <= 1.0) {
+    return false;
+  }
+  range->min = min;
+  range->max = max;
+  range->factor = factor;
+  return true;
+}
+
+size_t
+clbench_sweep_next(const struct SweepRange* range, size_t size)
+{
+  size_t next = (size_t)(size * range->factor);
+  if (next <= size) {
+    next = size + 1;
+  }
+  return next <= range->max ? next : 0;
+}
+
+cl_int
+clbench_sample(cl_event event, struct BenchSample* sample)
+{
+  cl_int err;
+  err = clGetEventProfilingInfo(event,
+                                CL_PROFILING_COMMAND_QUEUED,
+                                sizeof(sample->queued),
+                                &sample->queued,
+                                NULL);
+  err |= clGetEventProfilingInfo(event,
+                                 CL_PROFILING_COMMAND_SUBMIT,
+                                 sizeof(sample->submit),
+                                 &sample->submit,
+                                 NULL);
+  err |= clGetEventProfilingInfo(event,
+                                 CL_PROFILING_COMMAND_START,
+                                 sizeof(sample->start),
+                                 &sample->start,
+                                 NULL);
+  err |= clGetEventProfilingInfo(event,
+                                 CL_PROFILING_COMMAND_END,
+                                 sizeof(sample->end),
+                                 &sample->end,
+                                 NULL);
+  if (err == CL_SUCCESS) {
+    cltrace_command(NULL, event, sample);
+  }
+  return err;
+}
+
+static int
+compare_double(const void* a, const void* b)
+{
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted array
+static double
+percentile(const double* sorted, size_t n, double p)
+{
+  size_t rank = (size_t)(p / 100.0 * n + 0.999999);
+  if (rank < 1) {
+    rank = 1;
+  }
+  if (rank > n) {
+    rank = n;
+  }
+  return sorted[rank - 1];
+}
+
+static void
+compute_stats(double* values, size_t n, struct BenchStats* stats)
+{
+  memset(stats, 0, sizeof(*stats));
+  stats->runs = n;
+  if (n == 0) {
+    return;
+  }
+  qsort(values, n, sizeof(double), compare_double);
+  double sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    sum += values[i];
+  }
+  stats->min = values[0];
+  stats->max = values[n - 1];
+  stats->mean = sum / n;
+  stats->median =
+    n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+  stats->p95 = percentile(values, n, 95);
+  stats->p99 = percentile(values, n, 99);
+}
+
+void
+clbench_result(struct BenchResult* result,
+               cl_device_id device,
+               const char* op,
+               const char* kernel,
+               size_t vector_len,
+               double bytes,
+               double flops,
+               const struct BenchSample* samples,
+               size_t runs,
+               int warmup)
+{
+  memset(result, 0, sizeof(*result));
+  snprintf(result->op, sizeof(result->op), "%s", op);
+  snprintf(result->kernel, sizeof(result->kernel), "%s", kernel);
+  if (device != NULL) {
+    clGetDeviceInfo(
+      device, CL_DEVICE_NAME, sizeof(result->device), result->device, NULL);
+    clGetDeviceInfo(
+      device, CL_DRIVER_VERSION, sizeof(result->driver), result->driver, NULL);
+  }
+  result->vector_len = vector_len;
+  result->warmup = warmup;
+  result->bytes = bytes;
+  result->flops = flops;
+  result->samples = samples;
+
+  double* values = (double*)malloc(sizeof(double) * (runs > 0 ? runs : 1));
+  for (size_t i = 0; i < runs; i++) {
+    values[i] = (double)(samples[i].end - samples[i].start);
+  }
+  compute_stats(values, runs, &result->exec);
+  for (size_t i = 0; i < runs; i++) {
+    values[i] = (double)(samples[i].end - samples[i].queued);
+  }
+  compute_stats(values, runs, &result->latency);
+  free(values);
+}
+
+void
+clbench_overlap(const struct BenchSample* samples,
+                size_t n,
+                struct BenchOverlap* overlap)
+{
+  memset(overlap, 0, sizeof(*overlap));
+  if (n == 0) {
+    return;
+  }
+  cl_ulong first = samples[0].start, last = samples[0].end;
+  for (size_t i = 0; i < n; i++) {
+    overlap->serial_ns += (double)(samples[i].end - samples[i].start);
+    if (samples[i].start < first) {
+      first = samples[i].start;
+    }
+    if (samples[i].end > last) {
+      last = samples[i].end;
+    }
+  }
+  overlap->span_ns = (double)(last - first);
+  if (overlap->serial_ns > 0) {
+    overlap->overlap = 1.0 - overlap->span_ns / overlap->serial_ns;
+  }
+}
+
+void
+clbench_print_graph(const struct BenchOverlap* runs, size_t n_runs)
+{
+  double* values = (double*)malloc(sizeof(double) * (n_runs > 0 ? n_runs : 1));
+  struct BenchStats span, serial, overlap;
+  for (size_t i = 0; i < n_runs; i++) {
+    values[i] = runs[i].span_ns;
+  }
+  compute_stats(values, n_runs, &span);
+  for (size_t i = 0; i < n_runs; i++) {
+    values[i] = runs[i].serial_ns;
+  }
+  compute_stats(values, n_runs, &serial);
+  for (size_t i = 0; i < n_runs; i++) {
+    values[i] = runs[i].overlap;
+  }
+  compute_stats(values, n_runs, &overlap);
+  free(values);
+  printf("graph critical path(ns):%lg serial(ns):%lg overlap:%.1f%%\n",
+         span.median,
+         serial.median,
+         100.0 * overlap.median);
+}
+
+// bytes (or flops) per ns is GB/s (or GFLOP/s)
+static double
+rate(double amount, double ns)
+{
+  return ns > 0 ? amount / ns : 0;
+}
+
+void
+clbench_print(const struct BenchResult* r)
+{
+  printf("bench %s: %ld runs (+%d warmup), vector_len %ld\n",
+         r->op,
+         r->exec.runs,
+         r->warmup,
+         r->vector_len);
+  printf("  kernel(ns):  min %.0f  median %.0f  p95 %.0f  p99 %.0f  max %.0f\n",
+         r->exec.min,
+         r->exec.median,
+         r->exec.p95,
+         r->exec.p99,
+         r->exec.max);
+  printf("  latency(ns): min %.0f  median %.0f  p95 %.0f  p99 %.0f  max %.0f\n",
+         r->latency.min,
+         r->latency.median,
+         r->latency.p95,
+         r->latency.p99,
+         r->latency.max);
+  printf("  GB/s: %.3f  GFLOP/s: %.3f\n",
+         rate(r->bytes, r->exec.median),
+         rate(r->flops, r->exec.median));
+}
+
+void
+clbench_print_sweep(const struct BenchResult* results,
+                    const double* host_ns,
+                    size_t n_results)
+{
+  size_t crossover = 0;
+  printf("%12s %12s %12s %12s %12s %12s %10s %10s\n",
+         "vector_len",
+         "kernel(ns)",
+         "h2d(ns)",
+         "d2h(ns)",
+         "offload(ns)",
+         "host(ns)",
+         "kern GB/s",
+         "e2e GB/s");
+  for (size_t i = 0; i < n_results; i++) {
+    const struct BenchResult* r = &results[i];
+    double offload = r->write_ns + r->exec.median + r->read_ns;
+    printf("%12ld %12.0f %12.0f %12.0f %12.0f %12.0f %10.3f %10.3f%s\n",
+           r->vector_len,
+           r->exec.median,
+           r->write_ns,
+           r->read_ns,
+           offload,
+           host_ns[i],
+           rate(r->bytes, r->exec.median),
+           rate(r->bytes, offload),
+           offload < host_ns[i] ? "  *" : "");
+    if (offload < host_ns[i]) {
+      if (crossover == 0) {
+        crossover = r->vector_len;
+      }
+    } else {
+      crossover = 0;
+    }
+  }
+  if (crossover > 0) {
+    printf("offload pays off from vector_len %ld (*)\n", crossover);
+  } else {
+    printf("offload does not pay off in this range\n");
+  }
+}
+
+void
+clbench_print_speedup(const struct BenchResult* r,
+                      const struct BenchResult* base)
+{
+  double offload = r->write_ns + r->exec.median + r->read_ns;
+  double base_offload = base->write_ns + base->exec.median + base->read_ns;
+  printf("speedup %s vs %s, vector_len %ld: kernel %.2fx, e2e %.2fx\n",
+         r->kernel,
+         base->kernel,
+         r->vector_len,
+         rate(base->exec.median, r->exec.median),
+         rate(base_offload, offload));
+}
+
+static void
+write_stats_json(FILE* fp, const char* name, const struct BenchStats* s)
+{
+  fprintf(fp,
+          "    \"%s\": {\"min\": %.0f, \"median\": %.0f, \"p95\": %.0f, "
+          "\"p99\": %.0f, \"max\": %.0f, \"mean\": %.1f},\n",
+          name,
+          s->min,
+          s->median,
+          s->p95,
+          s->p99,
+          s->max,
+          s->mean);
+}
+
+// Device strings come from the driver; keep the output parseable
+static void
+write_string_json(FILE* fp, const char* str)
+{
+  fputc('"', fp);
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      fputc('\\', fp);
+    }
+    fputc((unsigned char)*str < 0x20 ? ' ' : *str, fp);
+  }
+  fputc('"', fp);
+}
+
+static bool
+write_json(FILE* fp, const struct BenchResult* results, size_t n_results)
+{
+  fprintf(fp, "[\n");
+  for (size_t i = 0; i < n_results; i++) {
+    const struct BenchResult* r = &results[i];
+    fprintf(fp, "  {\n    \"op\": ");
+    write_string_json(fp, r->op);
+    fprintf(fp, ",\n    \"kernel\": ");
+    write_string_json(fp, r->kernel);
+    fprintf(fp, ",\n    \"device\": ");
+    write_string_json(fp, r->device);
+    fprintf(fp, ",\n    \"driver\": ");
+    write_string_json(fp, r->driver);
+    fprintf(fp,
+            ",\n    \"vector_len\": %ld,\n    \"warmup\": %d,\n"
+            "    \"bytes\": %.0f,\n    \"flops\": %.0f,\n",
+            r->vector_len,
+            r->warmup,
+            r->bytes,
+            r->flops);
+    fprintf(fp,
+            "    \"write_ns\": %.0f,\n    \"read_ns\": %.0f,\n",
+            r->write_ns,
+            r->read_ns);
+    write_stats_json(fp, "kernel_ns", &r->exec);
+    write_stats_json(fp, "latency_ns", &r->latency);
+    fprintf(fp,
+            "    \"gbps\": %.4f,\n    \"gflops\": %.4f,\n    \"runs\": [",
+            rate(r->bytes, r->exec.median),
+            rate(r->flops, r->exec.median));
+    for (size_t j = 0; j < r->exec.runs; j++) {
+      const struct BenchSample* s = &r->samples[j];
+      fprintf(fp,
+              "%s\n      {\"queued\": %llu, \"submit\": %llu, "
+              "\"start\": %llu, \"end\": %llu}",
+              j > 0 ? "," : "",
+              (unsigned long long)s->queued,
+              (unsigned long long)s->submit,
+              (unsigned long long)s->start,
+              (unsigned long long)s->end);
+    }
+    fprintf(fp, "\n    ]\n  }%s\n", i + 1 < n_results ? "," : "");
+  }
+  fprintf(fp, "]\n");
+  return !ferror(fp);
+}
+
+static void
+write_string_csv(FILE* fp, const char* str)
+{
+  fputc('"', fp);
+  for (; *str; str++) {
+    if (*str == '"') {
+      fputc('"', fp);
+    }
+    fputc(*str, fp);
+  }
+  fputc('"', fp);
+}
+
+static bool
+write_csv(FILE* fp, const struct BenchResult* results, size_t n_results)
+{
+  // Appending: only a new (empty) file gets the header
+  fseek(fp, 0, SEEK_END);
+  if (ftell(fp) == 0) {
+    fprintf(fp,
+            "op,kernel,device,driver,vector_len,runs,warmup,"
+            "min_ns,median_ns,p95_ns,p99_ns,max_ns,mean_ns,"
+            "latency_median_ns,latency_p99_ns,write_ns,read_ns,gbps,gflops\n");
+  }
+  for (size_t i = 0; i < n_results; i++) {
+    const struct BenchResult* r = &results[i];
+    write_string_csv(fp, r->op);
+    fputc(',', fp);
+    write_string_csv(fp, r->kernel);
+    fputc(',', fp);
+    write_string_csv(fp, r->device);
+    fputc(',', fp);
+    write_string_csv(fp, r->driver);
+    fprintf(fp,
+            ",%ld,%ld,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.1f,%.0f,%.0f,%.0f,%.0f,"
+            "%.4f,%.4f\n",
+            r->vector_len,
+            r->exec.runs,
+            r->warmup,
+            r->exec.min,
+            r->exec.median,
+            r->exec.p95,
+            r->exec.p99,
+            r->exec.max,
+            r->exec.mean,
+            r->latency.median,
+            r->latency.p99,
+            r->write_ns,
+            r->read_ns,
+            rate(r->bytes, r->exec.median),
+            rate(r->flops, r->exec.median));
+  }
+  return !ferror(fp);
+}
+
+bool
+clbench_write(const char* path,
+              const struct BenchResult* results,
+              size_t n_results)
+{
+  size_t len = strlen(path);
+  bool json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+  FILE* fp = fopen(path, json ? "w" : "a");
+  if (fp == NULL) {
+    return false;
+  }
+  bool ok = json ? write_json(fp, results, n_results)
+                 : write_csv(fp, results, n_results);
+  return fclose(fp) == 0 && ok;
+}
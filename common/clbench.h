@@ -0,0 +1,202 @@
+#ifndef CLBENCH_H
+#define CLBENCH_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///
+//  OpenCL profiling timestamps of one kernel run (ns, device clock)
+//
+struct BenchSample
+{
+  cl_ulong queued;
+  cl_ulong submit;
+  cl_ulong start;
+  cl_ulong end;
+};
+
+struct BenchStats
+{
+  size_t runs;
+  double min;
+  double median;
+  double p95;
+  double p99;
+  double max;
+  double mean;
+};
+
+///
+//  Summary of ITERATIONS timed runs of one kernel. bytes and flops are the
+//  memory traffic and floating point operations of a single run, used to
+//  derive GB/s and GFLOP/s from the median kernel time.
+//
+struct BenchResult
+{
+  char op[32];
+  char kernel[256];
+  char device[256];
+  char driver[256];
+  size_t vector_len;
+  int warmup;
+  double bytes;
+  double flops;
+  double write_ns; // host -> device transfer wall time, 0 if not measured
+  double read_ns;  // device -> host transfer wall time, 0 if not measured
+  struct BenchStats exec;    // start -> end
+  struct BenchStats latency; // queued -> end
+  const struct BenchSample* samples;
+};
+
+///
+//  How much a set of commands (e.g. the writes, kernels and reads of a
+//  pipeline) ran concurrently
+//
+struct BenchOverlap
+{
+  double serial_ns; // sum of the command durations
+  double span_ns;   // first start to last end
+  double overlap;   // 1 - span / serial: 0 back to back, < 0 with gaps
+};
+
+///
+//  How a run orders its transfers and kernels (QUEUE env var)
+//
+enum QueueMode
+{
+  QUEUE_BLOCKING,     // in-order queue, each command waited for in turn
+  QUEUE_IN_ORDER,     // event graph on an in-order queue
+  QUEUE_OUT_OF_ORDER, // event graph on an out-of-order queue
+};
+
+///
+//  Geometric series of vector sizes, from SWEEP=min:max:factor
+//
+struct SweepRange
+{
+  size_t min;
+  size_t max;
+  double factor;
+};
+
+///
+//  Env vars:
+//  - ITERATIONS: (int) timed kernel runs (default 1)
+//  - WARMUP: (int) untimed kernel runs before them (default 0)
+//  - BENCH_OUT: (str) file to write the results to, JSON if it ends in
+//    .json, CSV otherwise (CSV rows are appended)
+//
+void
+clbench_config(int* iterations, int* warmup);
+
+///
+//  Env var QUEUE: (str) BLOCKING|IN_ORDER|OUT_OF_ORDER (default BLOCKING).
+//  In the event graph modes every command is enqueued without waiting, its
+//  dependencies stated only through event wait lists.
+//
+//  Returns false on an unknown QUEUE value.
+//
+bool
+clbench_queue_config(enum QueueMode* mode);
+
+const char*
+clbench_queue_name(enum QueueMode mode);
+
+///
+//  A profiling queue for the mode. QUEUE_OUT_OF_ORDER falls back to
+//  QUEUE_IN_ORDER (and *mode is updated) if the device cannot execute host
+//  queues out of order.
+//
+cl_command_queue
+clbench_create_queue(cl_context context,
+                     cl_device_id device,
+                     enum QueueMode* mode,
+                     cl_int* err);
+
+bool
+clbench_parse_sweep(const char* str, struct SweepRange* range);
+
+///
+//  Next size of the series after size, or 0 past the end
+//
+size_t
+clbench_sweep_next(const struct SweepRange* range, size_t size);
+
+cl_int
+clbench_sample(cl_event event, struct BenchSample* sample);
+
+///
+//  Statistics of runs samples. A NULL device (results timed on the host)
+//  leaves the device name and driver empty.
+//
+void
+clbench_result(struct BenchResult* result,
+               cl_device_id device,
+               const char* op,
+               const char* kernel,
+               size_t vector_len,
+               double bytes,
+               double flops,
+               const struct BenchSample* samples,
+               size_t runs,
+               int warmup);
+
+void
+clbench_print(const struct BenchResult* result);
+
+///
+//  One row per size: kernel, transfer and total offload time against the
+//  host computing the same operation (host_ns), and the smallest size from
+//  which offloading is faster.
+//
+void
+clbench_print_sweep(const struct BenchResult* results,
+                    const double* host_ns,
+                    size_t n_results);
+
+///
+//  Overlap of n commands, from their profiling samples
+//
+void
+clbench_overlap(const struct BenchSample* samples,
+                size_t n,
+                struct BenchOverlap* overlap);
+
+///
+//  Medians over the runs of an event graph: critical path (span), the sum
+//  of its commands (what an in-order queue would take at best) and overlap
+//
+void
+clbench_print_graph(const struct BenchOverlap* runs, size_t n_runs);
+
+///
+//  Kernel and end-to-end (transfers included) speedup of r over base, the
+//  same operation and vector length with another kernel
+//
+void
+clbench_print_speedup(const struct BenchResult* r,
+                      const struct BenchResult* base);
+
+///
+//  Write results to path (see BENCH_OUT). Returns false on I/O errors.
+//
+bool
+clbench_write(const char* path,
+              const struct BenchResult* results,
+              size_t n_results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,284 @@
+#include "clcache.h"
+#include "cltime.h"
+#include "cltrace.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define CACHE_DIR_DEFAULT ".clcache"
+
+uint64_t
+clcache_hash(uint64_t hash, const void* data, size_t len)
+{
+  const unsigned char* p = (const unsigned char*)data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+  // Separator so that ("ab", "c") and ("a", "bc") hash differently
+  hash ^= 0xff;
+  hash *= 0x100000001b3ULL;
+  return hash;
+}
+
+static uint64_t
+cache_key(cl_device_id device,
+          const char* source,
+          size_t source_len,
+          const char* options)
+{
+  char buffer[1024];
+  uint64_t hash = CLCACHE_HASH_SEED;
+
+  hash = clcache_hash(hash, source, source_len);
+  hash = clcache_hash(hash, options, options != NULL ? strlen(options) : 0);
+  buffer[0] = '\0';
+  clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(buffer), buffer, NULL);
+  hash = clcache_hash(hash, buffer, strlen(buffer));
+  buffer[0] = '\0';
+  clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(buffer), buffer, NULL);
+  hash = clcache_hash(hash, buffer, strlen(buffer));
+  return hash;
+}
+
+static void
+print_build_log(cl_program program, cl_device_id device)
+{
+  char buildLog[16384];
+  buildLog[0] = '\0';
+  clGetProgramBuildInfo(
+    program, device, CL_PROGRAM_BUILD_LOG, sizeof(buildLog), buildLog, NULL);
+  fprintf(stderr, "Error in kernel:\n%s\n", buildLog);
+}
+
+static cl_program
+build_from_source(cl_context context,
+                  cl_device_id device,
+                  const char* source,
+                  size_t source_len,
+                  const char* options)
+{
+  cl_int errNum;
+  cl_program program =
+    clCreateProgramWithSource(context, 1, &source, &source_len, &errNum);
+  if (program == NULL || errNum != CL_SUCCESS) {
+    fprintf(stderr, "Failed to create CL program from source.\n");
+    return NULL;
+  }
+  errNum = clBuildProgram(program, 1, &device, options, NULL, NULL);
+  if (errNum != CL_SUCCESS) {
+    print_build_log(program, device);
+    clReleaseProgram(program);
+    return NULL;
+  }
+  return program;
+}
+
+static cl_program
+load_binary(cl_context context,
+            cl_device_id device,
+            const char* path,
+            const char* options,
+            bool* invalid)
+{
+  *invalid = false;
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) {
+    return NULL;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  rewind(fp);
+  if (size <= 0) {
+    fclose(fp);
+    *invalid = true;
+    return NULL;
+  }
+
+  size_t binarySize = (size_t)size;
+  unsigned char* binary = (unsigned char*)malloc(binarySize);
+  size_t got = fread(binary, 1, binarySize, fp);
+  fclose(fp);
+  if (got != binarySize) {
+    free(binary);
+    *invalid = true;
+    return NULL;
+  }
+
+  cl_int errNum = CL_SUCCESS;
+  cl_int binaryStatus = CL_SUCCESS;
+  cl_program program =
+    clCreateProgramWithBinary(context,
+                              1,
+                              &device,
+                              &binarySize,
+                              (const unsigned char**)&binary,
+                              &binaryStatus,
+                              &errNum);
+  free(binary);
+  if (program == NULL || errNum != CL_SUCCESS ||
+      binaryStatus != CL_SUCCESS) {
+    if (program != NULL) {
+      clReleaseProgram(program);
+    }
+    *invalid = true;
+    return NULL;
+  }
+
+  // Binaries still need a (cheap) build step to become executable
+  if (clBuildProgram(program, 1, &device, options, NULL, NULL) !=
+      CL_SUCCESS) {
+    clReleaseProgram(program);
+    *invalid = true;
+    return NULL;
+  }
+  return program;
+}
+
+static bool
+store_binary(cl_program program, const char* dir, const char* path)
+{
+  size_t binarySize = 0;
+  if (clGetProgramInfo(program,
+                       CL_PROGRAM_BINARY_SIZES,
+                       sizeof(binarySize),
+                       &binarySize,
+                       NULL) != CL_SUCCESS ||
+      binarySize == 0) {
+    return false;
+  }
+
+  unsigned char* binary = (unsigned char*)malloc(binarySize);
+  if (clGetProgramInfo(
+        program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL) !=
+      CL_SUCCESS) {
+    free(binary);
+    return false;
+  }
+
+  bool ok = clcache_write_file(dir, path, binary, binarySize);
+  free(binary);
+  return ok;
+}
+
+bool
+clcache_write_file(const char* dir,
+                   const char* path,
+                   const void* data,
+                   size_t len)
+{
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    return false;
+  }
+
+  // Write to a private temporary file and rename it into place: rename() is
+  // atomic, so a concurrent reader sees either no entry or a complete one.
+  char tmpPath[4096];
+  snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", path, (int)getpid());
+  FILE* fp = fopen(tmpPath, "wb");
+  if (fp == NULL) {
+    return false;
+  }
+  bool ok = fwrite(data, 1, len, fp) == len;
+  ok = fflush(fp) == 0 && ok;
+  ok = fsync(fileno(fp)) == 0 && ok;
+  ok = fclose(fp) == 0 && ok;
+  if (!ok || rename(tmpPath, path) != 0) {
+    unlink(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+const char*
+clcache_dir(void)
+{
+  const char* dir = getenv("CACHE_DIR");
+  return dir != NULL ? dir : CACHE_DIR_DEFAULT;
+}
+
+static cl_program
+cache_program(cl_context context,
+              cl_device_id device,
+              const char* source,
+              size_t source_len,
+              const char* options,
+              enum CacheStatus* status)
+{
+  char* cache_str = getenv("CACHE");
+  const char* dir = clcache_dir();
+
+  if (cache_str != NULL && atoi(cache_str) == 0) {
+    *status = CACHE_DISABLED;
+    return build_from_source(context, device, source, source_len, options);
+  }
+
+  char path[4096];
+  snprintf(path,
+           sizeof(path),
+           "%s/%016llx.bin",
+           dir,
+           (unsigned long long)cache_key(device, source, source_len, options));
+
+  bool invalid = false;
+  cl_program program = load_binary(context, device, path, options, &invalid);
+  if (program != NULL) {
+    *status = CACHE_HIT;
+    return program;
+  }
+  *status = invalid ? CACHE_INVALID : CACHE_MISS;
+
+  program = build_from_source(context, device, source, source_len, options);
+  if (program != NULL && !store_binary(program, dir, path)) {
+    fprintf(stderr, "Failed to write program binary to %s\n", path);
+  }
+  return program;
+}
+
+cl_program
+clcache_program(cl_context context,
+                cl_device_id device,
+                const char* source,
+                size_t source_len,
+                const char* options,
+                enum CacheStatus* status)
+{
+  double start = now_ns();
+  enum CacheStatus cache_status;
+  cl_program program = cache_program(
+    context, device, source, source_len, options, &cache_status);
+  if (status != NULL) {
+    *status = cache_status;
+  }
+  char name[64];
+  snprintf(name,
+           sizeof(name),
+           "build program (cache %s)",
+           clcache_status_name(cache_status));
+  cltrace_phase(name, start);
+  return program;
+}
+
+const char*
+clcache_status_name(enum CacheStatus status)
+{
+  switch (status) {
+    case CACHE_DISABLED:
+      return "disabled";
+    case CACHE_MISS:
+      return "miss";
+    case CACHE_HIT:
+      return "hit";
+    case CACHE_INVALID:
+      return "invalid";
+  }
+  return "unknown";
+}
@@ -0,0 +1,83 @@
+#ifndef CLCACHE_H
+#define CLCACHE_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum CacheStatus
+{
+  CACHE_DISABLED,
+  CACHE_MISS,
+  CACHE_HIT,
+  CACHE_INVALID,
+};
+
+///
+//  Create and build a program for a single device, going through the
+//  on-disk binary cache.
+//
+//  The cache key combines the kernel source, the build options, the device
+//  name and the driver version. On a hit the stored binary is loaded and
+//  built; if the driver rejects it the program is rebuilt from source and
+//  the entry is replaced. On a miss the program is built from source and its
+//  binary stored. Entries are written to a temporary file and renamed into
+//  place, so concurrent runs never observe a partial binary.
+//
+//  Env vars:
+//  - CACHE: (int) 1|0 to enable the cache (default 1)
+//  - CACHE_DIR: (str) cache directory (default .clcache)
+//
+//  Returns NULL (with the build log on stderr) if the source does not build.
+//
+cl_program
+clcache_program(cl_context context,
+                cl_device_id device,
+                const char* source,
+                size_t source_len,
+                const char* options,
+                enum CacheStatus* status);
+
+const char*
+clcache_status_name(enum CacheStatus status);
+
+#define CLCACHE_HASH_SEED 0xcbf29ce484222325ULL
+
+///
+//  FNV-1a of data, chained from hash (start from CLCACHE_HASH_SEED). Other
+//  on-disk entries keyed like the program binaries use it too.
+//
+uint64_t
+clcache_hash(uint64_t hash, const void* data, size_t len);
+
+///
+//  CACHE_DIR, or the default cache directory
+//
+const char*
+clcache_dir(void);
+
+///
+//  Atomically replace path (in the cache directory dir, created if missing)
+//  with len bytes of data
+//
+bool
+clcache_write_file(const char* dir,
+                   const char* path,
+                   const void* data,
+                   size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef CLCHECK_H
+#define CLCHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+///
+//  Abort with the failing call on an OpenCL error. CL_CHECK takes a call
+//  returning cl_int; CL_CHECK_ERR a call returning an object, with &_err as
+//  its error argument.
+//
+#define CL_CHECK(_expr)                                                        \
+  do {                                                                         \
+    cl_int _err = _expr;                                                       \
+    if (_err == CL_SUCCESS)                                                    \
+      break;                                                                   \
+    fprintf(stderr, "OpenCL Error: '%s' returned %d!\n", #_expr, (int)_err);   \
+    abort();                                                                   \
+  } while (0)
+
+#define CL_CHECK_ERR(_expr)                                                    \
+  ({                                                                           \
+    cl_int _err = CL_INVALID_VALUE;                                            \
+    typeof(_expr) _ret = _expr;                                                \
+    if (_err != CL_SUCCESS) {                                                  \
+      fprintf(stderr, "OpenCL Error: '%s' returned %d!\n", #_expr, (int)_err); \
+      abort();                                                                 \
+    }                                                                          \
+    _ret;                                                                      \
+  })
+
+#endif
@@ -0,0 +1,128 @@
+#include "cldtype.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool
+cldtype_config(enum DataType* dtype)
+{
+  *dtype = DTYPE_F32;
+  char* dtype_str = getenv("DTYPE");
+  if (dtype_str == NULL || strcmp(dtype_str, "f32") == 0) {
+    return true;
+  }
+  if (strcmp(dtype_str, "f16") == 0) {
+    *dtype = DTYPE_F16;
+    return true;
+  }
+  if (strcmp(dtype_str, "f64") == 0) {
+    *dtype = DTYPE_F64;
+    return true;
+  }
+  return false;
+}
+
+const char*
+cldtype_name(enum DataType dtype)
+{
+  switch (dtype) {
+    case DTYPE_F32:
+      return "f32";
+    case DTYPE_F16:
+      return "f16";
+    case DTYPE_F64:
+      return "f64";
+  }
+  return "unknown";
+}
+
+size_t
+cldtype_size(enum DataType dtype)
+{
+  switch (dtype) {
+    case DTYPE_F16:
+      return 2;
+    case DTYPE_F64:
+      return 8;
+    default:
+      return 4;
+  }
+}
+
+const char*
+cldtype_option(enum DataType dtype)
+{
+  switch (dtype) {
+    case DTYPE_F16:
+      return "-DDTYPE_F16";
+    case DTYPE_F64:
+      return "-DDTYPE_F64";
+    default:
+      return "";
+  }
+}
+
+const char*
+cldtype_preamble(void)
+{
+  // f16 computes in float (vload_half/vstore_half, no extension needed),
+  // f64 in double (cl_khr_fp64)
+  return "#if defined(DTYPE_F64)\n"
+         "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+         "#define DATA double\n"
+         "#define REAL double\n"
+         "#define LOAD(i, p) (p)[i]\n"
+         "#define STORE(v, i, p) ((p)[i] = (v))\n"
+         "#elif defined(DTYPE_F16)\n"
+         "#define DATA half\n"
+         "#define REAL float\n"
+         "#define LOAD(i, p) vload_half(i, p)\n"
+         "#define STORE(v, i, p) vstore_half(v, i, p)\n"
+         "#else\n"
+         "#define DATA float\n"
+         "#define REAL float\n"
+         "#define LOAD(i, p) (p)[i]\n"
+         "#define STORE(v, i, p) ((p)[i] = (v))\n"
+         "#endif\n";
+}
+
+// name is one of the space-separated CL_DEVICE_EXTENSIONS of device
+static bool
+dtype_extension(cl_device_id device, const char* name)
+{
+  size_t size = 0;
+  if (clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, NULL, &size) !=
+        CL_SUCCESS ||
+      size == 0) {
+    return false;
+  }
+  char* extensions = (char*)malloc(size);
+  bool found = false;
+  if (clGetDeviceInfo(
+        device, CL_DEVICE_EXTENSIONS, size, extensions, NULL) == CL_SUCCESS) {
+    size_t len = strlen(name);
+    for (char* p = strstr(extensions, name); p != NULL && !found;
+         p = strstr(p + len, name)) {
+      found = (p == extensions || p[-1] == ' ') &&
+              (p[len] == '\0' || p[len] == ' ');
+    }
+  }
+  free(extensions);
+  return found;
+}
+
+bool
+cldtype_supported(cl_device_id device, enum DataType dtype, bool* native)
+{
+  switch (dtype) {
+    case DTYPE_F16:
+      *native = dtype_extension(device, "cl_khr_fp16");
+      return true;
+    case DTYPE_F64:
+      *native = dtype_extension(device, "cl_khr_fp64");
+      return *native;
+    default:
+      *native = true;
+      return true;
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef CLDTYPE_H
+#define CLDTYPE_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///
+//  Element type of the device buffers of the element-wise kernels. The host
+//  fills, checks and times in float; the host engine converts the buffers.
+//
+enum DataType
+{
+  DTYPE_F32,
+  DTYPE_F16, // half storage (vload_half/vstore_half), float compute
+  DTYPE_F64, // double storage and compute (cl_khr_fp64)
+};
+
+///
+//  Env var DTYPE: (str) f16|f32|f64 (default f32)
+//
+//  Returns false on an unknown DTYPE value.
+//
+bool
+cldtype_config(enum DataType* dtype);
+
+const char*
+cldtype_name(enum DataType dtype);
+
+///
+//  Bytes of an element in the device buffers
+//
+size_t
+cldtype_size(enum DataType dtype);
+
+///
+//  Build option selecting dtype in the kernel files ("" for f32)
+//
+const char*
+cldtype_option(enum DataType dtype);
+
+///
+//  OpenCL C macros for the element type of a build with cldtype_option:
+//  DATA (storage), REAL (compute), LOAD(i, p) and STORE(v, i, p). Part of
+//  the preamble the program caches prepend to the kernel files.
+//
+const char*
+cldtype_preamble(void);
+
+///
+//  Whether the device can run the kernels on dtype: f64 needs cl_khr_fp64,
+//  f16 storage works on any device. *native: the device also has arithmetic
+//  on the type (cl_khr_fp16 for f16).
+//
+bool
+cldtype_supported(cl_device_id device, enum DataType dtype, bool* native);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1070 @@
+#include "clhost.hpp"
+#include "cltime.h"
+#include "cltrace.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HOST_X86 1
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define HOST_NEON 1
+#endif
+
+namespace clrt {
+
+// Elements a thread computes at least, below which ranges are not split
+#define HOST_GRAIN 16384
+// Elements check computes at a time into a stack buffer before comparing
+#define HOST_BLOCK 1024
+
+typedef void (*ComputeFn)(enum HostOp op,
+                          const float* a,
+                          const float* b,
+                          float factor,
+                          float* out,
+                          size_t n);
+// Mismatches of x against y, the first one in *first
+typedef size_t (*CountFn)(const float* x,
+                          const float* y,
+                          size_t n,
+                          size_t* first);
+
+static void
+compute_scalar(enum HostOp op,
+               const float* a,
+               const float* b,
+               float factor,
+               float* out,
+               size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    switch (op) {
+      case HOST_SAXPY:
+        out[i] = a[i] * factor;
+        break;
+      case HOST_DSUM:
+        out[i] = a[i] + a[i];
+        break;
+      case HOST_DMUL:
+        out[i] = 2.0f * a[i];
+        break;
+      case HOST_VECADD:
+        out[i] = a[i] + b[i];
+        break;
+      case HOST_VECMUL:
+        out[i] = a[i] * b[i];
+        break;
+    }
+  }
+}
+
+static size_t
+count_scalar(const float* x, const float* y, size_t n, size_t* first)
+{
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (x[i] != y[i]) {
+      if (count == 0) {
+        *first = i;
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+// Mismatches of the scalar tail [i, n) added to the count of [0, i)
+static size_t
+count_tail(const float* x,
+           const float* y,
+           size_t i,
+           size_t n,
+           size_t count,
+           size_t* first)
+{
+  size_t tail_first = 0;
+  size_t tail = count_scalar(x + i, y + i, n - i, &tail_first);
+  if (count == 0 && tail > 0) {
+    *first = i + tail_first;
+  }
+  return count + tail;
+}
+
+static inline const float*
+tail_ptr(const float* p, size_t i)
+{
+  return p != NULL ? p + i : NULL;
+}
+
+// Storage conversions: dst or src holds n elements of dtype
+typedef void (*StoreFn)(enum DataType dtype,
+                        const float* src,
+                        void* dst,
+                        size_t n);
+typedef void (*LoadFn)(enum DataType dtype,
+                       const void* src,
+                       float* dst,
+                       size_t n);
+
+// Round to nearest even, overflowing to infinity, NaNs kept quiet
+static uint16_t
+half_from_float(float f)
+{
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint16_t sign = (x >> 16) & 0x8000;
+  uint32_t abs = x & 0x7fffffff;
+  if (abs > 0x7f800000) {
+    return sign | 0x7e00 | ((abs >> 13) & 0x3ff);
+  }
+  if (abs >= 0x477ff000) { // 65520 and up round to infinity
+    return sign | 0x7c00;
+  }
+  if (abs >= 0x38800000) { // normal half: rebias the exponent
+    uint32_t h = (abs - 0x38000000) >> 13;
+    uint32_t rest = abs & 0x1fff;
+    h += rest > 0x1000 || (rest == 0x1000 && (h & 1));
+    return sign | h;
+  }
+  if (abs <= 0x33000000) { // up to 2^-25, half of the smallest subnormal
+    return sign;
+  }
+  // Subnormal half: units of 2^-24
+  uint32_t shift = 126 - (abs >> 23);
+  uint32_t m = (abs & 0x7fffff) | 0x800000;
+  uint32_t h = m >> shift;
+  uint32_t rest = m & ((1u << shift) - 1);
+  uint32_t halfway = 1u << (shift - 1);
+  h += rest > halfway || (rest == halfway && (h & 1));
+  return sign | h;
+}
+
+static float
+half_to_float(uint16_t h)
+{
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t x;
+  if (exp == 0x1f) {
+    // NaNs come back quiet, like the hardware conversions
+    x = sign | 0x7f800000 | (mant << 13) | (mant != 0 ? 0x400000 : 0);
+  } else if (exp != 0) {
+    x = sign | ((exp + 112) << 23) | (mant << 13);
+  } else if (mant == 0) {
+    x = sign;
+  } else {
+    // Subnormal half: normalize the mantissa
+    uint32_t e = 113;
+    while ((mant & 0x400) == 0) {
+      mant <<= 1;
+      e--;
+    }
+    x = sign | (e << 23) | ((mant & 0x3ff) << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+static void
+store_scalar(enum DataType dtype, const float* src, void* dst, size_t n)
+{
+  if (dtype == DTYPE_F16) {
+    uint16_t* h = (uint16_t*)dst;
+    for (size_t i = 0; i < n; i++) {
+      h[i] = half_from_float(src[i]);
+    }
+  } else if (dtype == DTYPE_F64) {
+    double* d = (double*)dst;
+    for (size_t i = 0; i < n; i++) {
+      d[i] = src[i];
+    }
+  } else {
+    memcpy(dst, src, sizeof(float) * n);
+  }
+}
+
+static void
+load_scalar(enum DataType dtype, const void* src, float* dst, size_t n)
+{
+  if (dtype == DTYPE_F16) {
+    const uint16_t* h = (const uint16_t*)src;
+    for (size_t i = 0; i < n; i++) {
+      dst[i] = half_to_float(h[i]);
+    }
+  } else if (dtype == DTYPE_F64) {
+    const double* d = (const double*)src;
+    for (size_t i = 0; i < n; i++) {
+      dst[i] = (float)d[i];
+    }
+  } else {
+    memcpy(dst, src, sizeof(float) * n);
+  }
+}
+
+static inline void*
+storage_ptr(enum DataType dtype, void* p, size_t i)
+{
+  return (char*)p + cldtype_size(dtype) * i;
+}
+
+static inline const void*
+storage_ptr(enum DataType dtype, const void* p, size_t i)
+{
+  return (const char*)p + cldtype_size(dtype) * i;
+}
+
+#ifdef HOST_X86
+__attribute__((target("avx2"))) static void
+compute_avx2(enum HostOp op,
+             const float* a,
+             const float* b,
+             float factor,
+             float* out,
+             size_t n)
+{
+  const __m256 f = _mm256_set1_ps(op == HOST_DMUL ? 2.0f : factor);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps(a + i);
+    __m256 y;
+    switch (op) {
+      case HOST_SAXPY:
+      case HOST_DMUL:
+        y = _mm256_mul_ps(x, f);
+        break;
+      case HOST_DSUM:
+        y = _mm256_add_ps(x, x);
+        break;
+      case HOST_VECADD:
+        y = _mm256_add_ps(x, _mm256_loadu_ps(b + i));
+        break;
+      default:
+        y = _mm256_mul_ps(x, _mm256_loadu_ps(b + i));
+        break;
+    }
+    _mm256_storeu_ps(out + i, y);
+  }
+  compute_scalar(op, a + i, tail_ptr(b, i), factor, out + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t
+count_avx2(const float* x, const float* y, size_t n, size_t* first)
+{
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int neq = _mm256_movemask_ps(_mm256_cmp_ps(
+      _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), _CMP_NEQ_UQ));
+    if (neq != 0) {
+      if (count == 0) {
+        *first = i + __builtin_ctz(neq);
+      }
+      count += __builtin_popcount(neq);
+    }
+  }
+  return count_tail(x, y, i, n, count, first);
+}
+
+__attribute__((target("avx512f"))) static void
+compute_avx512(enum HostOp op,
+               const float* a,
+               const float* b,
+               float factor,
+               float* out,
+               size_t n)
+{
+  const __m512 f = _mm512_set1_ps(op == HOST_DMUL ? 2.0f : factor);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 x = _mm512_loadu_ps(a + i);
+    __m512 y;
+    switch (op) {
+      case HOST_SAXPY:
+      case HOST_DMUL:
+        y = _mm512_mul_ps(x, f);
+        break;
+      case HOST_DSUM:
+        y = _mm512_add_ps(x, x);
+        break;
+      case HOST_VECADD:
+        y = _mm512_add_ps(x, _mm512_loadu_ps(b + i));
+        break;
+      default:
+        y = _mm512_mul_ps(x, _mm512_loadu_ps(b + i));
+        break;
+    }
+    _mm512_storeu_ps(out + i, y);
+  }
+  compute_scalar(op, a + i, tail_ptr(b, i), factor, out + i, n - i);
+}
+
+__attribute__((target("avx512f"))) static size_t
+count_avx512(const float* x, const float* y, size_t n, size_t* first)
+{
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __mmask16 neq = _mm512_cmp_ps_mask(
+      _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), _CMP_NEQ_UQ);
+    if (neq != 0) {
+      if (count == 0) {
+        *first = i + __builtin_ctz(neq);
+      }
+      count += __builtin_popcount(neq);
+    }
+  }
+  return count_tail(x, y, i, n, count, first);
+}
+
+// Every AVX2 CPU has F16C: host_supports requires both
+__attribute__((target("avx2,f16c"))) static void
+store_avx2(enum DataType dtype, const float* src, void* dst, size_t n)
+{
+  size_t i = 0;
+  if (dtype == DTYPE_F16) {
+    uint16_t* h = (uint16_t*)dst;
+    for (; i + 8 <= n; i += 8) {
+      __m128i y = _mm256_cvtps_ph(_mm256_loadu_ps(src + i),
+                                  _MM_FROUND_TO_NEAREST_INT);
+      _mm_storeu_si128((__m128i*)(h + i), y);
+    }
+  } else if (dtype == DTYPE_F64) {
+    double* d = (double*)dst;
+    for (; i + 8 <= n; i += 8) {
+      __m256 x = _mm256_loadu_ps(src + i);
+      _mm256_storeu_pd(d + i, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+      _mm256_storeu_pd(d + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+    }
+  }
+  store_scalar(dtype, src + i, storage_ptr(dtype, dst, i), n - i);
+}
+
+__attribute__((target("avx2,f16c"))) static void
+load_avx2(enum DataType dtype, const void* src, float* dst, size_t n)
+{
+  size_t i = 0;
+  if (dtype == DTYPE_F16) {
+    const uint16_t* h = (const uint16_t*)src;
+    for (; i + 8 <= n; i += 8) {
+      __m128i x = _mm_loadu_si128((const __m128i*)(h + i));
+      _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(x));
+    }
+  } else if (dtype == DTYPE_F64) {
+    const double* d = (const double*)src;
+    for (; i + 8 <= n; i += 8) {
+      __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(d + i));
+      __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(d + i + 4));
+      _mm256_storeu_ps(dst + i, _mm256_set_m128(hi, lo));
+    }
+  }
+  load_scalar(dtype, storage_ptr(dtype, src, i), dst + i, n - i);
+}
+
+__attribute__((target("avx512f"))) static void
+store_avx512(enum DataType dtype, const float* src, void* dst, size_t n)
+{
+  size_t i = 0;
+  if (dtype == DTYPE_F16) {
+    uint16_t* h = (uint16_t*)dst;
+    for (; i + 16 <= n; i += 16) {
+      __m256i y = _mm512_cvtps_ph(_mm512_loadu_ps(src + i),
+                                  _MM_FROUND_TO_NEAREST_INT);
+      _mm256_storeu_si256((__m256i*)(h + i), y);
+    }
+  } else if (dtype == DTYPE_F64) {
+    double* d = (double*)dst;
+    for (; i + 16 <= n; i += 16) {
+      __m512 x = _mm512_loadu_ps(src + i);
+      _mm512_storeu_pd(d + i, _mm512_cvtps_pd(_mm512_castps512_ps256(x)));
+      _mm512_storeu_pd(
+        d + i + 8,
+        _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(
+          _mm512_castps_pd(x), 1))));
+    }
+  }
+  store_scalar(dtype, src + i, storage_ptr(dtype, dst, i), n - i);
+}
+
+__attribute__((target("avx512f"))) static void
+load_avx512(enum DataType dtype, const void* src, float* dst, size_t n)
+{
+  size_t i = 0;
+  if (dtype == DTYPE_F16) {
+    const uint16_t* h = (const uint16_t*)src;
+    for (; i + 16 <= n; i += 16) {
+      __m256i x = _mm256_loadu_si256((const __m256i*)(h + i));
+      _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(x));
+    }
+  } else if (dtype == DTYPE_F64) {
+    const double* d = (const double*)src;
+    for (; i + 16 <= n; i += 16) {
+      _mm256_storeu_ps(dst + i, _mm512_cvtpd_ps(_mm512_loadu_pd(d + i)));
+      _mm256_storeu_ps(dst + i + 8,
+                       _mm512_cvtpd_ps(_mm512_loadu_pd(d + i + 8)));
+    }
+  }
+  load_scalar(dtype, storage_ptr(dtype, src, i), dst + i, n - i);
+}
+#endif
+
+#ifdef HOST_NEON
+static void
+compute_neon(enum HostOp op,
+             const float* a,
+             const float* b,
+             float factor,
+             float* out,
+             size_t n)
+{
+  const float32x4_t f = vdupq_n_f32(op == HOST_DMUL ? 2.0f : factor);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t x = vld1q_f32(a + i);
+    float32x4_t y;
+    switch (op) {
+      case HOST_SAXPY:
+      case HOST_DMUL:
+        y = vmulq_f32(x, f);
+        break;
+      case HOST_DSUM:
+        y = vaddq_f32(x, x);
+        break;
+      case HOST_VECADD:
+        y = vaddq_f32(x, vld1q_f32(b + i));
+        break;
+      default:
+        y = vmulq_f32(x, vld1q_f32(b + i));
+        break;
+    }
+    vst1q_f32(out + i, y);
+  }
+  compute_scalar(op, a + i, tail_ptr(b, i), factor, out + i, n - i);
+}
+
+static size_t
+count_neon(const float* x, const float* y, size_t n, size_t* first)
+{
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    uint32x4_t eq = vceqq_f32(vld1q_f32(x + i), vld1q_f32(y + i));
+    if (vminvq_u32(eq) == 0) {
+      count = count_tail(x, y, i, i + 4, count, first);
+    }
+  }
+  return count_tail(x, y, i, n, count, first);
+}
+
+static void
+store_neon(enum DataType dtype, const float* src, void* dst, size_t n)
+{
+  size_t i = 0;
+  if (dtype == DTYPE_F16) {
+    uint16_t* h = (uint16_t*)dst;
+    for (; i + 4 <= n; i += 4) {
+      float16x4_t y = vcvt_f16_f32(vld1q_f32(src + i));
+      vst1_u16(h + i, vreinterpret_u16_f16(y));
+    }
+  } else if (dtype == DTYPE_F64) {
+    double* d = (double*)dst;
+    for (; i + 4 <= n; i += 4) {
+      float32x4_t x = vld1q_f32(src + i);
+      vst1q_f64(d + i, vcvt_f64_f32(vget_low_f32(x)));
+      vst1q_f64(d + i + 2, vcvt_high_f64_f32(x));
+    }
+  }
+  store_scalar(dtype, src + i, storage_ptr(dtype, dst, i), n - i);
+}
+
+static void
+load_neon(enum DataType dtype, const void* src, float* dst, size_t n)
+{
+  size_t i = 0;
+  if (dtype == DTYPE_F16) {
+    const uint16_t* h = (const uint16_t*)src;
+    for (; i + 4 <= n; i += 4) {
+      float16x4_t x = vreinterpret_f16_u16(vld1_u16(h + i));
+      vst1q_f32(dst + i, vcvt_f32_f16(x));
+    }
+  } else if (dtype == DTYPE_F64) {
+    const double* d = (const double*)src;
+    for (; i + 4 <= n; i += 4) {
+      float32x2_t lo = vcvt_f32_f64(vld1q_f64(d + i));
+      vst1q_f32(dst + i, vcvt_high_f32_f64(lo, vld1q_f64(d + i + 2)));
+    }
+  }
+  load_scalar(dtype, storage_ptr(dtype, src, i), dst + i, n - i);
+}
+#endif
+
+static bool
+host_supports(enum HostIsa isa)
+{
+  switch (isa) {
+    case HOST_ISA_SCALAR:
+      return true;
+#ifdef HOST_X86
+    case HOST_ISA_AVX2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+    case HOST_ISA_AVX512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef HOST_NEON
+    case HOST_ISA_NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+static void
+host_kernels(enum HostIsa isa, ComputeFn* compute, CountFn* count)
+{
+  *compute = compute_scalar;
+  *count = count_scalar;
+  switch (isa) {
+#ifdef HOST_X86
+    case HOST_ISA_AVX2:
+      *compute = compute_avx2;
+      *count = count_avx2;
+      break;
+    case HOST_ISA_AVX512:
+      *compute = compute_avx512;
+      *count = count_avx512;
+      break;
+#endif
+#ifdef HOST_NEON
+    case HOST_ISA_NEON:
+      *compute = compute_neon;
+      *count = count_neon;
+      break;
+#endif
+    default:
+      break;
+  }
+}
+
+static void
+host_converters(enum HostIsa isa, StoreFn* store, LoadFn* load)
+{
+  *store = store_scalar;
+  *load = load_scalar;
+  switch (isa) {
+#ifdef HOST_X86
+    case HOST_ISA_AVX2:
+      *store = store_avx2;
+      *load = load_avx2;
+      break;
+    case HOST_ISA_AVX512:
+      *store = store_avx512;
+      *load = load_avx512;
+      break;
+#endif
+#ifdef HOST_NEON
+    case HOST_ISA_NEON:
+      *store = store_neon;
+      *load = load_neon;
+      break;
+#endif
+    default:
+      break;
+  }
+}
+
+const char*
+host_isa_name(enum HostIsa isa)
+{
+  switch (isa) {
+    case HOST_ISA_AVX2:
+      return "avx2";
+    case HOST_ISA_AVX512:
+      return "avx512";
+    case HOST_ISA_NEON:
+      return "neon";
+    default:
+      return "scalar";
+  }
+}
+
+enum HostIsa
+host_detect_isa()
+{
+  if (host_supports(HOST_ISA_AVX512)) {
+    return HOST_ISA_AVX512;
+  } else if (host_supports(HOST_ISA_AVX2)) {
+    return HOST_ISA_AVX2;
+  } else if (host_supports(HOST_ISA_NEON)) {
+    return HOST_ISA_NEON;
+  }
+  return HOST_ISA_SCALAR;
+}
+
+bool
+host_config(enum HostIsa* isa, int* threads)
+{
+  *isa = host_detect_isa();
+  char* isa_str = getenv("HOST_ISA");
+  if (isa_str != NULL && strcmp(isa_str, "AUTO") != 0) {
+    if (strcmp(isa_str, "SCALAR") == 0) {
+      *isa = HOST_ISA_SCALAR;
+    } else if (strcmp(isa_str, "AVX2") == 0) {
+      *isa = HOST_ISA_AVX2;
+    } else if (strcmp(isa_str, "AVX512") == 0) {
+      *isa = HOST_ISA_AVX512;
+    } else if (strcmp(isa_str, "NEON") == 0) {
+      *isa = HOST_ISA_NEON;
+    } else {
+      return false;
+    }
+  }
+  *threads = 0;
+  char* threads_str = getenv("HOST_THREADS");
+  if (threads_str != NULL && atoi(threads_str) > 0) {
+    *threads = atoi(threads_str);
+  }
+  return true;
+}
+
+ThreadPool::ThreadPool(int threads)
+  : job_(NULL)
+  , n_(0)
+  , parts_(1)
+  , pending_(0)
+  , generation_(0)
+  , stop_(false)
+{
+  for (int i = 1; i < threads; i++) {
+    workers_.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i].join();
+  }
+}
+
+void
+ThreadPool::range(int index, size_t* begin, size_t* end) const
+{
+  // Multiples of 16 elements, so every range but the last is whole vectors
+  size_t chunk = ((n_ + parts_ - 1) / parts_ + 15) & ~(size_t)15;
+  *begin = (size_t)index * chunk < n_ ? (size_t)index * chunk : n_;
+  *end = *begin + chunk < n_ ? *begin + chunk : n_;
+}
+
+void
+ThreadPool::parallel_for(size_t n,
+                         size_t grain,
+                         const std::function<void(size_t, size_t)>& fn)
+{
+  size_t parts = size();
+  if (grain > 0 && n / grain < parts) {
+    parts = n / grain;
+  }
+  if (parts <= 1) {
+    fn(0, n);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = &fn;
+    n_ = n;
+    parts_ = (int)parts;
+    pending_ = (int)workers_.size();
+    generation_++;
+  }
+  start_.notify_all();
+  size_t begin, end;
+  range(0, &begin, &end);
+  fn(begin, end);
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return pending_ == 0; });
+  job_ = NULL;
+}
+
+void
+ThreadPool::work(int index)
+{
+  unsigned long seen = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+    if (stop_) {
+      return;
+    }
+    seen = generation_;
+    const std::function<void(size_t, size_t)>* job = job_;
+    size_t begin, end;
+    range(index, &begin, &end);
+    lock.unlock();
+    if (begin < end) {
+      (*job)(begin, end);
+    }
+    lock.lock();
+    if (--pending_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+void
+verify_config(struct VerifyConfig* config)
+{
+  config->max_ulp = 0;
+  config->max_rel = 0;
+  config->show = 10;
+  char* ulp_str = getenv("VERIFY_ULP");
+  if (ulp_str != NULL && atol(ulp_str) > 0) {
+    config->max_ulp = atol(ulp_str);
+  }
+  char* rel_str = getenv("VERIFY_REL");
+  if (rel_str != NULL && atof(rel_str) > 0) {
+    config->max_rel = atof(rel_str);
+  }
+  char* show_str = getenv("VERIFY_SHOW");
+  if (show_str != NULL && atoi(show_str) >= 0) {
+    config->show = atoi(show_str);
+  }
+}
+
+// Floats as integers ordered like the floats, -0 and +0 both 0
+static int64_t
+verify_order(float x)
+{
+  int32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits >= 0 ? (int64_t)bits : (int64_t)INT32_MIN - bits;
+}
+
+uint64_t
+verify_ulp(float expected, float actual)
+{
+  if (isnan(expected) || isnan(actual)) {
+    return isnan(expected) && isnan(actual) ? 0 : UINT64_MAX;
+  }
+  int64_t diff = verify_order(expected) - verify_order(actual);
+  return diff < 0 ? (uint64_t)-diff : (uint64_t)diff;
+}
+
+// Halves as integers ordered like them, -0 and +0 both 0
+static int64_t
+verify_half_order(float x)
+{
+  int16_t bits = (int16_t)half_from_float(x);
+  return bits >= 0 ? (int64_t)bits : (int64_t)INT16_MIN - bits;
+}
+
+// verify_ulp of two values of the storage type, in its ULPs
+static uint64_t
+verify_storage_ulp(enum DataType storage, float expected, float actual)
+{
+  if (storage != DTYPE_F16 || isnan(expected) || isnan(actual)) {
+    return verify_ulp(expected, actual);
+  }
+  int64_t diff = verify_half_order(expected) - verify_half_order(actual);
+  return diff < 0 ? (uint64_t)-diff : (uint64_t)diff;
+}
+
+static int
+host_threads(int threads)
+{
+  if (threads > 0) {
+    return threads;
+  }
+  int hw = (int)std::thread::hardware_concurrency();
+  return hw > 0 ? hw : 1;
+}
+
+HostEngine::HostEngine(enum HostIsa isa, int threads)
+  : isa_(host_supports(isa) ? isa : host_detect_isa())
+  , pool_(host_threads(threads))
+  , failures_(0)
+  , storage_(DTYPE_F32)
+{
+  verify_.max_ulp = 0;
+  verify_.max_rel = 0;
+  verify_.show = 10;
+}
+
+void
+HostEngine::compute(enum HostOp op,
+                    const float* a,
+                    const float* b,
+                    float factor,
+                    float* out,
+                    size_t n)
+{
+  ComputeFn compute;
+  CountFn count;
+  host_kernels(isa_, &compute, &count);
+  pool_.parallel_for(n, HOST_GRAIN, [&](size_t begin, size_t end) {
+    compute(
+      op, a + begin, tail_ptr(b, begin), factor, out + begin, end - begin);
+  });
+}
+
+void
+HostEngine::store(enum DataType dtype, const float* src, void* dst, size_t n)
+{
+  StoreFn store;
+  LoadFn load;
+  host_converters(isa_, &store, &load);
+  pool_.parallel_for(n, HOST_GRAIN, [&](size_t begin, size_t end) {
+    store(dtype, src + begin, storage_ptr(dtype, dst, begin), end - begin);
+  });
+}
+
+void
+HostEngine::load(enum DataType dtype, const void* src, float* dst, size_t n)
+{
+  StoreFn store;
+  LoadFn load;
+  host_converters(isa_, &store, &load);
+  pool_.parallel_for(n, HOST_GRAIN, [&](size_t begin, size_t end) {
+    load(dtype, storage_ptr(dtype, src, begin), dst + begin, end - begin);
+  });
+}
+
+static int
+verify_bucket(uint64_t ulp)
+{
+  if (ulp == UINT64_MAX) {
+    return VERIFY_NAN_BUCKET;
+  }
+  return ulp == 0 ? 0 : 64 - __builtin_clzll(ulp);
+}
+
+// Fold the elements [i, i + len) of a block with SIMD mismatches, from the
+// first one on, into report
+static void
+verify_block(const struct VerifyConfig* config,
+             enum DataType storage,
+             const float* expected,
+             const float* actual,
+             size_t i,
+             size_t len,
+             size_t first,
+             struct VerifyReport* report)
+{
+  report->histogram[0] += first;
+  for (size_t j = first; j < len; j++) {
+    uint64_t ulp = verify_storage_ulp(storage, expected[j], actual[j]);
+    report->histogram[verify_bucket(ulp)]++;
+    if (ulp == 0) {
+      continue;
+    }
+    double rel = expected[j] != 0
+                   ? fabs((double)actual[j] - expected[j]) / fabs(expected[j])
+                   : INFINITY;
+    if (ulp > report->max_ulp) {
+      report->max_ulp = ulp;
+      report->max_ulp_index = i + j;
+    }
+    if (rel > report->max_rel) {
+      report->max_rel = rel;
+    }
+    if (ulp <= config->max_ulp ||
+        (config->max_rel > 0 && rel <= config->max_rel)) {
+      continue;
+    }
+    if (report->n_shown < (size_t)config->show) {
+      struct VerifyMismatch* shown = &report->shown[report->n_shown++];
+      shown->index = i + j;
+      shown->expected = expected[j];
+      shown->actual = actual[j];
+      shown->ulp = ulp;
+    }
+    report->failures++;
+  }
+}
+
+bool
+HostEngine::verify(enum HostOp op,
+                   const float* a,
+                   const float* b,
+                   float factor,
+                   const float* out,
+                   size_t n,
+                   struct VerifyReport* report)
+{
+  double start = now_ns();
+  ComputeFn compute;
+  CountFn count;
+  host_kernels(isa_, &compute, &count);
+  StoreFn store;
+  LoadFn load;
+  host_converters(isa_, &store, &load);
+  struct VerifyConfig config = verify_;
+  if (config.show < 0 || config.show > VERIFY_MAX_SHOW) {
+    config.show = config.show < 0 ? 0 : VERIFY_MAX_SHOW;
+  }
+  memset(report, 0, sizeof(*report));
+  report->elements = n;
+  std::mutex mutex;
+  std::vector<struct VerifyMismatch> shown;
+  pool_.parallel_for(n, HOST_GRAIN, [&](size_t begin, size_t end) {
+    struct VerifyReport part;
+    memset(&part, 0, sizeof(part));
+    float expected[HOST_BLOCK];
+    uint16_t rounded[HOST_BLOCK];
+    for (size_t i = begin; i < end; i += HOST_BLOCK) {
+      size_t len = end - i < HOST_BLOCK ? end - i : HOST_BLOCK;
+      compute(op, a + i, tail_ptr(b, i), factor, expected, len);
+      if (storage_ == DTYPE_F16) {
+        // The device rounds its float results to half on store
+        store(DTYPE_F16, expected, rounded, len);
+        load(DTYPE_F16, rounded, expected, len);
+      }
+      size_t first = 0;
+      if (count(expected, out + i, len, &first) == 0) {
+        part.histogram[0] += len;
+      } else {
+        verify_block(
+          &config, storage_, expected, out + i, i, len, first, &part);
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    report->failures += part.failures;
+    for (int k = 0; k < VERIFY_BUCKETS; k++) {
+      report->histogram[k] += part.histogram[k];
+    }
+    if (part.max_ulp > report->max_ulp ||
+        (part.max_ulp == report->max_ulp && part.max_ulp > 0 &&
+         part.max_ulp_index < report->max_ulp_index)) {
+      report->max_ulp = part.max_ulp;
+      report->max_ulp_index = part.max_ulp_index;
+    }
+    if (part.max_rel > report->max_rel) {
+      report->max_rel = part.max_rel;
+    }
+    shown.insert(shown.end(), part.shown, part.shown + part.n_shown);
+  });
+  // Each range kept its first mismatches: the lowest indices overall are
+  // among them
+  std::sort(shown.begin(),
+            shown.end(),
+            [](const struct VerifyMismatch& x, const struct VerifyMismatch& y) {
+              return x.index < y.index;
+            });
+  report->n_shown =
+    shown.size() < (size_t)config.show ? shown.size() : config.show;
+  std::copy(shown.begin(), shown.begin() + report->n_shown, report->shown);
+  failures_ += report->failures;
+  report->ns = now_ns() - start;
+  cltrace_phase("verify", start);
+  return report->failures == 0;
+}
+
+void
+HostEngine::print_report(const char* name,
+                         const struct VerifyReport* report) const
+{
+  const char* unit = storage_ == DTYPE_F16 ? "f16 ulp" : "ulp";
+  printf("verify %s: %lu elements, %lu failures (tolerance %lu %s, rel %g) "
+         "check(ns):%lg\n",
+         name,
+         report->elements,
+         report->failures,
+         (unsigned long)verify_.max_ulp,
+         unit,
+         verify_.max_rel,
+         report->ns);
+  if (report->max_ulp == UINT64_MAX) {
+    printf("verify %s: max error NaN at index %lu\n",
+           name,
+           report->max_ulp_index);
+  } else if (report->max_ulp > 0) {
+    printf("verify %s: max error %lu %s at index %lu (max rel %g)\n",
+           name,
+           (unsigned long)report->max_ulp,
+           unit,
+           report->max_ulp_index,
+           report->max_rel);
+  }
+  printf("verify %s: ulp histogram:", name);
+  for (int k = 0; k < VERIFY_BUCKETS; k++) {
+    if (report->histogram[k] == 0) {
+      continue;
+    }
+    if (k == VERIFY_NAN_BUCKET) {
+      printf(" nan:%lu", report->histogram[k]);
+    } else if (k <= 1) {
+      printf(" %d:%lu", k, report->histogram[k]);
+    } else {
+      printf(" %lu-%lu:%lu",
+             1UL << (k - 1),
+             (1UL << k) - 1,
+             report->histogram[k]);
+    }
+  }
+  printf("\n");
+  for (size_t i = 0; i < report->n_shown; i++) {
+    const struct VerifyMismatch* shown = &report->shown[i];
+    char ulp[32];
+    if (shown->ulp == UINT64_MAX) {
+      snprintf(ulp, sizeof(ulp), "nan");
+    } else {
+      snprintf(
+        ulp, sizeof(ulp), "%lu %s", (unsigned long)shown->ulp, unit);
+    }
+    printf("[FAILURE] at index %lu:  %.6f != %.6f (%s)\n",
+           shown->index,
+           shown->expected,
+           shown->actual,
+           ulp);
+  }
+  if (report->failures > report->n_shown) {
+    printf("[FAILURE] ... %lu more\n", report->failures - report->n_shown);
+  }
+}
+
+void
+HostEngine::bench(enum HostOp op,
+                  const float* a,
+                  const float* b,
+                  float factor,
+                  float* out,
+                  size_t n,
+                  int iterations,
+                  int warmup,
+                  std::vector<struct BenchSample>* samples)
+{
+  for (int i = 0; i < warmup + iterations; i++) {
+    double start = now_ns();
+    compute(op, a, b, factor, out, n);
+    double end = now_ns();
+    if (i >= warmup) {
+      struct BenchSample sample;
+      sample.queued = sample.submit = sample.start = (cl_ulong)start;
+      sample.end = (cl_ulong)end;
+      samples->push_back(sample);
+    }
+  }
+}
+
+void
+HostEngine::name(char* buf, size_t size) const
+{
+  snprintf(buf, size, "host %s x%d", host_isa_name(isa_), threads());
+}
+
+} // namespace clrt
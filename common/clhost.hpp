@@ -0,0 +1,238 @@
+#ifndef CLHOST_HPP
+#define CLHOST_HPP
+
+#include "clbench.h"
+#include "cldtype.h"
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///
+//  Host implementation of the kernels of both programs, vectorized with
+//  AVX-512, AVX2 or NEON (picked at runtime) and split over a thread pool:
+//  the reference the CHECK paths compare against, and a HOST backend timed
+//  like the OpenCL one.
+//
+//  Results match the scalar HostOp of the programs bit for bit: each element
+//  is one IEEE multiply or add, which every instruction set rounds the same.
+//  Device results are verified against them within a ULP or relative
+//  tolerance, for devices contracting or flushing differently.
+//
+//  It also converts between float and the storage types of the device
+//  buffers (DTYPE): half with F16C, AVX-512 or NEON conversions, double with
+//  the widening and narrowing instructions.
+//
+namespace clrt {
+
+enum HostOp
+{
+  HOST_SAXPY,  // out = a * factor
+  HOST_DSUM,   // out = a + a
+  HOST_DMUL,   // out = 2 * a
+  HOST_VECADD, // out = a + b
+  HOST_VECMUL, // out = a * b
+};
+
+enum HostIsa
+{
+  HOST_ISA_SCALAR,
+  HOST_ISA_AVX2,
+  HOST_ISA_AVX512,
+  HOST_ISA_NEON,
+};
+
+const char*
+host_isa_name(enum HostIsa isa);
+
+///
+//  Widest instruction set of the CPU running the process
+//
+enum HostIsa
+host_detect_isa();
+
+///
+//  Env vars:
+//  - HOST_ISA: (str) AUTO|SCALAR|AVX2|AVX512|NEON (default AUTO: the widest
+//    the CPU supports; an unsupported one falls back to it)
+//  - HOST_THREADS: (int) threads of the host engine (default 0: one per
+//    hardware thread)
+//
+//  False if HOST_ISA is not recognized
+//
+bool
+host_config(enum HostIsa* isa, int* threads);
+
+// Mismatches a VerifyReport keeps at most
+#define VERIFY_MAX_SHOW 64
+// Histogram buckets: 0 ulp, [2^(k-1), 2^k) ulp for k = 1..32, NaN mismatch
+#define VERIFY_BUCKETS 34
+#define VERIFY_NAN_BUCKET (VERIFY_BUCKETS - 1)
+
+///
+//  Tolerance of a verification: an element passes within max_ulp ULPs or
+//  within a max_rel relative error of the host result
+//
+struct VerifyConfig
+{
+  uint64_t max_ulp; // 0: exact
+  double max_rel;   // 0: not used
+  int show;         // mismatches reported (at most VERIFY_MAX_SHOW)
+};
+
+struct VerifyMismatch
+{
+  size_t index;
+  float expected;
+  float actual;
+  uint64_t ulp;
+};
+
+///
+//  Outcome of a verification: counts, the largest error (failing or not),
+//  the ULP distance histogram of every element and the first mismatches
+//
+struct VerifyReport
+{
+  size_t elements;
+  size_t failures;
+  uint64_t max_ulp; // UINT64_MAX: NaN against a number
+  size_t max_ulp_index;
+  double max_rel;
+  size_t histogram[VERIFY_BUCKETS];
+  size_t n_shown;
+  struct VerifyMismatch shown[VERIFY_MAX_SHOW]; // by index
+  double ns;                                    // wall time of the check
+};
+
+///
+//  Env vars:
+//  - VERIFY_ULP: (int) ULP distance accepted (default 0: exact)
+//  - VERIFY_REL: (float) relative error accepted (default 0: not used)
+//  - VERIFY_SHOW: (int) mismatches printed (default 10)
+//
+void
+verify_config(struct VerifyConfig* config);
+
+///
+//  Distance in units in the last place between two floats (0 for +0 and -0
+//  and for two NaNs, UINT64_MAX for a NaN against a number)
+//
+uint64_t
+verify_ulp(float expected, float actual);
+
+///
+//  Workers running one range function at a time: parallel_for splits [0, n)
+//  in one contiguous range per thread (the calling thread takes the first)
+//  and returns once every range is done
+//
+class ThreadPool
+{
+public:
+  // threads counts the calling thread: threads - 1 workers are started
+  explicit ThreadPool(int threads);
+  ~ThreadPool();
+
+  int size() const { return (int)workers_.size() + 1; }
+
+  // Ranges shorter than grain elements are not split further
+  void parallel_for(size_t n,
+                    size_t grain,
+                    const std::function<void(size_t, size_t)>& fn);
+
+private:
+  void work(int index);
+  void range(int index, size_t* begin, size_t* end) const;
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const std::function<void(size_t, size_t)>* job_;
+  size_t n_;
+  int parts_;
+  int pending_;
+  unsigned long generation_;
+  bool stop_;
+};
+
+///
+//  The host kernels on one instruction set and a pool of threads
+//  (threads <= 0: one per hardware thread). b is only read by the
+//  HOST_VECADD and HOST_VECMUL ops, factor only by HOST_SAXPY.
+//
+class HostEngine
+{
+public:
+  HostEngine(enum HostIsa isa, int threads);
+
+  enum HostIsa isa() const { return isa_; }
+  int threads() const { return pool_.size(); }
+
+  // Tolerance of verify (default exact, 10 mismatches shown)
+  void set_verify(const struct VerifyConfig& config) { verify_ = config; }
+  const struct VerifyConfig& verify_config() const { return verify_; }
+  // Elements failed by every verify so far, for the exit status
+  size_t failures() const { return failures_; }
+
+  // Type the device results verify compares were stored as: with f16 the
+  // expected values are rounded to half and ULPs are counted in half ULPs
+  // (f64 results are compared once rounded to float)
+  void set_storage(enum DataType dtype) { storage_ = dtype; }
+  enum DataType storage() const { return storage_; }
+
+  // n elements of src stored as dtype at dst, and back. Halves round to
+  // nearest even, like vstore_half; f32 is a copy.
+  void store(enum DataType dtype, const float* src, void* dst, size_t n);
+  void load(enum DataType dtype, const void* src, float* dst, size_t n);
+
+  void compute(enum HostOp op,
+               const float* a,
+               const float* b,
+               float factor,
+               float* out,
+               size_t n);
+
+  // Compare out against compute, in parallel blocks: blocks matching
+  // exactly are only compared with SIMD. True if every element passes.
+  bool verify(enum HostOp op,
+              const float* a,
+              const float* b,
+              float factor,
+              const float* out,
+              size_t n,
+              struct VerifyReport* report);
+
+  // "verify <name>: ..." summary, histogram and the mismatches shown
+  void print_report(const char* name, const struct VerifyReport* report) const;
+
+  // compute timed warmup + iterations times, one wall clock sample per
+  // timed run (queued = submit = start)
+  void bench(enum HostOp op,
+             const float* a,
+             const float* b,
+             float factor,
+             float* out,
+             size_t n,
+             int iterations,
+             int warmup,
+             std::vector<struct BenchSample>* samples);
+
+  // "host <isa> x<threads>", the device name of the host results
+  void name(char* buf, size_t size) const;
+
+private:
+  enum HostIsa isa_;
+  ThreadPool pool_;
+  struct VerifyConfig verify_;
+  size_t failures_;
+  enum DataType storage_;
+};
+
+} // namespace clrt
+
+#endif
@@ -0,0 +1,304 @@
+#include "clmem.h"
+#include "cltime.h"
+#include "cltrace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+bool
+clbuf_parse_mode(const char* str, enum MemoryMode* mode)
+{
+  if (strcmp(str, "COPY") == 0) {
+    *mode = MEMORY_COPY;
+  } else if (strcmp(str, "USE_HOST_PTR") == 0) {
+    *mode = MEMORY_USE_HOST_PTR;
+  } else if (strcmp(str, "ALLOC_HOST_PTR") == 0) {
+    *mode = MEMORY_ALLOC_HOST_PTR;
+  } else if (strcmp(str, "SVM") == 0) {
+    *mode = MEMORY_SVM;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char*
+clbuf_mode_name(enum MemoryMode mode)
+{
+  switch (mode) {
+    case MEMORY_COPY:
+      return "copy";
+    case MEMORY_USE_HOST_PTR:
+      return "use_host_ptr";
+    case MEMORY_ALLOC_HOST_PTR:
+      return "alloc_host_ptr";
+    case MEMORY_SVM:
+      return "svm";
+  }
+  return "unknown";
+}
+
+static void*
+page_alloc(size_t size)
+{
+  void* ptr = NULL;
+  long page = sysconf(_SC_PAGESIZE);
+  // CL_MEM_USE_HOST_PTR is only zero-copy if both address and size are
+  // page (or cache line) aligned on most drivers
+  size_t rounded = (size + page - 1) / page * page;
+  if (posix_memalign(&ptr, page, rounded > 0 ? rounded : page) != 0) {
+    return NULL;
+  }
+  memset(ptr, 0, rounded);
+  return ptr;
+}
+
+cl_int
+clbuf_create(struct ClBuffer* buf,
+             cl_context context,
+             enum MemoryMode mode,
+             cl_mem_flags flags,
+             size_t size)
+{
+  cl_int err = CL_SUCCESS;
+  double start = now_ns();
+
+  memset(buf, 0, sizeof(*buf));
+  buf->mode = mode;
+  buf->context = context;
+  buf->flags = flags;
+  buf->size = size;
+  buf->capacity = size;
+
+  switch (mode) {
+    case MEMORY_COPY:
+      buf->host = page_alloc(size);
+      if (buf->host == NULL) {
+        return CL_OUT_OF_HOST_MEMORY;
+      }
+      buf->mem = clCreateBuffer(context, flags, size, NULL, &err);
+      break;
+    case MEMORY_USE_HOST_PTR:
+      buf->host = page_alloc(size);
+      if (buf->host == NULL) {
+        return CL_OUT_OF_HOST_MEMORY;
+      }
+      buf->mem = clCreateBuffer(
+        context, flags | CL_MEM_USE_HOST_PTR, size, buf->host, &err);
+      break;
+    case MEMORY_ALLOC_HOST_PTR:
+      buf->mem = clCreateBuffer(
+        context, flags | CL_MEM_ALLOC_HOST_PTR, size, NULL, &err);
+      break;
+    case MEMORY_SVM:
+      buf->host = clSVMAlloc(context, flags, size, 0);
+      if (buf->host == NULL) {
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+      }
+      break;
+  }
+  cltrace_phase("create buffer", start);
+  return err;
+}
+
+cl_int
+clbuf_resize(struct ClBuffer* buf, size_t size)
+{
+  if (size <= buf->capacity) {
+    buf->size = size;
+    return CL_SUCCESS;
+  }
+  cl_context context = buf->context;
+  enum MemoryMode mode = buf->mode;
+  cl_mem_flags flags = buf->flags;
+  clbuf_release(buf);
+  return clbuf_create(buf, context, mode, flags, size);
+}
+
+cl_int
+clbuf_map_async(struct ClBuffer* buf,
+                cl_command_queue queue,
+                cl_map_flags flags,
+                cl_uint num_events,
+                const cl_event* wait_list,
+                void** ptr,
+                cl_event* event)
+{
+  cl_int err = CL_SUCCESS;
+
+  buf->map_flags = flags;
+  switch (buf->mode) {
+    case MEMORY_COPY:
+      // Buffers the kernel cannot write keep an authoritative staging copy
+      if ((flags & CL_MAP_READ) && !(buf->flags & CL_MEM_READ_ONLY)) {
+        err = clEnqueueReadBuffer(queue,
+                                  buf->mem,
+                                  CL_FALSE,
+                                  0,
+                                  buf->size,
+                                  buf->host,
+                                  num_events,
+                                  wait_list,
+                                  event);
+      } else {
+        // Nothing to copy, but keep the dependencies
+        err = clEnqueueMarkerWithWaitList(queue, num_events, wait_list, event);
+      }
+      buf->mapped = buf->host;
+      break;
+    case MEMORY_USE_HOST_PTR:
+    case MEMORY_ALLOC_HOST_PTR:
+      buf->mapped = clEnqueueMapBuffer(queue,
+                                       buf->mem,
+                                       CL_FALSE,
+                                       flags,
+                                       0,
+                                       buf->size,
+                                       num_events,
+                                       wait_list,
+                                       event,
+                                       &err);
+      break;
+    case MEMORY_SVM:
+      err = clEnqueueSVMMap(queue,
+                            CL_FALSE,
+                            flags,
+                            buf->host,
+                            buf->size,
+                            num_events,
+                            wait_list,
+                            event);
+      buf->mapped = buf->host;
+      break;
+  }
+  *ptr = buf->mapped;
+  return err;
+}
+
+cl_int
+clbuf_unmap_async(struct ClBuffer* buf,
+                  cl_command_queue queue,
+                  cl_uint num_events,
+                  const cl_event* wait_list,
+                  cl_event* event)
+{
+  cl_int err = CL_SUCCESS;
+
+  switch (buf->mode) {
+    case MEMORY_COPY:
+      if (buf->map_flags & (CL_MAP_WRITE | CL_MAP_WRITE_INVALIDATE_REGION)) {
+        err = clEnqueueWriteBuffer(queue,
+                                   buf->mem,
+                                   CL_FALSE,
+                                   0,
+                                   buf->size,
+                                   buf->host,
+                                   num_events,
+                                   wait_list,
+                                   event);
+      } else {
+        err = clEnqueueMarkerWithWaitList(queue, num_events, wait_list, event);
+      }
+      break;
+    case MEMORY_USE_HOST_PTR:
+    case MEMORY_ALLOC_HOST_PTR:
+      err = clEnqueueUnmapMemObject(
+        queue, buf->mem, buf->mapped, num_events, wait_list, event);
+      break;
+    case MEMORY_SVM:
+      err = clEnqueueSVMUnmap(queue, buf->host, num_events, wait_list, event);
+      break;
+  }
+  buf->mapped = NULL;
+  buf->map_flags = 0;
+  return err;
+}
+
+// Wait for (and release) the event of a blocking call
+static cl_int
+wait_done(cl_int err, cl_event done)
+{
+  if (err == CL_SUCCESS) {
+    err = clWaitForEvents(1, &done);
+  }
+  clReleaseEvent(done);
+  return err;
+}
+
+cl_int
+clbuf_map(struct ClBuffer* buf,
+          cl_command_queue queue,
+          cl_map_flags flags,
+          void** ptr)
+{
+  cl_event done = NULL;
+  cl_int err = clbuf_map_async(buf, queue, flags, 0, NULL, ptr, &done);
+  return done != NULL ? wait_done(err, done) : err;
+}
+
+cl_int
+clbuf_unmap(struct ClBuffer* buf, cl_command_queue queue)
+{
+  // Unmap has no blocking flag; wait so the timing covers the whole handoff
+  cl_event done = NULL;
+  cl_int err = clbuf_unmap_async(buf, queue, 0, NULL, &done);
+  return done != NULL ? wait_done(err, done) : err;
+}
+
+cl_int
+clbuf_zero(struct ClBuffer* buf,
+           cl_command_queue queue,
+           cl_uint num_events,
+           const cl_event* wait_list,
+           cl_event* event)
+{
+  const cl_uint zero = 0;
+  // The size must be a multiple of the pattern: f16 buffers of odd lengths
+  size_t pattern = buf->size % 4 == 0 ? 4 : buf->size % 2 == 0 ? 2 : 1;
+  if (buf->mode == MEMORY_SVM) {
+    return clEnqueueSVMMemFill(queue,
+                               buf->host,
+                               &zero,
+                               pattern,
+                               buf->size,
+                               num_events,
+                               wait_list,
+                               event);
+  }
+  return clEnqueueFillBuffer(queue,
+                             buf->mem,
+                             &zero,
+                             pattern,
+                             0,
+                             buf->size,
+                             num_events,
+                             wait_list,
+                             event);
+}
+
+cl_int
+clbuf_set_arg(struct ClBuffer* buf, cl_kernel kernel, cl_uint index)
+{
+  if (buf->mode == MEMORY_SVM) {
+    return clSetKernelArgSVMPointer(kernel, index, buf->host);
+  }
+  return clSetKernelArg(kernel, index, sizeof(cl_mem), &buf->mem);
+}
+
+void
+clbuf_release(struct ClBuffer* buf)
+{
+  if (buf->mem != NULL) {
+    clReleaseMemObject(buf->mem);
+  }
+  if (buf->mode == MEMORY_SVM) {
+    if (buf->host != NULL) {
+      clSVMFree(buf->context, buf->host);
+    }
+  } else {
+    // The driver must drop its CL_MEM_USE_HOST_PTR reference first
+    free(buf->host);
+  }
+  memset(buf, 0, sizeof(*buf));
+}
@@ -0,0 +1,129 @@
+#ifndef CLMEM_H
+#define CLMEM_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum MemoryMode
+{
+  MEMORY_COPY,           // device buffer + host staging copy, read/write calls
+  MEMORY_USE_HOST_PTR,   // page-aligned host allocation wrapped by the buffer
+  MEMORY_ALLOC_HOST_PTR, // host-visible allocation owned by the driver
+  MEMORY_SVM,            // coarse-grained shared virtual memory
+};
+
+///
+//  A kernel argument buffer whose host side is reached through map/unmap,
+//  whatever the memory mode. In MEMORY_COPY mode map/unmap fall back to
+//  blocking clEnqueueReadBuffer/clEnqueueWriteBuffer on a page-aligned
+//  staging copy; in the other modes no copy is made on shared-memory
+//  devices.
+//
+struct ClBuffer
+{
+  enum MemoryMode mode;
+  cl_context context;
+  cl_mem_flags flags;
+  size_t size;     // bytes in use
+  size_t capacity; // bytes allocated
+  cl_mem mem;      // NULL in MEMORY_SVM mode
+  void* host;   // staging / wrapped host allocation, or the SVM pointer
+  void* mapped; // pointer returned by the last clbuf_map
+  cl_map_flags map_flags;
+};
+
+///
+//  Parse COPY|USE_HOST_PTR|ALLOC_HOST_PTR|SVM. Returns false on an unknown
+//  name.
+//
+bool
+clbuf_parse_mode(const char* str, enum MemoryMode* mode);
+
+const char*
+clbuf_mode_name(enum MemoryMode mode);
+
+cl_int
+clbuf_create(struct ClBuffer* buf,
+             cl_context context,
+             enum MemoryMode mode,
+             cl_mem_flags flags,
+             size_t size);
+
+///
+//  Set the size in use, reallocating only if it exceeds the capacity (the
+//  contents are then lost). Kernel arguments must be set again after a call.
+//
+cl_int
+clbuf_resize(struct ClBuffer* buf, size_t size);
+
+///
+//  Make the contents available on the host. CL_MAP_READ returns the device
+//  results; CL_MAP_WRITE / CL_MAP_WRITE_INVALIDATE_REGION return a pointer
+//  to fill. Blocking.
+//
+cl_int
+clbuf_map(struct ClBuffer* buf,
+          cl_command_queue queue,
+          cl_map_flags flags,
+          void** ptr);
+
+///
+//  Hand the contents back to the device after clbuf_map. Blocking.
+//
+cl_int
+clbuf_unmap(struct ClBuffer* buf, cl_command_queue queue);
+
+///
+//  Non-blocking clbuf_map / clbuf_unmap for event graphs: the command waits
+//  for the num_events of wait_list, and *event completes with it (in
+//  MEMORY_COPY mode, a marker stands for a copy with nothing to do). The
+//  contents at *ptr are only valid once *event has completed.
+//
+cl_int
+clbuf_map_async(struct ClBuffer* buf,
+                cl_command_queue queue,
+                cl_map_flags flags,
+                cl_uint num_events,
+                const cl_event* wait_list,
+                void** ptr,
+                cl_event* event);
+
+cl_int
+clbuf_unmap_async(struct ClBuffer* buf,
+                  cl_command_queue queue,
+                  cl_uint num_events,
+                  const cl_event* wait_list,
+                  cl_event* event);
+
+///
+//  Enqueue a fill of the device contents with zeros (non-blocking), after
+//  the num_events of wait_list. event may be NULL.
+//
+cl_int
+clbuf_zero(struct ClBuffer* buf,
+           cl_command_queue queue,
+           cl_uint num_events,
+           const cl_event* wait_list,
+           cl_event* event);
+
+cl_int
+clbuf_set_arg(struct ClBuffer* buf, cl_kernel kernel, cl_uint index);
+
+void
+clbuf_release(struct ClBuffer* buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,221 @@
+#include "clmulti.h"
+#include "cltrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CALIBRATE_DEFAULT (1 << 20)
+#define MAX_PLATFORMS 16
+
+bool
+clmulti_config(enum MultiMode* mode, size_t* calibrate_len)
+{
+  *mode = MULTI_OFF;
+  *calibrate_len = CALIBRATE_DEFAULT;
+
+  char* calibrate_str = getenv("CALIBRATE");
+  if (calibrate_str != NULL) {
+    *calibrate_len = atol(calibrate_str);
+  }
+
+  char* multi_str = getenv("MULTI_DEVICE");
+  if (multi_str == NULL) {
+    return true;
+  }
+  if (strcmp(multi_str, "PLATFORM") == 0) {
+    *mode = MULTI_PLATFORM;
+    return true;
+  }
+  if (strcmp(multi_str, "ALL") == 0) {
+    *mode = MULTI_ALL;
+    return true;
+  }
+  return false;
+}
+
+const char*
+clmulti_mode_name(enum MultiMode mode)
+{
+  switch (mode) {
+    case MULTI_OFF:
+      return "OFF";
+    case MULTI_PLATFORM:
+      return "PLATFORM";
+    case MULTI_ALL:
+      return "ALL";
+  }
+  return "unknown";
+}
+
+// Add the devices of one platform (or only device_id if >= 0), sharing
+// one context
+static size_t
+open_platform(cl_platform_id platform,
+              int device_id,
+              struct MultiDevice* devices,
+              size_t max)
+{
+  cl_device_id ids[CLMULTI_MAX_DEVICES];
+  cl_uint n_ids = 0;
+  if (clGetDeviceIDs(
+        platform, CL_DEVICE_TYPE_ALL, CLMULTI_MAX_DEVICES, ids, &n_ids) !=
+        CL_SUCCESS ||
+      n_ids == 0) {
+    return 0;
+  }
+  if (n_ids > CLMULTI_MAX_DEVICES) {
+    n_ids = CLMULTI_MAX_DEVICES;
+  }
+  if (device_id >= 0) {
+    if ((cl_uint)device_id >= n_ids) {
+      return 0;
+    }
+    ids[0] = ids[device_id];
+    n_ids = 1;
+  }
+  if (n_ids > max) {
+    n_ids = max;
+  }
+
+  cl_int err;
+  cl_context context = clCreateContext(NULL, n_ids, ids, NULL, NULL, &err);
+  if (err != CL_SUCCESS) {
+    fprintf(stderr, "Failed to create a context for %u devices\n", n_ids);
+    return 0;
+  }
+  const cl_queue_properties properties[] = { CL_QUEUE_PROPERTIES,
+                                             CL_QUEUE_PROFILING_ENABLE,
+                                             0 };
+  size_t count = 0;
+  for (cl_uint i = 0; i < n_ids; i++) {
+    struct MultiDevice* d = &devices[count];
+    d->queue =
+      clCreateCommandQueueWithProperties(context, ids[i], properties, &err);
+    if (err != CL_SUCCESS) {
+      fprintf(stderr, "Failed to create a queue for device %u\n", i);
+      continue;
+    }
+    clRetainContext(context);
+    d->context = context;
+    d->device = ids[i];
+    d->name[0] = '\0';
+    clGetDeviceInfo(ids[i], CL_DEVICE_NAME, sizeof(d->name), d->name, NULL);
+
+    // Initial guess: compute units x clock
+    cl_uint units = 1, clock = 1;
+    clGetDeviceInfo(
+      ids[i], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(units), &units, NULL);
+    clGetDeviceInfo(
+      ids[i], CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(clock), &clock, NULL);
+    d->weight = (double)(units > 0 ? units : 1) * (clock > 0 ? clock : 1);
+    d->offset = d->len = 0;
+    count++;
+  }
+  clReleaseContext(context);
+  return count;
+}
+
+size_t
+clmulti_open(enum MultiMode mode,
+             int platform_id,
+             int device_id,
+             struct MultiDevice* devices,
+             size_t max)
+{
+  cl_platform_id platforms[MAX_PLATFORMS];
+  cl_uint n_platforms = 0;
+  if (clGetPlatformIDs(MAX_PLATFORMS, platforms, &n_platforms) != CL_SUCCESS) {
+    return 0;
+  }
+  if (n_platforms > MAX_PLATFORMS) {
+    n_platforms = MAX_PLATFORMS;
+  }
+
+  size_t count = 0;
+  if (mode == MULTI_ALL) {
+    for (cl_uint p = 0; p < n_platforms && count < max; p++) {
+      count += open_platform(platforms[p], -1, &devices[count], max - count);
+    }
+  } else if (platform_id >= 0 && (cl_uint)platform_id < n_platforms) {
+    count = open_platform(platforms[platform_id],
+                          mode == MULTI_OFF ? device_id : -1,
+                          devices,
+                          max);
+  }
+
+  double total = 0;
+  for (size_t i = 0; i < count; i++) {
+    total += devices[i].weight;
+  }
+  for (size_t i = 0; i < count; i++) {
+    devices[i].weight /= total;
+  }
+  return count;
+}
+
+void
+clmulti_split(struct MultiDevice* devices, size_t n_devices, size_t len)
+{
+  double cumulative = 0;
+  size_t offset = 0;
+  for (size_t i = 0; i < n_devices; i++) {
+    cumulative += devices[i].weight;
+    size_t end = i + 1 < n_devices ? (size_t)(cumulative * len + 0.5) : len;
+    if (end > len) {
+      end = len;
+    }
+    if (end < offset) {
+      end = offset;
+    }
+    devices[i].offset = offset;
+    devices[i].len = end - offset;
+    offset = end;
+  }
+}
+
+void
+clmulti_reweight(struct MultiDevice* devices,
+                 size_t n_devices,
+                 const double* elapsed_ns)
+{
+  // Measured devices share what they had before, by throughput
+  double measured_share = 0, measured_rate = 0;
+  for (size_t i = 0; i < n_devices; i++) {
+    if (devices[i].len > 0 && elapsed_ns[i] > 0) {
+      measured_share += devices[i].weight;
+      measured_rate += devices[i].len / elapsed_ns[i];
+    }
+  }
+  if (measured_rate <= 0) {
+    return;
+  }
+  for (size_t i = 0; i < n_devices; i++) {
+    if (devices[i].len > 0 && elapsed_ns[i] > 0) {
+      devices[i].weight =
+        measured_share * (devices[i].len / elapsed_ns[i]) / measured_rate;
+    }
+  }
+}
+
+void
+clmulti_print_split(const struct MultiDevice* devices, size_t n_devices)
+{
+  for (size_t i = 0; i < n_devices; i++) {
+    printf("device %lu: %s weight %.3f elements %lu..%lu\n",
+           (unsigned long)i,
+           devices[i].name,
+           devices[i].weight,
+           (unsigned long)devices[i].offset,
+           (unsigned long)(devices[i].offset + devices[i].len));
+  }
+}
+
+void
+clmulti_release(struct MultiDevice* devices, size_t n_devices)
+{
+  for (size_t i = 0; i < n_devices; i++) {
+    cltrace_release_queue(devices[i].queue);
+    clReleaseContext(devices[i].context);
+  }
+}
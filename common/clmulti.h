@@ -0,0 +1,96 @@
+#ifndef CLMULTI_H
+#define CLMULTI_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CLMULTI_MAX_DEVICES 16
+
+enum MultiMode
+{
+  MULTI_OFF,      // a single device (PLATFORM, DEVICE)
+  MULTI_PLATFORM, // every device of PLATFORM, in one context
+  MULTI_ALL,      // every device of every platform, one context per platform
+};
+
+///
+//  One device of a fan-out and its slice [offset, offset + len) of the
+//  vector
+//
+struct MultiDevice
+{
+  cl_context context; // shared by the devices of a platform (retained)
+  cl_device_id device;
+  cl_command_queue queue; // in-order, profiling
+  char name[256];
+  double weight; // share of the vector, the weights sum to 1
+  size_t offset;
+  size_t len;
+};
+
+///
+//  Env vars:
+//  - MULTI_DEVICE: (str) PLATFORM|ALL split the vector across devices
+//    (default unset: a single device)
+//  - CALIBRATE: (int) elements of the calibration run that weights the
+//    split (default 1048576, 0 to keep the initial guess)
+//
+//  Returns false on an unknown MULTI_DEVICE value.
+//
+bool
+clmulti_config(enum MultiMode* mode, size_t* calibrate_len);
+
+const char*
+clmulti_mode_name(enum MultiMode mode);
+
+///
+//  Create the contexts and queues of the devices of platform_id (or of
+//  every platform with MULTI_ALL, or only device_id with MULTI_OFF), at
+//  most max. The initial weights are proportional to
+//  CL_DEVICE_MAX_COMPUTE_UNITS x CL_DEVICE_MAX_CLOCK_FREQUENCY.
+//  Returns the number of devices, 0 on errors.
+//
+size_t
+clmulti_open(enum MultiMode mode,
+             int platform_id,
+             int device_id,
+             struct MultiDevice* devices,
+             size_t max);
+
+///
+//  Split len elements across the devices by weight (contiguous slices in
+//  device order, the last one taking the rounding)
+//
+void
+clmulti_split(struct MultiDevice* devices, size_t n_devices, size_t len);
+
+///
+//  Weight the devices by the throughput (len / elapsed_ns) measured on their
+//  current slices. Devices without a slice or a time keep their share.
+//
+void
+clmulti_reweight(struct MultiDevice* devices,
+                 size_t n_devices,
+                 const double* elapsed_ns);
+
+void
+clmulti_print_split(const struct MultiDevice* devices, size_t n_devices);
+
+void
+clmulti_release(struct MultiDevice* devices, size_t n_devices);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,533 @@
+#include "clrt.hpp"
+#include "cldtype.h"
+#include "cltime.h"
+#include "cltrace.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace clrt {
+
+#define MAX_PLATFORMS 100
+#define MAX_DEVICES 100
+#define POOL_MIN_CLASS 4096
+
+static void CL_CALLBACK
+notify(const char* errinfo, const void* private_info, size_t cb, void* data)
+{
+  fprintf(stderr, "OpenCL Error (via pfn_notify): %s\n", errinfo);
+}
+
+void
+print_platforms()
+{
+  cl_platform_id platforms[MAX_PLATFORMS];
+  cl_uint platforms_n = 0;
+  CL_CHECK(clGetPlatformIDs(MAX_PLATFORMS, platforms, &platforms_n));
+
+  printf("=== %d OpenCL platform(s) found: ===\n", platforms_n);
+  char buffer[10240];
+  for (unsigned int i = 0; i < platforms_n; i++) {
+    printf("  -- %d --\n", i);
+    CL_CHECK(clGetPlatformInfo(
+      platforms[i], CL_PLATFORM_PROFILE, sizeof(buffer), buffer, NULL));
+    printf("  PROFILE = %s\n", buffer);
+    CL_CHECK(clGetPlatformInfo(
+      platforms[i], CL_PLATFORM_VERSION, sizeof(buffer), buffer, NULL));
+    printf("  VERSION = %s\n", buffer);
+    CL_CHECK(clGetPlatformInfo(
+      platforms[i], CL_PLATFORM_NAME, sizeof(buffer), buffer, NULL));
+    printf("  NAME = %s\n", buffer);
+    CL_CHECK(clGetPlatformInfo(
+      platforms[i], CL_PLATFORM_VENDOR, sizeof(buffer), buffer, NULL));
+    printf("  VENDOR = %s\n", buffer);
+    CL_CHECK(clGetPlatformInfo(
+      platforms[i], CL_PLATFORM_EXTENSIONS, sizeof(buffer), buffer, NULL));
+    printf("  EXTENSIONS = %s\n", buffer);
+  }
+}
+
+void
+print_devices(cl_platform_id platform)
+{
+  cl_device_id devices[MAX_DEVICES];
+  cl_uint devices_n = 0;
+  CL_CHECK(clGetDeviceIDs(
+    platform, CL_DEVICE_TYPE_ALL, MAX_DEVICES, devices, &devices_n));
+
+  printf("=== %d OpenCL device(s) found on platform:\n", devices_n);
+  char buffer[10240];
+  for (unsigned int i = 0; i < devices_n; i++) {
+    cl_uint buf_uint;
+    cl_ulong buf_ulong;
+    size_t wi_size[3];
+    printf("  -- %d --\n", i);
+    CL_CHECK(clGetDeviceInfo(
+      devices[i], CL_DEVICE_NAME, sizeof(buffer), buffer, NULL));
+    printf("  DEVICE_NAME = %s\n", buffer);
+    CL_CHECK(clGetDeviceInfo(
+      devices[i], CL_DEVICE_VENDOR, sizeof(buffer), buffer, NULL));
+    printf("  DEVICE_VENDOR = %s\n", buffer);
+    CL_CHECK(clGetDeviceInfo(
+      devices[i], CL_DEVICE_VERSION, sizeof(buffer), buffer, NULL));
+    printf("  DEVICE_VERSION = %s\n", buffer);
+    CL_CHECK(clGetDeviceInfo(
+      devices[i], CL_DRIVER_VERSION, sizeof(buffer), buffer, NULL));
+    printf("  DRIVER_VERSION = %s\n", buffer);
+    CL_CHECK(clGetDeviceInfo(devices[i],
+                             CL_DEVICE_MAX_COMPUTE_UNITS,
+                             sizeof(buf_uint),
+                             &buf_uint,
+                             NULL));
+    printf("  DEVICE_MAX_COMPUTE_UNITS = %u\n", (unsigned int)buf_uint);
+    CL_CHECK(clGetDeviceInfo(devices[i],
+                             CL_DEVICE_MAX_CLOCK_FREQUENCY,
+                             sizeof(buf_uint),
+                             &buf_uint,
+                             NULL));
+    printf("  DEVICE_MAX_CLOCK_FREQUENCY = %u\n", (unsigned int)buf_uint);
+    CL_CHECK(clGetDeviceInfo(devices[i],
+                             CL_DEVICE_GLOBAL_MEM_SIZE,
+                             sizeof(buf_ulong),
+                             &buf_ulong,
+                             NULL));
+    printf("  DEVICE_GLOBAL_MEM_SIZE = %llu\n", (unsigned long long)buf_ulong);
+    CL_CHECK(clGetDeviceInfo(devices[i],
+                             CL_DEVICE_MAX_WORK_ITEM_SIZES,
+                             sizeof(wi_size),
+                             &wi_size,
+                             NULL));
+    printf("  DEVICE_MAX_WG_SIZE X=%ld,Y=%ld,Z=%ld\n",
+           wi_size[0],
+           wi_size[1],
+           wi_size[2]);
+  }
+}
+
+static cl_device_id
+find_device(int platform_id, int device_id, bool verbose)
+{
+  cl_platform_id platforms[MAX_PLATFORMS];
+  cl_uint platforms_n = 0;
+  CL_CHECK(clGetPlatformIDs(MAX_PLATFORMS, platforms, &platforms_n));
+  if (verbose) {
+    print_platforms();
+  }
+  if (platform_id < 0 || (cl_uint)platform_id >= platforms_n) {
+    return NULL;
+  }
+  if (verbose) {
+    print_devices(platforms[platform_id]);
+  }
+
+  cl_device_id devices[MAX_DEVICES];
+  cl_uint devices_n = 0;
+  if (clGetDeviceIDs(platforms[platform_id],
+                     CL_DEVICE_TYPE_ALL,
+                     MAX_DEVICES,
+                     devices,
+                     &devices_n) != CL_SUCCESS ||
+      device_id < 0 || (cl_uint)device_id >= devices_n) {
+    return NULL;
+  }
+  return devices[device_id];
+}
+
+cl_device_id
+select_device(int platform_id, int device_id, bool verbose)
+{
+  double start = now_ns();
+  cl_device_id device = find_device(platform_id, device_id, verbose);
+  cltrace_phase("select device", start);
+  return device;
+}
+
+Kernel
+create_kernel(cl_program program, const char* name)
+{
+  return Kernel(CL_CHECK_ERR(clCreateKernel(program, name, &_err)));
+}
+
+const std::string&
+kernel_preamble()
+{
+  static const std::string preamble =
+    std::string("#ifdef SPEC_FACTOR\n"
+                "#define FACTOR (SPEC_FACTOR)\n"
+                "#else\n"
+                "#define FACTOR factor\n"
+                "#endif\n"
+                "#ifdef SPEC_N\n"
+                "#define N SPEC_N\n"
+                "#else\n"
+                "#define N n\n"
+                "#endif\n") +
+    cldtype_preamble();
+  return preamble;
+}
+
+bool
+load_source(const char* path, std::string* source)
+{
+  std::ifstream file(path, std::ios::in);
+  if (!file.is_open()) {
+    fprintf(stderr, "Failed to open file for reading: %s\n", path);
+    return false;
+  }
+  std::ostringstream oss;
+  oss << file.rdbuf();
+  *source = oss.str();
+  return true;
+}
+
+bool
+ProgramCache::Key::operator<(const Key& other) const
+{
+  if (context != other.context) {
+    return context < other.context;
+  }
+  if (device != other.device) {
+    return device < other.device;
+  }
+  if (path != other.path) {
+    return path < other.path;
+  }
+  return options < other.options;
+}
+
+Program
+ProgramCache::get(cl_context context,
+                  cl_device_id device,
+                  const char* path,
+                  const char* options,
+                  enum CacheStatus* status)
+{
+  Key key = { context, device, path, options != NULL ? options : "" };
+  std::map<Key, Program>::iterator it = programs_.find(key);
+  if (it != programs_.end()) {
+    *status = CACHE_HIT;
+    return it->second;
+  }
+
+  // Build log lines keep pointing into the file
+  std::string source = kernel_preamble() + "#line 1\n";
+  std::string file;
+  if (!load_source(path, &file)) {
+    return Program();
+  }
+  source += file;
+  Program program(clcache_program(
+    context, device, source.c_str(), source.size(), options, status));
+  if (program != NULL) {
+    programs_[key] = program;
+  }
+  return program;
+}
+
+BufferPool::BufferPool(cl_context context, size_t arena_size)
+  : context_(Context::retain(context))
+  , arena_size_(arena_size)
+  , align_(1)
+  , stats_()
+{
+  cl_device_id devices[MAX_DEVICES];
+  size_t devices_size = 0;
+  CL_CHECK(clGetContextInfo(
+    context, CL_CONTEXT_DEVICES, sizeof(devices), devices, &devices_size));
+  for (size_t i = 0; i < devices_size / sizeof(cl_device_id); i++) {
+    cl_uint align_bits = 0;
+    CL_CHECK(clGetDeviceInfo(devices[i],
+                             CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+                             sizeof(align_bits),
+                             &align_bits,
+                             NULL));
+    if (align_bits / 8 > align_) {
+      align_ = align_bits / 8;
+    }
+  }
+}
+
+size_t
+BufferPool::size_class(size_t size)
+{
+  size_t c = POOL_MIN_CLASS;
+  while (c < size) {
+    c <<= 1;
+  }
+  return c;
+}
+
+// Report err through out, or abort on it if there is no out
+static bool
+pool_error(cl_int err, cl_int* out, const char* call)
+{
+  if (out != NULL) {
+    *out = err;
+    return err != CL_SUCCESS;
+  }
+  if (err != CL_SUCCESS) {
+    fprintf(stderr, "OpenCL Error: '%s' returned %d!\n", call, (int)err);
+    abort();
+  }
+  return false;
+}
+
+Mem
+BufferPool::acquire(cl_mem_flags flags, size_t size, cl_int* err)
+{
+  size_t c = size_class(size);
+  stats_.acquires++;
+  if (err != NULL) {
+    *err = CL_SUCCESS;
+  }
+  std::vector<Mem>& free = free_[Key(flags, c)];
+  if (!free.empty()) {
+    Mem mem = free.back();
+    free.pop_back();
+    stats_.reuses++;
+    stats_.held_bytes -= c;
+    return mem;
+  }
+
+  // Host pointer flags cannot be given to sub-buffers
+  const cl_mem_flags host_flags =
+    CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR;
+  if (arena_size_ > 0 && c <= arena_size_ && !(flags & host_flags)) {
+    return carve(flags, c, err);
+  }
+  cl_int create_err;
+  Mem mem(clCreateBuffer(context_, flags, c, NULL, &create_err));
+  if (create_err != CL_SUCCESS && c > size) {
+    // The class is over the device limits: an exact buffer, which release
+    // does not keep
+    c = size;
+    mem = Mem(clCreateBuffer(context_, flags, c, NULL, &create_err));
+  }
+  if (pool_error(create_err, err, "clCreateBuffer")) {
+    return Mem();
+  }
+  stats_.buffers++;
+  stats_.allocated_bytes += c;
+  return mem;
+}
+
+Mem
+BufferPool::carve(cl_mem_flags flags, size_t size, cl_int* err)
+{
+  Arena& arena = arenas_[flags];
+  size_t origin = (arena.used + align_ - 1) / align_ * align_;
+  cl_int create_err;
+  if (arena.mem == NULL || origin + size > arena_size_) {
+    // The sub-buffers carved so far keep the previous arena alive
+    Mem mem(clCreateBuffer(context_, flags, arena_size_, NULL, &create_err));
+    if (pool_error(create_err, err, "clCreateBuffer")) {
+      return Mem();
+    }
+    arena.mem = mem;
+    origin = 0;
+    stats_.buffers++;
+    stats_.allocated_bytes += arena_size_;
+  }
+  cl_buffer_region region = { origin, size };
+  Mem mem(clCreateSubBuffer(
+    arena.mem, flags, CL_BUFFER_CREATE_TYPE_REGION, &region, &create_err));
+  if (pool_error(create_err, err, "clCreateSubBuffer")) {
+    return Mem();
+  }
+  arena.used = origin + size;
+  stats_.sub_buffers++;
+  return mem;
+}
+
+void
+BufferPool::release(Mem mem)
+{
+  if (mem == NULL) {
+    return;
+  }
+  cl_mem_flags flags;
+  size_t size;
+  CL_CHECK(
+    clGetMemObjectInfo(mem, CL_MEM_FLAGS, sizeof(flags), &flags, NULL));
+  CL_CHECK(clGetMemObjectInfo(mem, CL_MEM_SIZE, sizeof(size), &size, NULL));
+  if (size != size_class(size)) {
+    return;
+  }
+  free_[Key(flags, size)].push_back(mem);
+  stats_.held_bytes += size;
+}
+
+void
+BufferPool::trim()
+{
+  free_.clear();
+  arenas_.clear();
+  stats_.held_bytes = 0;
+}
+
+void
+BufferPool::print_stats(const char* name) const
+{
+  printf("pool %s: acquires %lu reuses %lu buffers %lu sub-buffers %lu "
+         "allocated %lu bytes held %lu bytes\n",
+         name,
+         (unsigned long)stats_.acquires,
+         (unsigned long)stats_.reuses,
+         (unsigned long)stats_.buffers,
+         (unsigned long)stats_.sub_buffers,
+         (unsigned long)stats_.allocated_bytes,
+         (unsigned long)stats_.held_bytes);
+}
+
+void
+pool_config(size_t* arena_size, int* bench_buffers)
+{
+  *arena_size = 0;
+  *bench_buffers = 0;
+  char* arena_str = getenv("POOL_ARENA");
+  if (arena_str != NULL && atol(arena_str) > 0) {
+    *arena_size = atol(arena_str);
+  }
+  char* bench_str = getenv("POOL_BENCH");
+  if (bench_str != NULL && atoi(bench_str) > 0) {
+    *bench_buffers = atoi(bench_str);
+  }
+}
+
+// Mean time of one buffer over the runs, with acquire(i) making buffer i
+// and release(i) dropping it
+template<typename Acquire, typename Release>
+static double
+time_buffers(cl_command_queue queue,
+             int buffers,
+             int iterations,
+             Acquire acquire,
+             Release release)
+{
+  const float one = 1;
+  double total = 0;
+  for (int it = 0; it < iterations; it++) {
+    double start = now_ns();
+    for (int i = 0; i < buffers; i++) {
+      cl_mem mem = acquire(i);
+      CL_CHECK(clEnqueueWriteBuffer(
+        queue, mem, CL_TRUE, 0, sizeof(one), &one, 0, NULL, NULL));
+    }
+    for (int i = 0; i < buffers; i++) {
+      release(i);
+    }
+    total += now_ns() - start;
+  }
+  return total / ((double)iterations * buffers);
+}
+
+void
+pool_bench(cl_context context,
+           cl_command_queue queue,
+           size_t bytes,
+           int buffers,
+           int iterations,
+           size_t arena_size)
+{
+  const cl_mem_flags flags = CL_MEM_READ_WRITE;
+  std::vector<Mem> mems(buffers);
+
+  double create_ns = time_buffers(
+    queue,
+    buffers,
+    iterations,
+    [&](int i) {
+      mems[i] = Mem(
+        CL_CHECK_ERR(clCreateBuffer(context, flags, bytes, NULL, &_err)));
+      return mems[i].get();
+    },
+    [&](int i) { mems[i].reset(); });
+
+  BufferPool pool(context, 0);
+  double pool_ns = time_buffers(
+    queue,
+    buffers,
+    iterations,
+    [&](int i) {
+      mems[i] = pool.acquire(flags, bytes);
+      return mems[i].get();
+    },
+    [&](int i) { pool.release(std::move(mems[i])); });
+
+  size_t run_size = buffers * BufferPool::size_class(bytes);
+  BufferPool arena(
+    context, arena_size > 0 && arena_size < run_size ? arena_size : run_size);
+  double arena_ns = time_buffers(
+    queue,
+    buffers,
+    iterations,
+    [&](int i) {
+      mems[i] = arena.acquire(flags, bytes);
+      return mems[i].get();
+    },
+    [&](int i) { arena.release(std::move(mems[i])); });
+
+  printf("pool bench %lu bytes x%d: create(ns):%lg pool(ns):%lg "
+         "arena(ns):%lg speedup %.2fx\n",
+         (unsigned long)bytes,
+         buffers,
+         create_ns,
+         pool_ns,
+         arena_ns,
+         pool_ns > 0 ? create_ns / pool_ns : 0);
+  pool.print_stats("bench");
+  arena.print_stats("bench arena");
+}
+
+cl_event*
+EventTimer::next()
+{
+  events_.push_back(Event());
+  return events_.back().out();
+}
+
+void
+EventTimer::collect(std::vector<struct BenchSample>* samples)
+{
+  for (size_t i = 0; i < events_.size(); i++) {
+    cl_event event = events_[i];
+    CL_CHECK(clWaitForEvents(1, &event));
+    struct BenchSample sample;
+    CL_CHECK(clbench_sample(event, &sample));
+    samples->push_back(sample);
+  }
+}
+
+static cl_context
+create_context(cl_device_id device)
+{
+  double start = now_ns();
+  cl_context context =
+    CL_CHECK_ERR(clCreateContext(NULL, 1, &device, notify, NULL, &_err));
+  cltrace_phase("create context", start);
+  return context;
+}
+
+static cl_command_queue
+create_queue(cl_context context, cl_device_id device, enum QueueMode* mode)
+{
+  double start = now_ns();
+  cl_command_queue queue =
+    CL_CHECK_ERR(clbench_create_queue(context, device, mode, &_err));
+  cltrace_phase("create queue", start);
+  return queue;
+}
+
+Runtime::Runtime(cl_device_id device,
+                 enum QueueMode* mode,
+                 size_t arena_size)
+  : device_(device)
+  , context_(create_context(device))
+  , queue_(create_queue(context_, device, mode))
+  , pool_(context_, arena_size)
+{
+}
+
+} // namespace clrt
@@ -0,0 +1,323 @@
+#ifndef CLRT_HPP
+#define CLRT_HPP
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include "clbench.h"
+#include "clcache.h"
+#include "clcheck.h"
+#include "cltrace.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+///
+//  C++ runtime on top of the OpenCL C API and the common/ helpers (libclrt):
+//  owned handles, device selection, kernel sources, and a Runtime holding a
+//  context, a queue, the programs built so far and a buffer pool, so one
+//  process can serve any number of kernel launches with one setup.
+//
+//  Errors abort through CL_CHECK, like the rest of the tree.
+//
+namespace clrt {
+
+///
+//  An owned OpenCL object: released on destruction, retained on copy.
+//  Converts to the raw handle for the C API.
+//
+template<typename T,
+         cl_int(CL_API_CALL* Retain)(T),
+         cl_int(CL_API_CALL* Release)(T)>
+class Handle
+{
+public:
+  Handle()
+    : handle_(NULL)
+  {
+  }
+
+  // Takes over the reference of the clCreate* call that returned handle
+  explicit Handle(T handle)
+    : handle_(handle)
+  {
+  }
+
+  Handle(const Handle& other)
+    : handle_(other.handle_)
+  {
+    if (handle_ != NULL) {
+      Retain(handle_);
+    }
+  }
+
+  Handle(Handle&& other)
+    : handle_(other.handle_)
+  {
+    other.handle_ = NULL;
+  }
+
+  Handle& operator=(Handle other)
+  {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
+  ~Handle() { reset(); }
+
+  // A new reference to handle, which the caller keeps
+  static Handle retain(T handle)
+  {
+    if (handle != NULL) {
+      Retain(handle);
+    }
+    return Handle(handle);
+  }
+
+  T get() const { return handle_; }
+  operator T() const { return handle_; }
+
+  void reset()
+  {
+    if (handle_ != NULL) {
+      Release(handle_);
+      handle_ = NULL;
+    }
+  }
+
+  // Out parameter of a clEnqueue* / clCreate* call (releases the current
+  // object first)
+  T* out()
+  {
+    reset();
+    return &handle_;
+  }
+
+private:
+  T handle_;
+};
+
+typedef Handle<cl_context, clRetainContext, clReleaseContext> Context;
+typedef Handle<cl_command_queue, clRetainCommandQueue, cltrace_release_queue>
+  Queue;
+typedef Handle<cl_program, clRetainProgram, clReleaseProgram> Program;
+typedef Handle<cl_kernel, clRetainKernel, clReleaseKernel> Kernel;
+typedef Handle<cl_mem, clRetainMemObject, clReleaseMemObject> Mem;
+typedef Handle<cl_event, clRetainEvent, clReleaseEvent> Event;
+
+template<typename A>
+void
+set_arg(cl_kernel kernel, cl_uint index, const A& value)
+{
+  CL_CHECK(clSetKernelArg(kernel, index, sizeof(value), &value));
+}
+
+///
+//  Print every platform (profile, version, name, vendor, extensions)
+//
+void
+print_platforms();
+
+///
+//  Print the devices of a platform (name, vendor, versions, compute units,
+//  clock, memory, work-item sizes)
+//
+void
+print_devices(cl_platform_id platform);
+
+///
+//  Device device_id of platform platform_id (CL_DEVICE_TYPE_ALL), or NULL
+//  if there is no such device. With verbose set the platforms and the
+//  devices of the platform are printed.
+//
+cl_device_id
+select_device(int platform_id, int device_id, bool verbose);
+
+///
+//  Kernel name of a built program
+//
+Kernel
+create_kernel(cl_program program, const char* name);
+
+///
+//  Macros of the element-wise kernel files, driven by their build options:
+//  N and FACTOR (the n and factor arguments, or the -DSPEC_N and
+//  -DSPEC_FACTOR constants of a specialized build) and the element type
+//  ones of cldtype_preamble. ProgramCache prepends it to every file, so it
+//  is part of the source the binary cache hashes.
+//
+const std::string&
+kernel_preamble();
+
+///
+//  Contents of a kernel source file; false if it cannot be read
+//
+bool
+load_source(const char* path, std::string* source);
+
+///
+//  Programs built by this process, keyed by context, device, source file and
+//  build options, on top of the on-disk binary cache (clcache.h): each
+//  variant is built once per process.
+//
+class ProgramCache
+{
+public:
+  // A NULL Program (with the build log on stderr) if the file cannot be read
+  // or does not build. *status is CACHE_HIT for a program built earlier.
+  Program get(cl_context context,
+              cl_device_id device,
+              const char* path,
+              const char* options,
+              enum CacheStatus* status);
+
+  void clear() { programs_.clear(); }
+
+private:
+  struct Key
+  {
+    cl_context context;
+    cl_device_id device;
+    std::string path;
+    std::string options;
+
+    bool operator<(const Key& other) const;
+  };
+
+  std::map<Key, Program> programs_;
+};
+
+///
+//  Allocation counters of a BufferPool
+//
+struct PoolStats
+{
+  size_t acquires;        // acquire calls
+  size_t reuses;          // acquires served by a released buffer
+  size_t buffers;         // clCreateBuffer calls, arenas included
+  size_t sub_buffers;     // clCreateSubBuffer calls
+  size_t allocated_bytes; // bytes of the buffers and arenas created
+  size_t held_bytes;      // bytes of the released buffers kept for reuse
+};
+
+///
+//  Device buffers of one context kept for reuse. Sizes are rounded up to a
+//  power of two (4096 bytes at least): acquire hands back a released
+//  buffer with the same flags and size class, or makes one. With an arena
+//  size, the classes that fit are carved (clCreateSubBuffer) out of arena
+//  buffers of that size instead of being allocated one by one.
+//
+class BufferPool
+{
+public:
+  BufferPool(cl_context context, size_t arena_size);
+
+  // A buffer of size bytes. Errors abort, unless err is given: it then gets
+  // the error and the Mem is empty.
+  Mem acquire(cl_mem_flags flags, size_t size, cl_int* err = NULL);
+  // Keep mem for a later acquire (buffers not sized by a class are released)
+  void release(Mem mem);
+  // Release the buffers held
+  void trim();
+
+  static size_t size_class(size_t size);
+
+  const struct PoolStats& stats() const { return stats_; }
+  void print_stats(const char* name) const;
+
+private:
+  typedef std::pair<cl_mem_flags, size_t> Key;
+
+  struct Arena
+  {
+    Mem mem;
+    size_t used;
+  };
+
+  Mem carve(cl_mem_flags flags, size_t size, cl_int* err);
+
+  Context context_;
+  size_t arena_size_;
+  size_t align_; // sub-buffer origin alignment of the devices, in bytes
+  std::map<Key, std::vector<Mem>> free_;
+  std::map<cl_mem_flags, Arena> arenas_;
+  struct PoolStats stats_;
+};
+
+///
+//  Env vars:
+//  - POOL_ARENA: (int) bytes of the arena buffers a pool carves its
+//    sub-buffers from (default 0: one buffer per acquire)
+//  - POOL_BENCH: (int) buffers per run of the allocation benchmark (default
+//    0: no benchmark)
+//
+void
+pool_config(size_t* arena_size, int* bench_buffers);
+
+///
+//  Allocation latency of buffers of bytes bytes, buffers at a time, over
+//  iterations runs: clCreateBuffer / clReleaseMemObject against a pool and
+//  against a pool carving an arena (of arena_size bytes, or of all the
+//  buffers of a run if smaller). Every buffer gets a one-element write, so
+//  drivers allocating on first use are measured too.
+//
+void
+pool_bench(cl_context context,
+           cl_command_queue queue,
+           size_t bytes,
+           int buffers,
+           int iterations,
+           size_t arena_size);
+
+///
+//  Events of enqueued commands, sampled (clbench_sample) once complete
+//
+class EventTimer
+{
+public:
+  // Event out parameter for the next command, valid until the next call
+  cl_event* next();
+
+  size_t size() const { return events_.size(); }
+  cl_event operator[](size_t i) const { return events_[i]; }
+
+  // Wait for every command and append their samples
+  void collect(std::vector<struct BenchSample>* samples);
+  void clear() { events_.clear(); }
+
+private:
+  std::vector<Event> events_;
+};
+
+///
+//  A context and a profiling queue (clbench_create_queue) on one device,
+//  with the programs built on it and a buffer pool (carving arenas of
+//  arena_size bytes, if not 0)
+//
+class Runtime
+{
+public:
+  Runtime(cl_device_id device, enum QueueMode* mode, size_t arena_size);
+
+  cl_device_id device() const { return device_; }
+  cl_context context() const { return context_; }
+  cl_command_queue queue() const { return queue_; }
+  ProgramCache& programs() { return programs_; }
+  BufferPool& pool() { return pool_; }
+
+private:
+  cl_device_id device_;
+  Context context_;
+  Queue queue_;
+  ProgramCache programs_;
+  BufferPool pool_;
+};
+
+} // namespace clrt
+
+#endif
@@ -0,0 +1,189 @@
+#include "clshm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void
+clshm_config(const char** input, const char** output)
+{
+  *input = getenv("INPUT");
+  *output = getenv("OUTPUT");
+}
+
+// A descriptor of spec, owned by the caller (fd:<n> is duplicated)
+static int
+open_spec(const char* spec, bool output)
+{
+  int flags = output ? O_RDWR | O_CREAT : O_RDONLY;
+  if (strncmp(spec, "fd:", 3) == 0) {
+    return dup(atoi(spec + 3));
+  }
+  if (strncmp(spec, "shm:", 4) == 0) {
+    return shm_open(spec + 4, flags, 0600);
+  }
+  return open(spec, flags, 0600);
+}
+
+bool
+clshm_open(struct HostFile* file,
+           const char* spec,
+           size_t size,
+           enum HostIo io,
+           bool output)
+{
+  memset(file, 0, sizeof(*file));
+  file->io = io;
+  file->output = output;
+  file->size = size;
+  file->fd = -1;
+  if (spec == NULL) {
+    // An output nobody reads: anonymous memory, the same way
+    if (io == HOSTIO_MMAP) {
+      void* addr = mmap(NULL,
+                        size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS,
+                        -1,
+                        0);
+      file->addr = addr != MAP_FAILED ? addr : NULL;
+    } else {
+      size_t page = (size_t)sysconf(_SC_PAGESIZE);
+      if (posix_memalign(&file->addr, page, size > 0 ? size : page) != 0) {
+        file->addr = NULL;
+      }
+    }
+    return file->addr != NULL;
+  }
+  file->fd = open_spec(spec, output);
+  if (file->fd < 0) {
+    fprintf(stderr, "clshm: %s: %s\n", spec, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(file->fd, &st) != 0) {
+    fprintf(stderr, "clshm: %s: %s\n", spec, strerror(errno));
+    clshm_close(file);
+    return false;
+  }
+  if ((size_t)st.st_size < size) {
+    if (!output) {
+      fprintf(stderr,
+              "clshm: %s holds %ld bytes, %ld needed\n",
+              spec,
+              (long)st.st_size,
+              (long)size);
+      clshm_close(file);
+      return false;
+    }
+    if (ftruncate(file->fd, size) != 0) {
+      fprintf(stderr, "clshm: %s: %s\n", spec, strerror(errno));
+      clshm_close(file);
+      return false;
+    }
+  }
+
+  if (io == HOSTIO_MMAP) {
+    // An input is mapped private and writable: a driver syncing the host
+    // copy of a read-only buffer gets copy-on-write pages, not a fault
+    void* addr = mmap(NULL,
+                      size,
+                      PROT_READ | PROT_WRITE,
+                      output ? MAP_SHARED : MAP_PRIVATE,
+                      file->fd,
+                      0);
+    if (addr == MAP_FAILED) {
+      fprintf(stderr, "clshm: mmap %s: %s\n", spec, strerror(errno));
+      clshm_close(file);
+      return false;
+    }
+    file->addr = addr;
+    return true;
+  }
+
+  // Page-aligned like the MEMORY_USE_HOST_PTR allocations
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  if (posix_memalign(&file->addr, page, size > 0 ? size : page) != 0) {
+    file->addr = NULL;
+    clshm_close(file);
+    return false;
+  }
+  if (output) {
+    return true;
+  }
+  for (size_t done = 0; done < size;) {
+    ssize_t n = pread(file->fd, (char*)file->addr + done, size - done, done);
+    if (n <= 0) {
+      fprintf(stderr,
+              "clshm: read %s: %s\n",
+              spec,
+              n < 0 ? strerror(errno) : "end of file");
+      clshm_close(file);
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+bool
+clshm_sync(struct HostFile* file)
+{
+  if (file->io == HOSTIO_MMAP || !file->output || file->fd < 0) {
+    return true;
+  }
+  for (size_t done = 0; done < file->size;) {
+    ssize_t n = pwrite(
+      file->fd, (char*)file->addr + done, file->size - done, done);
+    if (n <= 0) {
+      fprintf(stderr, "clshm: write: %s\n", strerror(errno));
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+void
+clshm_close(struct HostFile* file)
+{
+  if (file->addr != NULL) {
+    if (file->io == HOSTIO_MMAP) {
+      munmap(file->addr, file->size);
+    } else {
+      free(file->addr);
+    }
+    file->addr = NULL;
+  }
+  if (file->fd >= 0) {
+    close(file->fd);
+    file->fd = -1;
+  }
+}
+
+cl_mem
+clshm_buffer(cl_context context,
+             cl_device_id device,
+             cl_mem_flags flags,
+             void* ptr,
+             size_t size,
+             bool* wrapped,
+             cl_int* err)
+{
+  cl_uint align_bits = 8;
+  clGetDeviceInfo(device,
+                  CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+                  sizeof(align_bits),
+                  &align_bits,
+                  NULL);
+  size_t align = align_bits / 8 > 0 ? align_bits / 8 : 1;
+  *wrapped = (uintptr_t)ptr % align == 0;
+  flags |= *wrapped ? CL_MEM_USE_HOST_PTR : CL_MEM_COPY_HOST_PTR;
+  return clCreateBuffer(context, flags, size, ptr, err);
+}
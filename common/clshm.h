@@ -0,0 +1,92 @@
+#ifndef CLSHM_H
+#define CLSHM_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///
+//  How the vectors of another process reach the host memory of a run
+//
+enum HostIo
+{
+  HOSTIO_MMAP, // mapped in place, wrapped by the buffers
+  HOSTIO_READ, // read() into (and write() back from) a private copy
+};
+
+///
+//  The vectors of a file shared with another process. spec is a path,
+//  shm:<name> (POSIX shared memory, shm_open) or fd:<n> (a descriptor
+//  inherited from the parent, e.g. a memfd).
+//
+struct HostFile
+{
+  enum HostIo io;
+  int fd;
+  void* addr; // the mapping or the copy
+  size_t size;
+  bool output; // written back by clshm_sync in HOSTIO_READ mode
+};
+
+///
+//  Env vars:
+//  - INPUT: (str) file, shm:<name> or fd:<n> holding the input vectors
+//    (default unset: the input is generated)
+//  - OUTPUT: (str) file, shm:<name> or fd:<n> to write the output to,
+//    created or grown as needed (default unset: not written out)
+//
+void
+clshm_config(const char** input, const char** output);
+
+///
+//  Open size bytes of spec: an input must hold them, an output is grown to
+//  them. HOSTIO_MMAP maps them; HOSTIO_READ allocates a page-aligned copy,
+//  read() into for an input. A NULL spec opens anonymous memory (an output
+//  not written out). False (with the reason on stderr) on errors.
+//
+bool
+clshm_open(struct HostFile* file,
+           const char* spec,
+           size_t size,
+           enum HostIo io,
+           bool output);
+
+///
+//  Make an output visible to the other process: write() of the copy in
+//  HOSTIO_READ mode, nothing to do for a shared mapping
+//
+bool
+clshm_sync(struct HostFile* file);
+
+void
+clshm_close(struct HostFile* file);
+
+///
+//  A buffer of size bytes over host memory at ptr: CL_MEM_USE_HOST_PTR when
+//  ptr meets the base address alignment of device (no copy on devices
+//  sharing host memory), CL_MEM_COPY_HOST_PTR otherwise. *wrapped tells
+//  which.
+//
+cl_mem
+clshm_buffer(cl_context context,
+             cl_device_id device,
+             cl_mem_flags flags,
+             void* ptr,
+             size_t size,
+             bool* wrapped,
+             cl_int* err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
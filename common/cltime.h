@@ -0,0 +1,18 @@
+#ifndef CLTIME_H
+#define CLTIME_H
+
+#include <time.h>
+
+///
+//  Monotonic wall clock in nanoseconds, used to time host-side phases
+//  (transfers, program builds) that have no OpenCL profiling event.
+//
+static inline double
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+#endif
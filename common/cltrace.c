@@ -0,0 +1,388 @@
+#include "cltrace.h"
+#include "cltime.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAX_DEVICES 16
+
+struct TraceRecord
+{
+  char name[64];
+  bool command;     // a command of a queue, or a host phase
+  int pid;          // 0: the host, 1 + device index
+  int tid;          // host thread, or queue of the device
+  double start_ns;  // host clock
+  double end_ns;
+  double queued_ns; // commands: enqueue time
+};
+
+struct TraceQueue
+{
+  cl_command_queue queue; // NULL once released: the track only names a tid
+  int pid;
+  int tid;
+  double offset_ns; // host clock - device clock
+};
+
+struct TraceDevice
+{
+  cl_device_id device;
+  char name[128];
+  int queues;
+};
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool trace_on = false;
+static char trace_path[4096];
+static double trace_origin;
+static struct TraceRecord* trace_records = NULL;
+static size_t trace_len = 0;
+static size_t trace_cap = 0;
+static struct TraceDevice trace_devices[TRACE_MAX_DEVICES];
+static size_t trace_n_devices = 0;
+static struct TraceQueue* trace_queues = NULL;
+static size_t trace_n_queues = 0;
+static size_t trace_queues_cap = 0;
+static bool trace_dropped = false; // commands of untracked queues seen
+static int trace_n_threads = 0;
+// Host track of the calling thread, -1 until it records a phase
+static __thread int trace_tid = -1;
+
+static void
+trace_at_exit(void)
+{
+  if (cltrace_write(trace_path)) {
+    printf("trace: %lu events written to %s\n", trace_len, trace_path);
+  } else {
+    fprintf(stderr, "Failed to write trace to %s\n", trace_path);
+  }
+}
+
+void
+cltrace_config(void)
+{
+  char* path = getenv("TRACE");
+  if (path == NULL || trace_on) {
+    return;
+  }
+  snprintf(trace_path, sizeof(trace_path), "%s", path);
+  trace_origin = now_ns();
+  trace_on = true;
+  atexit(trace_at_exit);
+}
+
+bool
+cltrace_enabled(void)
+{
+  return trace_on;
+}
+
+// A new record, or NULL if out of memory (the caller holds the mutex)
+static struct TraceRecord*
+trace_append(void)
+{
+  if (trace_len == trace_cap) {
+    size_t cap = trace_cap > 0 ? 2 * trace_cap : 1024;
+    struct TraceRecord* records = (struct TraceRecord*)realloc(
+      trace_records, sizeof(struct TraceRecord) * cap);
+    if (records == NULL) {
+      return NULL;
+    }
+    trace_records = records;
+    trace_cap = cap;
+  }
+  struct TraceRecord* record = &trace_records[trace_len++];
+  memset(record, 0, sizeof(*record));
+  return record;
+}
+
+void
+cltrace_phase(const char* name, double start_ns)
+{
+  if (!trace_on) {
+    return;
+  }
+  double end_ns = now_ns();
+  pthread_mutex_lock(&trace_mutex);
+  if (trace_tid < 0) {
+    trace_tid = trace_n_threads++;
+  }
+  struct TraceRecord* record = trace_append();
+  if (record != NULL) {
+    snprintf(record->name, sizeof(record->name), "%s", name);
+    record->pid = 0;
+    record->tid = trace_tid;
+    record->start_ns = start_ns;
+    record->end_ns = end_ns;
+  }
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+// Host clock minus device clock of queue: the end of a marker against the
+// host time it is seen complete (an upper bound of the true offset)
+static double
+trace_calibrate(cl_command_queue queue)
+{
+  cl_event marker;
+  if (clEnqueueMarkerWithWaitList(queue, 0, NULL, &marker) != CL_SUCCESS) {
+    return 0;
+  }
+  clWaitForEvents(1, &marker);
+  double host = now_ns();
+  cl_ulong end = 0;
+  clGetEventProfilingInfo(
+    marker, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+  clReleaseEvent(marker);
+  return end > 0 ? host - (double)end : 0;
+}
+
+// Track of queue, or -1 if it has none yet (the caller holds the mutex)
+static long
+trace_find(cl_command_queue queue)
+{
+  for (size_t i = 0; i < trace_n_queues; i++) {
+    if (trace_queues[i].queue == queue) {
+      return (long)i;
+    }
+  }
+  return -1;
+}
+
+// New track of queue, its device clock offset_ns behind the host clock, or
+// -1 when out of devices or memory (the caller holds the mutex)
+static long
+trace_add(cl_command_queue queue, double offset_ns)
+{
+  cl_device_id device = NULL;
+  clGetCommandQueueInfo(
+    queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+  size_t d = 0;
+  while (d < trace_n_devices && trace_devices[d].device != device) {
+    d++;
+  }
+  if (d == trace_n_devices) {
+    if (trace_n_devices == TRACE_MAX_DEVICES) {
+      return -1;
+    }
+    trace_devices[d].device = device;
+    trace_devices[d].queues = 0;
+    snprintf(trace_devices[d].name, sizeof(trace_devices[d].name), "?");
+    clGetDeviceInfo(device,
+                    CL_DEVICE_NAME,
+                    sizeof(trace_devices[d].name),
+                    trace_devices[d].name,
+                    NULL);
+    trace_n_devices++;
+  }
+  if (trace_n_queues == trace_queues_cap) {
+    size_t cap = trace_queues_cap > 0 ? 2 * trace_queues_cap : 16;
+    struct TraceQueue* queues = (struct TraceQueue*)realloc(
+      trace_queues, sizeof(struct TraceQueue) * cap);
+    if (queues == NULL) {
+      return -1;
+    }
+    trace_queues = queues;
+    trace_queues_cap = cap;
+  }
+  struct TraceQueue* track = &trace_queues[trace_n_queues];
+  track->queue = queue;
+  track->pid = 1 + (int)d;
+  track->tid = trace_devices[d].queues++;
+  track->offset_ns = offset_ns;
+  return (long)trace_n_queues++;
+}
+
+cl_int CL_API_CALL
+cltrace_release_queue(cl_command_queue queue)
+{
+  if (trace_on && queue != NULL) {
+    cl_uint refs = 0;
+    clGetCommandQueueInfo(
+      queue, CL_QUEUE_REFERENCE_COUNT, sizeof(refs), &refs, NULL);
+    if (refs == 1) {
+      pthread_mutex_lock(&trace_mutex);
+      long q = trace_find(queue);
+      if (q >= 0) {
+        trace_queues[q].queue = NULL;
+      }
+      pthread_mutex_unlock(&trace_mutex);
+    }
+  }
+  return clReleaseCommandQueue(queue);
+}
+
+static const char*
+trace_command_name(cl_command_type type)
+{
+  switch (type) {
+    case CL_COMMAND_NDRANGE_KERNEL:
+      return "kernel";
+    case CL_COMMAND_READ_BUFFER:
+    case CL_COMMAND_READ_BUFFER_RECT:
+      return "read";
+    case CL_COMMAND_WRITE_BUFFER:
+    case CL_COMMAND_WRITE_BUFFER_RECT:
+      return "write";
+    case CL_COMMAND_COPY_BUFFER:
+    case CL_COMMAND_SVM_MEMCPY:
+      return "copy";
+    case CL_COMMAND_FILL_BUFFER:
+    case CL_COMMAND_SVM_MEMFILL:
+      return "fill";
+    case CL_COMMAND_MAP_BUFFER:
+    case CL_COMMAND_SVM_MAP:
+      return "map";
+    case CL_COMMAND_UNMAP_MEM_OBJECT:
+    case CL_COMMAND_SVM_UNMAP:
+      return "unmap";
+    case CL_COMMAND_MIGRATE_MEM_OBJECTS:
+      return "migrate";
+    case CL_COMMAND_MARKER:
+    case CL_COMMAND_BARRIER:
+      return "marker";
+    default:
+      return "command";
+  }
+}
+
+void
+cltrace_command(const char* name,
+                cl_event event,
+                const struct BenchSample* sample)
+{
+  if (!trace_on) {
+    return;
+  }
+  cl_command_queue queue = NULL;
+  clGetEventInfo(
+    event, CL_EVENT_COMMAND_QUEUE, sizeof(queue), &queue, NULL);
+  if (name == NULL) {
+    cl_command_type type = 0;
+    clGetEventInfo(event, CL_EVENT_COMMAND_TYPE, sizeof(type), &type, NULL);
+    name = trace_command_name(type);
+  }
+  if (queue == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&trace_mutex);
+  long q = trace_find(queue);
+  if (q < 0) {
+    // First command of the queue: the calibration marker waits for the
+    // queue, which must not hold up the other threads' records
+    pthread_mutex_unlock(&trace_mutex);
+    double offset_ns = trace_calibrate(queue);
+    pthread_mutex_lock(&trace_mutex);
+    q = trace_find(queue);
+    if (q < 0) {
+      q = trace_add(queue, offset_ns);
+    }
+  }
+  struct TraceRecord* record = q >= 0 ? trace_append() : NULL;
+  if (record != NULL) {
+    const struct TraceQueue* track = &trace_queues[q];
+    snprintf(record->name, sizeof(record->name), "%s", name);
+    record->command = true;
+    record->pid = track->pid;
+    record->tid = track->tid;
+    record->queued_ns = (double)sample->queued + track->offset_ns;
+    record->start_ns = (double)sample->start + track->offset_ns;
+    record->end_ns = (double)sample->end + track->offset_ns;
+  } else if (!trace_dropped) {
+    trace_dropped = true;
+    fprintf(stderr,
+            "trace: out of device tracks or memory, commands dropped\n");
+  }
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+// name as a JSON string
+static void
+trace_string(FILE* file, const char* name)
+{
+  fputc('"', file);
+  for (const char* c = name; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', file);
+    }
+    fputc((unsigned char)*c < 0x20 ? ' ' : *c, file);
+  }
+  fputc('"', file);
+}
+
+static void
+trace_metadata(FILE* file,
+               const char* what,
+               int pid,
+               int tid,
+               const char* name,
+               bool* first)
+{
+  fprintf(file,
+          "%s{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+          "\"args\":{\"name\":",
+          *first ? "" : ",\n",
+          what,
+          pid,
+          tid);
+  trace_string(file, name);
+  fprintf(file, "}}");
+  *first = false;
+}
+
+bool
+cltrace_write(const char* path)
+{
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+  pthread_mutex_lock(&trace_mutex);
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  bool first = true;
+  char name[160];
+  trace_metadata(file, "process_name", 0, 0, "host", &first);
+  for (int t = 0; t < trace_n_threads; t++) {
+    snprintf(name, sizeof(name), t == 0 ? "main" : "thread %d", t);
+    trace_metadata(file, "thread_name", 0, t, name, &first);
+  }
+  for (size_t d = 0; d < trace_n_devices; d++) {
+    snprintf(name, sizeof(name), "device %lu: %s", d, trace_devices[d].name);
+    trace_metadata(file, "process_name", 1 + (int)d, 0, name, &first);
+  }
+  for (size_t q = 0; q < trace_n_queues; q++) {
+    snprintf(name, sizeof(name), "queue %d", trace_queues[q].tid);
+    trace_metadata(file,
+                   "thread_name",
+                   trace_queues[q].pid,
+                   trace_queues[q].tid,
+                   name,
+                   &first);
+  }
+  // Microseconds from cltrace_config
+  for (size_t i = 0; i < trace_len; i++) {
+    const struct TraceRecord* record = &trace_records[i];
+    fprintf(file, ",\n{\"name\":");
+    trace_string(file, record->name);
+    fprintf(file,
+            ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f",
+            record->command ? "command" : "phase",
+            record->pid,
+            record->tid,
+            (record->start_ns - trace_origin) / 1e3,
+            (record->end_ns - record->start_ns) / 1e3);
+    if (record->command) {
+      // Time from the enqueue to the start on the device
+      fprintf(file,
+              ",\"args\":{\"wait_us\":%.3f}",
+              (record->start_ns - record->queued_ns) / 1e3);
+    }
+    fprintf(file, "}");
+  }
+  fprintf(file, "\n]}\n");
+  pthread_mutex_unlock(&trace_mutex);
+  return fclose(file) == 0;
+}
@@ -0,0 +1,74 @@
+#ifndef CLTRACE_H
+#define CLTRACE_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "clbench.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///
+//  Trace of a run in the Chrome trace event format (chrome://tracing,
+//  ui.perfetto.dev): host phases (device selection, context creation,
+//  program builds, buffer creation, transfers, verification...) on one track
+//  per host thread, and every profiled command on one track per queue,
+//  grouped by device. Device timestamps are moved to the host clock with an
+//  offset measured once per queue, with a marker, when its first command is
+//  recorded. Queues released through cltrace_release_queue give up their
+//  track: a new queue reusing the handle gets a track and offset of its own.
+//
+//  Recording does nothing until cltrace_config finds TRACE set; the file is
+//  written at exit.
+//
+//  Env vars:
+//  - TRACE: (str) file to write the trace (JSON) to
+//
+void
+cltrace_config(void);
+
+bool
+cltrace_enabled(void);
+
+///
+//  Host phase name from start_ns (now_ns clock) to now, on the track of the
+//  calling thread
+//
+void
+cltrace_phase(const char* name, double start_ns);
+
+///
+//  Completed command of a profiling queue, with its sample (clbench_sample
+//  records every command it samples). name NULL: its command type.
+//
+void
+cltrace_command(const char* name,
+                cl_event event,
+                const struct BenchSample* sample);
+
+///
+//  clReleaseCommandQueue, dropping the track of queue first if this is its
+//  last reference
+//
+cl_int CL_API_CALL
+cltrace_release_queue(cl_command_queue queue);
+
+///
+//  Write the trace recorded so far; false if path cannot be written
+//
+bool
+cltrace_write(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,392 @@
+#include "cltune.h"
+
+#include "clcache.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TUNE_RUNS_DEFAULT 3
+#define ITEMS_PER_CU_DEFAULT 256
+#define MAX_CANDIDATES 64
+
+bool
+cltune_config(struct LocalConfig* config)
+{
+  config->mode = LOCAL_DRIVER;
+  config->local = 0;
+  config->runs = TUNE_RUNS_DEFAULT;
+
+  char* runs_str = getenv("TUNE_RUNS");
+  if (runs_str != NULL && atoi(runs_str) > 0) {
+    config->runs = atoi(runs_str);
+  }
+
+  char* local_str = getenv("LOCAL");
+  if (local_str == NULL || strcmp(local_str, "DRIVER") == 0) {
+    return true;
+  }
+  if (strcmp(local_str, "AUTO") == 0) {
+    config->mode = LOCAL_AUTO;
+    return true;
+  }
+  if (atol(local_str) > 0) {
+    config->mode = LOCAL_FIXED;
+    config->local = atol(local_str);
+    return true;
+  }
+  return false;
+}
+
+const char*
+cltune_status_name(enum TuneStatus status)
+{
+  switch (status) {
+    case TUNE_NONE:
+      return "none";
+    case TUNE_SAVED:
+      return "saved";
+    case TUNE_TUNED:
+      return "tuned";
+  }
+  return "unknown";
+}
+
+int
+cltune_vector_width(cl_device_id device)
+{
+  char* width_str = getenv("WIDTH");
+  if (width_str != NULL && strcmp(width_str, "AUTO") != 0) {
+    int width = atoi(width_str);
+    if (width != 1 && width != 2 && width != 4 && width != 8 && width != 16) {
+      printf("not recognized vector width (AUTO|1|2|4|8|16)\n");
+      exit(1);
+    }
+    return width;
+  }
+
+  cl_uint preferred = 1, native = 1;
+  clGetDeviceInfo(device,
+                  CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT,
+                  sizeof(preferred),
+                  &preferred,
+                  NULL);
+  clGetDeviceInfo(device,
+                  CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT,
+                  sizeof(native),
+                  &native,
+                  NULL);
+  cl_uint device_width = preferred > native ? preferred : native;
+  int width = 1;
+  while (width < 16 && (cl_uint)width * 2 <= device_width) {
+    width *= 2;
+  }
+  printf("vector width: %d (preferred %u, native %u)\n",
+         width,
+         (unsigned int)preferred,
+         (unsigned int)native);
+  return width;
+}
+
+size_t
+cltune_grid_items(cl_device_id device, size_t n)
+{
+  size_t per_cu = ITEMS_PER_CU_DEFAULT;
+  char* per_cu_str = getenv("ITEMS_PER_CU");
+  if (per_cu_str != NULL && atol(per_cu_str) > 0) {
+    per_cu = atol(per_cu_str);
+  }
+  cl_uint units = 1;
+  clGetDeviceInfo(
+    device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(units), &units, NULL);
+  size_t items = units * per_cu;
+  printf("grid-stride: %lu work-items (%u compute units x %lu)\n",
+         (unsigned long)(items < n ? items : n),
+         (unsigned int)units,
+         (unsigned long)per_cu);
+  return items < n ? items : n;
+}
+
+static size_t
+round_up(size_t n, size_t multiple)
+{
+  return (n + multiple - 1) / multiple * multiple;
+}
+
+// Global size for a local size, or 0 if the kernel cannot run with it
+static size_t
+global_for(size_t n, size_t local, bool bounds)
+{
+  if (local == 0) {
+    return n;
+  }
+  if (n % local == 0) {
+    return n;
+  }
+  return bounds ? round_up(n, local) : 0;
+}
+
+// Sizes in the same bucket share a tuned choice: floor(log2(n))
+static int
+size_bucket(size_t n)
+{
+  int bucket = 0;
+  while (n > 1) {
+    n >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static void
+tune_path(cl_device_id device,
+          cl_kernel kernel,
+          const char* kernel_id,
+          size_t n,
+          char* path,
+          size_t path_len)
+{
+  char buffer[1024];
+  uint64_t hash = CLCACHE_HASH_SEED;
+
+  buffer[0] = '\0';
+  clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(buffer), buffer, NULL);
+  hash = clcache_hash(hash, buffer, strlen(buffer));
+  buffer[0] = '\0';
+  clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(buffer), buffer, NULL);
+  hash = clcache_hash(hash, buffer, strlen(buffer));
+  buffer[0] = '\0';
+  clGetKernelInfo(
+    kernel, CL_KERNEL_FUNCTION_NAME, sizeof(buffer), buffer, NULL);
+  hash = clcache_hash(hash, buffer, strlen(buffer));
+  hash = clcache_hash(hash, kernel_id, strlen(kernel_id));
+  int bucket = size_bucket(n);
+  hash = clcache_hash(hash, &bucket, sizeof(bucket));
+  snprintf(path,
+           path_len,
+           "%s/wg-%016llx.txt",
+           clcache_dir(),
+           (unsigned long long)hash);
+}
+
+// The driver choice is stored as "driver": a local size of 0 in a file is
+// as unreadable as no number at all
+static bool
+load_choice(const char* path, size_t* local)
+{
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) {
+    return false;
+  }
+  char word[32];
+  bool ok = fscanf(fp, "%31s", word) == 1;
+  fclose(fp);
+  if (!ok) {
+    return false;
+  }
+  if (strcmp(word, "driver") == 0) {
+    *local = 0;
+    return true;
+  }
+  char* end;
+  unsigned long value = strtoul(word, &end, 10);
+  if (*end != '\0' || value == 0) {
+    return false;
+  }
+  *local = value;
+  return true;
+}
+
+static bool
+store_choice(const char* path, size_t local)
+{
+  char buffer[32];
+  int len = local > 0 ? snprintf(buffer,
+                                 sizeof(buffer),
+                                 "%lu\n",
+                                 (unsigned long)local)
+                      : snprintf(buffer, sizeof(buffer), "driver\n");
+  return clcache_write_file(clcache_dir(), path, buffer, len);
+}
+
+// Best kernel time of config->runs launches (after one untimed launch)
+static cl_int
+time_launch(const struct LocalConfig* config,
+            cl_command_queue queue,
+            cl_kernel kernel,
+            size_t global,
+            size_t local,
+            double* best)
+{
+  *best = 0;
+  for (int run = 0; run <= config->runs; run++) {
+    cl_event event;
+    cl_int err = clEnqueueNDRangeKernel(queue,
+                                        kernel,
+                                        1,
+                                        NULL,
+                                        &global,
+                                        local > 0 ? &local : NULL,
+                                        0,
+                                        NULL,
+                                        &event);
+    if (err != CL_SUCCESS) {
+      return err;
+    }
+    err = clWaitForEvents(1, &event);
+    cl_ulong start = 0, end = 0;
+    err |= clGetEventProfilingInfo(
+      event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    err |= clGetEventProfilingInfo(
+      event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+    clReleaseEvent(event);
+    if (err != CL_SUCCESS) {
+      return err;
+    }
+    double elapsed = (double)(end - start);
+    if (run > 0 && (*best == 0 || elapsed < *best)) {
+      *best = elapsed;
+    }
+  }
+  return CL_SUCCESS;
+}
+
+static size_t
+candidates(cl_device_id device, cl_kernel kernel, size_t* sizes)
+{
+  size_t max_local = 0, kernel_max = 0, multiple = 1;
+  size_t item_sizes[3] = { 0, 0, 0 };
+  clGetDeviceInfo(device,
+                  CL_DEVICE_MAX_WORK_GROUP_SIZE,
+                  sizeof(max_local),
+                  &max_local,
+                  NULL);
+  clGetDeviceInfo(device,
+                  CL_DEVICE_MAX_WORK_ITEM_SIZES,
+                  sizeof(item_sizes),
+                  item_sizes,
+                  NULL);
+  clGetKernelWorkGroupInfo(kernel,
+                           device,
+                           CL_KERNEL_WORK_GROUP_SIZE,
+                           sizeof(kernel_max),
+                           &kernel_max,
+                           NULL);
+  clGetKernelWorkGroupInfo(kernel,
+                           device,
+                           CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+                           sizeof(multiple),
+                           &multiple,
+                           NULL);
+  if (kernel_max > 0 && kernel_max < max_local) {
+    max_local = kernel_max;
+  }
+  if (item_sizes[0] > 0 && item_sizes[0] < max_local) {
+    max_local = item_sizes[0];
+  }
+
+  size_t count = 0;
+  sizes[count++] = 0; // driver choice
+  for (size_t local = 1; local <= max_local && count < MAX_CANDIDATES;
+       local *= 2) {
+    sizes[count++] = local;
+  }
+  // Non power-of-two preferred multiples (e.g. 48 or 96)
+  if (multiple > 1 && (multiple & (multiple - 1)) != 0) {
+    for (size_t local = multiple; local <= max_local && count < MAX_CANDIDATES;
+         local *= 2) {
+      sizes[count++] = local;
+    }
+  }
+  return count;
+}
+
+cl_int
+cltune_select(const struct LocalConfig* config,
+              cl_command_queue queue,
+              cl_kernel kernel,
+              const char* kernel_id,
+              size_t n,
+              bool bounds,
+              size_t* global,
+              size_t* local,
+              enum TuneStatus* status)
+{
+  *status = TUNE_NONE;
+  *local = 0;
+  *global = n;
+  if (config->mode == LOCAL_DRIVER) {
+    return CL_SUCCESS;
+  }
+  if (config->mode == LOCAL_FIXED) {
+    if (global_for(n, config->local, bounds) == 0) {
+      fprintf(stderr,
+              "local %lu does not divide %lu and the kernel has no bounds "
+              "check: using the driver choice\n",
+              (unsigned long)config->local,
+              (unsigned long)n);
+      return CL_SUCCESS;
+    }
+    *local = config->local;
+    *global = global_for(n, *local, bounds);
+    return CL_SUCCESS;
+  }
+
+  cl_device_id device;
+  cl_int err = clGetCommandQueueInfo(
+    queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+  if (err != CL_SUCCESS) {
+    return err;
+  }
+
+  char path[4096];
+  tune_path(device, kernel, kernel_id, n, path, sizeof(path));
+  // A saved size over the kernel's limit (a corrupt or foreign file) would
+  // fail the launch: tune again instead
+  size_t saved, kernel_max = 0;
+  clGetKernelWorkGroupInfo(kernel,
+                           device,
+                           CL_KERNEL_WORK_GROUP_SIZE,
+                           sizeof(kernel_max),
+                           &kernel_max,
+                           NULL);
+  if (load_choice(path, &saved) && global_for(n, saved, bounds) != 0 &&
+      (kernel_max == 0 || saved <= kernel_max)) {
+    *status = TUNE_SAVED;
+    *local = saved;
+    *global = global_for(n, saved, bounds);
+    return CL_SUCCESS;
+  }
+
+  size_t sizes[MAX_CANDIDATES];
+  size_t count = candidates(device, kernel, sizes);
+  double best_time = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t candidate_global = global_for(n, sizes[i], bounds);
+    // Skip local sizes that do not fit, or would mostly launch padding
+    if (candidate_global == 0 || (sizes[i] > 1 && sizes[i] / 2 >= n)) {
+      continue;
+    }
+    double elapsed;
+    err = time_launch(
+      config, queue, kernel, candidate_global, sizes[i], &elapsed);
+    if (err != CL_SUCCESS) {
+      // Beyond a limit not reported by the queries: not a candidate
+      printf("tune local %lu: failed (%d)\n", (unsigned long)sizes[i], err);
+      continue;
+    }
+    printf("tune local %lu: %.0f ns\n", (unsigned long)sizes[i], elapsed);
+    if (best_time == 0 || elapsed < best_time) {
+      best_time = elapsed;
+      *local = sizes[i];
+      *global = candidate_global;
+    }
+  }
+
+  *status = TUNE_TUNED;
+  if (!store_choice(path, *local)) {
+    fprintf(stderr, "Failed to write work-group choice to %s\n", path);
+  }
+  return CL_SUCCESS;
+}
@@ -0,0 +1,103 @@
+#ifndef CLTUNE_H
+#define CLTUNE_H
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum LocalMode
+{
+  LOCAL_DRIVER, // NULL local work size: the driver chooses
+  LOCAL_FIXED,  // LOCAL=<n>
+  LOCAL_AUTO,   // autotuned, saved per (device, kernel, size bucket)
+};
+
+enum TuneStatus
+{
+  TUNE_NONE,  // driver or fixed choice, nothing tuned
+  TUNE_SAVED, // choice of an earlier run
+  TUNE_TUNED, // tuned by this run and saved
+};
+
+struct LocalConfig
+{
+  enum LocalMode mode;
+  size_t local; // LOCAL_FIXED size
+  int runs;     // timed launches per candidate when tuning
+};
+
+///
+//  Env vars:
+//  - LOCAL: (str) DRIVER|AUTO|<n> local work size (default DRIVER)
+//  - TUNE_RUNS: (int) timed launches per candidate size (default 3)
+//
+//  Returns false on an unknown LOCAL value.
+//
+bool
+cltune_config(struct LocalConfig* config);
+
+const char*
+cltune_status_name(enum TuneStatus status);
+
+///
+//  Elements per work-item of the vector (*.vec.cl) kernels: 1, 2, 4, 8 or 16.
+//
+//  Env var WIDTH: (str) AUTO|<n> (default AUTO: the larger of the device
+//  CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT and
+//  CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT, rounded down to a valid width).
+//  Exits on an invalid WIDTH.
+//
+int
+cltune_vector_width(cl_device_id device);
+
+///
+//  Work-items to launch for the grid-stride (*.gs.cl) kernels over n
+//  elements: the device compute units times a per-unit multiple, at most n.
+//
+//  Env var ITEMS_PER_CU: (int) work-items per compute unit (default 256)
+//
+size_t
+cltune_grid_items(cl_device_id device, size_t n);
+
+///
+//  Choose the local work size of a 1D launch of n work-items, and the global
+//  size to launch with it. *local is 0 when the driver should choose (pass
+//  NULL to clEnqueueNDRangeKernel).
+//
+//  With bounds set the kernel ignores work-items at or past n, so the global
+//  size is padded up to a multiple of the local size; otherwise only local
+//  sizes dividing n are valid and the others fall back to the driver choice.
+//
+//  In LOCAL_AUTO mode a choice saved for the same device, driver, kernel
+//  (kernel_id and function name) and power-of-two bucket of n is reused.
+//  Otherwise the kernel is launched, with its arguments as currently set,
+//  for the driver choice and every power of two up to the kernel maximum
+//  (plus the multiples of CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE that
+//  are not powers of two), and the fastest is saved in the cache directory
+//  (see clcache.h). The queue must have profiling enabled.
+//
+cl_int
+cltune_select(const struct LocalConfig* config,
+              cl_command_queue queue,
+              cl_kernel kernel,
+              const char* kernel_id,
+              size_t n,
+              bool bounds,
+              size_t* global,
+              size_t* local,
+              enum TuneStatus* status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,6 +1,10 @@
+// From clrt::kernel_preamble: N, DATA, LOAD and STORE
+
 __kernel void
-dmul(__global float* src, __global float* dst, float factor)
+dmul(__global DATA* src, __global DATA* dst, float factor, int n)
 {
   int i = get_global_id(0);
-  dst[i] += 2.0f * src[i];
+  if (i < N) {
+    STORE(LOAD(i, dst) + 2.0f * LOAD(i, src), i, dst);
+  }
 }
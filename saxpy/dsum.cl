@@ -1,6 +1,11 @@
+// From clrt::kernel_preamble: N, DATA, REAL, LOAD and STORE
+
 __kernel void
-dsum(__global float* src, __global float* dst, float factor)
+dsum(__global DATA* src, __global DATA* dst, float factor, int n)
 {
   int i = get_global_id(0);
-  dst[i] += src[i] + src[i];
+  if (i < N) {
+    REAL s = LOAD(i, src);
+    STORE(LOAD(i, dst) + (s + s), i, dst);
+  }
 }
@@ -0,0 +1,13 @@
+// From clrt::kernel_preamble: N, DATA, REAL, LOAD and STORE
+
+// Grid-stride loop: each work-item handles elements i, i + global size, ...
+// so the host can launch a few work-items per compute unit whatever n is
+__kernel void
+dsum(__global DATA* src, __global DATA* dst, float factor, int n)
+{
+  int stride = get_global_size(0);
+  for (int i = get_global_id(0); i < N; i += stride) {
+    REAL s = LOAD(i, src);
+    STORE(LOAD(i, dst) + (s + s), i, dst);
+  }
+}
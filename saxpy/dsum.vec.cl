@@ -0,0 +1,40 @@
+// From clrt::kernel_preamble: N, DATA, REAL, LOAD and STORE
+
+// Elements per work-item, set by the host (-DVW=<n>): 1, 2, 4, 8 or 16
+#ifndef VW
+#define VW 4
+#endif
+
+#define CAT_(a, b) a##b
+#define CAT(a, b) CAT_(a, b)
+
+#if VW == 1
+#define REALN REAL
+#define LOADN(i, p) LOAD(i, p)
+#define STOREN(v, i, p) STORE(v, i, p)
+#elif defined(DTYPE_F16)
+#define REALN CAT(float, VW)
+#define LOADN(i, p) CAT(vload_half, VW)(i, p)
+#define STOREN(v, i, p) CAT(vstore_half, VW)(v, i, p)
+#else
+#define REALN CAT(REAL, VW)
+#define LOADN(i, p) CAT(vload, VW)(i, p)
+#define STOREN(v, i, p) CAT(vstore, VW)(v, i, p)
+#endif
+
+// Work-item i handles elements [i * VW, (i + 1) * VW). The one straddling n
+// handles the n % VW remaining elements one at a time.
+__kernel void
+dsum(__global DATA* src, __global DATA* dst, float factor, int n)
+{
+  int i = get_global_id(0);
+  if ((i + 1) * VW <= N) {
+    REALN s = LOADN(i, src);
+    STOREN(LOADN(i, dst) + (s + s), i, dst);
+  } else {
+    for (int j = i * VW; j < N; j++) {
+      REAL s = LOAD(j, src);
+      STORE(LOAD(j, dst) + (s + s), j, dst);
+    }
+  }
+}
@@ -0,0 +1,94 @@
+// Two-stage minimum and maximum: minmax() scans a grid-stride slice of x per
+// work-item, reduces the work-group in local memory and writes one (min, max)
+// pair per work-group; minmax_final() reduces the pairs with a single
+// work-group. NaNs are ignored (fmin, fmax). The local size is a power of
+// two.
+//
+// Built with -DSUBGROUPS (devices with cl_khr_subgroups), each sub-group
+// reduces in registers and local memory holds one pair per sub-group.
+#ifdef SUBGROUPS
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#endif
+
+// The minimum and maximum of lo and hi over the work-group, in work-item 0
+void
+group_minmax(float* lo, float* hi, __local float* lo_s, __local float* hi_s)
+{
+#ifdef SUBGROUPS
+  float l = sub_group_reduce_min(*lo);
+  float h = sub_group_reduce_max(*hi);
+  if (get_sub_group_local_id() == 0) {
+    lo_s[get_sub_group_id()] = l;
+    hi_s[get_sub_group_id()] = h;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  l = INFINITY;
+  h = -INFINITY;
+  if (get_sub_group_id() == 0) {
+    for (uint i = get_sub_group_local_id(); i < get_num_sub_groups();
+         i += get_sub_group_size()) {
+      l = fmin(l, lo_s[i]);
+      h = fmax(h, hi_s[i]);
+    }
+    l = sub_group_reduce_min(l);
+    h = sub_group_reduce_max(h);
+  }
+  *lo = l;
+  *hi = h;
+#else
+  uint lid = get_local_id(0);
+  lo_s[lid] = *lo;
+  hi_s[lid] = *hi;
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (uint s = get_local_size(0) / 2; s > 0; s /= 2) {
+    if (lid < s) {
+      lo_s[lid] = fmin(lo_s[lid], lo_s[lid + s]);
+      hi_s[lid] = fmax(hi_s[lid], hi_s[lid + s]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+  *lo = lo_s[0];
+  *hi = hi_s[0];
+#endif
+}
+
+__kernel void
+minmax(__global const float* x,
+       __global float* partial,
+       int n,
+       __local float* lo_s,
+       __local float* hi_s)
+{
+  float lo = INFINITY;
+  float hi = -INFINITY;
+  for (int i = get_global_id(0); i < n; i += get_global_size(0)) {
+    lo = fmin(lo, x[i]);
+    hi = fmax(hi, x[i]);
+  }
+  group_minmax(&lo, &hi, lo_s, hi_s);
+  if (get_local_id(0) == 0) {
+    partial[2 * get_group_id(0)] = lo;
+    partial[2 * get_group_id(0) + 1] = hi;
+  }
+}
+
+// n pairs in partial
+__kernel void
+minmax_final(__global const float* partial,
+             __global float* out,
+             int n,
+             __local float* lo_s,
+             __local float* hi_s)
+{
+  float lo = INFINITY;
+  float hi = -INFINITY;
+  for (int i = get_local_id(0); i < n; i += get_local_size(0)) {
+    lo = fmin(lo, partial[2 * i]);
+    hi = fmax(hi, partial[2 * i + 1]);
+  }
+  group_minmax(&lo, &hi, lo_s, hi_s);
+  if (get_local_id(0) == 0) {
+    out[0] = lo;
+    out[1] = hi;
+  }
+}
@@ -1,6 +1,10 @@
+// From clrt::kernel_preamble: N, FACTOR, DATA, LOAD and STORE
+
 __kernel void
-saxpy(__global float* src, __global float* dst, float factor)
+saxpy(__global DATA* src, __global DATA* dst, float factor, int n)
 {
   int i = get_global_id(0);
-  dst[i] += src[i] * factor;
+  if (i < N) {
+    STORE(LOAD(i, dst) + LOAD(i, src) * FACTOR, i, dst);
+  }
 }
@@ -24,308 +24,2648 @@
 
 #include <CL/cl.h>
 
+#include "clbatch.h"
+#include "clbench.h"
+#include "clcache.h"
+#include "clcheck.h"
+#include "cldtype.h"
+#include "clhost.hpp"
+#include "clmem.h"
+#include "clmulti.h"
+#include "clrt.hpp"
+#include "clshm.h"
+#include "cltime.h"
+#include "cltrace.h"
+#include "cltune.h"
+
+#include <algorithm>
+#include <atomic>
 #include <errno.h>
-#include <fstream>
+#include <float.h>
 #include <iostream>
-#include <sstream>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 enum Operation
 {
   OP_SAXPY,
   OP_DSUM,
   OP_DMUL,
+  // Reductions and scan (ReduceMain)
+  OP_DOT,
+  OP_SUM,
+  OP_MINMAX,
+  OP_SCAN,
 };
 
+///
+//  Operation of a kernel file, by the prefix of its name
+//
+static const struct
+{
+  const char* name;
+  enum Operation op;
+} operations[] = {
+  { "saxpy", OP_SAXPY }, { "dsum", OP_DSUM }, { "dmul", OP_DMUL },
+  { "dot", OP_DOT },     { "sum", OP_SUM },   { "minmax", OP_MINMAX },
+  { "scan", OP_SCAN },
+};
+
+///
+//  Name of the operation of kernelfile (its kernel), NULL if none
+//
+static const char*
+ParseOperation(const char* kernelfile, enum Operation* op)
+{
+  for (size_t i = 0; i < sizeof(operations) / sizeof(operations[0]); i++) {
+    if (strncmp(kernelfile, operations[i].name, strlen(operations[i].name)) ==
+        0) {
+      *op = operations[i].op;
+      return operations[i].name;
+    }
+  }
+  return NULL;
+}
+
 enum Fill
 {
-  FILL_INDEX,
-  FILL_RAND,
+  FILL_INDEX,
+  FILL_RAND,
+};
+
+enum Transfer
+{
+  TRANSFER_ELEMENT,
+  TRANSFER_CHUNK,
+  TRANSFER_BULK,
+};
+
+///
+//  Fill the input vector with the indices or random data
+//
+void
+FillInput(float* arr, size_t vector_len, enum Fill fill)
+{
+  for (size_t i = 0; i < vector_len; i++) {
+    if (fill == FILL_INDEX) {
+      arr[i] = (float)i;
+    } else {
+      arr[i] = ((float)rand() / (float)(RAND_MAX)) * 100.0;
+    }
+  }
+}
+
+///
+//  Host reference for one element of the output
+//
+static inline float
+HostOp(enum Operation op, float src, float factor)
+{
+  if (op == OP_SAXPY) {
+    return src * factor;
+  } else if (op == OP_DSUM) {
+    return src + src;
+  }
+  return 2.0f * src;
+}
+
+///
+//  The same operation on the host engine
+//
+static enum clrt::HostOp
+HostEngineOp(enum Operation op)
+{
+  if (op == OP_SAXPY) {
+    return clrt::HOST_SAXPY;
+  } else if (op == OP_DSUM) {
+    return clrt::HOST_DSUM;
+  }
+  return clrt::HOST_DMUL;
+}
+
+///
+//  Everything a run needs besides the vector length: a SWEEP reuses it
+//  (context, queue, program and buffers) across sizes
+//
+struct SaxpyRun
+{
+  cl_device_id device;
+  cl_command_queue queue;
+  enum QueueMode queue_mode;
+  enum Operation op;
+  const char* operation;
+  enum MemoryMode memory;
+  enum Transfer transfer;
+  size_t chunk_len; // ignored by TRANSFER_BULK: one transfer per vector
+  enum Fill fill;
+  float factor;
+  enum DataType dtype; // of the buffers; the host side stays float
+  bool check_res;
+  clrt::HostEngine* host; // CHECK reference and HostTime
+  int iterations;
+  int warmup;
+  struct LocalConfig local_config;
+  struct ClBuffer input_buffer;
+  struct ClBuffer output_buffer;
+};
+
+///
+//  A kernel file built for the run. *.vec.cl kernels are built with
+//  -DVW=<width> and process width elements per work-item; *.gs.cl kernels
+//  loop over the vector with a grid stride.
+//
+struct SaxpyKernel
+{
+  clrt::Program program;
+  clrt::Kernel kernel;
+  const char* kernelfile;
+  char label[256]; // kernel file and build options, for the results
+  int width;
+  bool grid_stride;
+  bool bounds; // the kernel takes the vector length and can be padded
+};
+
+///
+//  Build kernelfile on context (through the program caches) and create its
+//  kernel, with the factor argument set. spec_len > 0: specialized for the
+//  factor and a vector length of spec_len, folded in with -D options (the
+//  program caches keep one build per parameter set). The element type of
+//  the run is a -D option too.
+//
+bool
+CreateSaxpyKernel(clrt::ProgramCache* programs,
+                  cl_context context,
+                  const struct SaxpyRun* run,
+                  const char* kernelfile,
+                  size_t spec_len,
+                  struct SaxpyKernel* kern)
+{
+  char options[160] = "";
+  size_t len = 0;
+  kern->kernelfile = kernelfile;
+  kern->width = 1;
+  kern->grid_stride = strstr(kernelfile, ".gs.") != NULL;
+  if (strstr(kernelfile, ".vec.") != NULL) {
+    kern->width = cltune_vector_width(run->device);
+    len = snprintf(options, sizeof(options), "-DVW=%d", kern->width);
+  }
+  if (spec_len > 0) {
+    len += snprintf(options + len,
+                    sizeof(options) - len,
+                    "%s-DSPEC_N=%lu",
+                    len > 0 ? " " : "",
+                    spec_len);
+    // %a: the exact factor, as a hexadecimal float literal
+    if (isfinite(run->factor)) {
+      len += snprintf(options + len,
+                      sizeof(options) - len,
+                      " -DSPEC_FACTOR=%af",
+                      (double)run->factor);
+    }
+  }
+  if (run->dtype != DTYPE_F32) {
+    snprintf(options + len,
+             sizeof(options) - len,
+             "%s%s",
+             len > 0 ? " " : "",
+             cldtype_option(run->dtype));
+  }
+  snprintf(kern->label,
+           sizeof(kern->label),
+           "%s%s%s",
+           kernelfile,
+           options[0] ? " " : "",
+           options);
+
+  std::cout << "Building program " << kern->label << "..." << std::endl;
+  enum CacheStatus cache_status;
+  double build_start = now_ns();
+  kern->program =
+    programs->get(context, run->device, kernelfile, options, &cache_status);
+  if (kern->program == NULL) {
+    return false;
+  }
+  printf("program build(ns):%lg (cache %s)\n",
+         now_ns() - build_start,
+         clcache_status_name(cache_status));
+
+  kern->kernel = clrt::create_kernel(kern->program, run->operation);
+  clrt::set_arg(kern->kernel, 2, run->factor);
+  cl_uint num_args;
+  CL_CHECK(clGetKernelInfo(
+    kern->kernel, CL_KERNEL_NUM_ARGS, sizeof(num_args), &num_args, NULL));
+  kern->bounds = num_args > 3;
+  return true;
+}
+
+///
+//  Fill the input at dst, stored as the run's element type. Returns the
+//  values the device sees as floats: dst itself for f32, view otherwise
+//  (rounded to half for f16, when checked). The conversion time is added to
+//  *convert_ns.
+//
+static float*
+FillStorage(const struct SaxpyRun* run,
+            void* dst,
+            float* view,
+            size_t vector_len,
+            double* convert_ns)
+{
+  if (run->dtype == DTYPE_F32) {
+    FillInput((float*)dst, vector_len, run->fill);
+    return (float*)dst;
+  }
+  FillInput(view, vector_len, run->fill);
+  double start = now_ns();
+  run->host->store(run->dtype, view, dst, vector_len);
+  *convert_ns += now_ns() - start;
+  if (run->dtype == DTYPE_F16 && run->check_res) {
+    run->host->load(run->dtype, dst, view, vector_len);
+  }
+  return view;
+}
+
+///
+//  The output at src as floats: src itself for f32, converted into view
+//  otherwise
+//
+static const float*
+LoadStorage(const struct SaxpyRun* run,
+            const void* src,
+            float* view,
+            size_t vector_len,
+            double* convert_ns)
+{
+  if (run->dtype == DTYPE_F32) {
+    return (const float*)src;
+  }
+  double start = now_ns();
+  run->host->load(run->dtype, src, view, vector_len);
+  *convert_ns += now_ns() - start;
+  return view;
+}
+
+///
+//  QUEUE=IN_ORDER|OUT_OF_ORDER: every iteration hands the input over again
+//  (in bulk, whatever TRANSFER), zeroes the output and runs the kernel as
+//  one event graph. The input write and the zero fill are independent; the
+//  kernel waits on both. samples gets the kernel of each iteration. view
+//  gets the input as floats when the run stores another type.
+//
+void
+RunGraph(struct SaxpyRun* run,
+         const struct SaxpyKernel* kern,
+         size_t vector_len,
+         size_t global_work_size,
+         size_t local_work_size,
+         float* view,
+         struct BenchSample* samples)
+{
+  cl_command_queue queue = run->queue;
+  struct BenchOverlap* graphs =
+    (struct BenchOverlap*)malloc(sizeof(struct BenchOverlap) * run->iterations);
+  double convert_ns = 0;
+  for (int i = 0; i < run->warmup + run->iterations; i++) {
+    void* arr1;
+    CL_CHECK(clbuf_map(
+      &run->input_buffer, queue, CL_MAP_WRITE_INVALIDATE_REGION, &arr1));
+    FillStorage(run, arr1, view, vector_len, &convert_ns);
+
+    // write src, zero dst, kernel
+    clrt::EventTimer events;
+    CL_CHECK(
+      clbuf_unmap_async(&run->input_buffer, queue, 0, NULL, events.next()));
+    CL_CHECK(clbuf_zero(&run->output_buffer, queue, 0, NULL, events.next()));
+    cl_event writes[2] = { events[0], events[1] };
+    CL_CHECK(clEnqueueNDRangeKernel(queue,
+                                    kern->kernel,
+                                    1,
+                                    NULL,
+                                    &global_work_size,
+                                    local_work_size > 0 ? &local_work_size
+                                                        : NULL,
+                                    2,
+                                    writes,
+                                    events.next()));
+
+    std::vector<struct BenchSample> commands;
+    events.collect(&commands);
+    if (i >= run->warmup) {
+      samples[i - run->warmup] = commands[2];
+      clbench_overlap(commands.data(), 3, &graphs[i - run->warmup]);
+    }
+  }
+  clbench_print_graph(graphs, run->iterations);
+  free(graphs);
+}
+
+///
+//  Verify dst against the host engine computing src, printing the first
+//  elements and the report (VERIFY_* tolerance)
+//
+void
+CheckOutput(const struct SaxpyRun* run,
+            const float* src,
+            const float* dst,
+            size_t vector_len)
+{
+  for (size_t i = 0; i < vector_len && i < 3; i++) {
+    float comp = HostOp(run->op, src[i], run->factor);
+    printf("[%ld] Host: %.6f  Device: %.6f\n", i, comp, dst[i]);
+  }
+  struct clrt::VerifyReport report;
+  run->host->verify(
+    HostEngineOp(run->op), src, NULL, run->factor, dst, vector_len, &report);
+  run->host->print_report(run->operation, &report);
+}
+
+///
+//  Write the input, run the kernel iterations, read back and check the
+//  result of one vector length. The buffers only grow. bench->samples is
+//  allocated here and owned by the caller.
+//
+void
+RunVector(struct SaxpyRun* run,
+          const struct SaxpyKernel* kern,
+          size_t vector_len,
+          struct BenchResult* bench)
+{
+  cl_command_queue queue = run->queue;
+  size_t chunk_len =
+    run->transfer == TRANSFER_BULK ? vector_len : run->chunk_len;
+  // Bytes per element in the buffers. Other types than float go through
+  // float views on the host.
+  size_t elem = cldtype_size(run->dtype);
+  bool convert = run->dtype != DTYPE_F32;
+  std::vector<float> src_view(convert ? vector_len : 0);
+  std::vector<float> dst_view(convert ? vector_len : 0);
+  double convert_ns = 0;
+
+  double alloc_start = now_ns();
+  CL_CHECK(clbuf_resize(&run->input_buffer, elem * vector_len));
+  CL_CHECK(clbuf_resize(&run->output_buffer, elem * vector_len));
+  double alloc_elapsed = now_ns() - alloc_start;
+  CL_CHECK(clbuf_set_arg(&run->input_buffer, kern->kernel, 0));
+  CL_CHECK(clbuf_set_arg(&run->output_buffer, kern->kernel, 1));
+  if (kern->bounds) {
+    cl_int n = vector_len;
+    CL_CHECK(clSetKernelArg(kern->kernel, 3, sizeof(n), &n));
+  }
+
+  printf("attempting to enqueue write buffer\n");
+  fflush(stdout);
+
+  double phase_start = now_ns();
+  float* arr1;
+  double write_elapsed;
+  if (run->memory == MEMORY_COPY) {
+    char* in = (char*)run->input_buffer.host;
+    arr1 = FillStorage(run, in, src_view.data(), vector_len, &convert_ns);
+
+    // One blocking write per chunk: chunk_len == 1 is the per-element stress
+    // test, chunk_len == vector_len a single bulk transfer.
+    double write_start = now_ns();
+    for (size_t i = 0; i < vector_len; i += chunk_len) {
+      size_t len = vector_len - i < chunk_len ? vector_len - i : chunk_len;
+      CL_CHECK(clEnqueueWriteBuffer(queue,
+                                    run->input_buffer.mem,
+                                    CL_TRUE,
+                                    i * elem,
+                                    len * elem,
+                                    in + i * elem,
+                                    0,
+                                    NULL,
+                                    NULL));
+    }
+    write_elapsed = now_ns() - write_start;
+  } else {
+    // Fill the input in place: only the map/unmap handoff is timed
+    double map_start = now_ns();
+    void* in;
+    CL_CHECK(clbuf_map(
+      &run->input_buffer, queue, CL_MAP_WRITE_INVALIDATE_REGION, &in));
+    write_elapsed = now_ns() - map_start;
+    arr1 = FillStorage(run, in, src_view.data(), vector_len, &convert_ns);
+    double unmap_start = now_ns();
+    CL_CHECK(clbuf_unmap(&run->input_buffer, queue));
+    write_elapsed += now_ns() - unmap_start;
+  }
+  cltrace_phase("write input", phase_start);
+
+  struct BenchSample* samples =
+    (struct BenchSample*)malloc(sizeof(struct BenchSample) * run->iterations);
+
+  size_t global_work_size[1];
+  size_t local_work_size[1];
+  enum TuneStatus tune_status;
+  // Vector kernels: one work-item per width elements, the last one also
+  // handling the remainder. Grid-stride kernels: a few per compute unit.
+  size_t items = kern->grid_stride
+                   ? cltune_grid_items(run->device, vector_len)
+                   : (vector_len + kern->width - 1) / kern->width;
+  CL_CHECK(cltune_select(&run->local_config,
+                         queue,
+                         kern->kernel,
+                         kern->label,
+                         items,
+                         kern->bounds,
+                         global_work_size,
+                         local_work_size,
+                         &tune_status));
+  printf("local work size: %ld (global %ld, tune %s)\n",
+         local_work_size[0],
+         global_work_size[0],
+         cltune_status_name(tune_status));
+
+  printf("attempting to enqueue kernel\n");
+  fflush(stdout);
+  phase_start = now_ns();
+  if (run->queue_mode != QUEUE_BLOCKING) {
+    RunGraph(run,
+             kern,
+             vector_len,
+             global_work_size[0],
+             local_work_size[0],
+             src_view.data(),
+             samples);
+  } else {
+    for (int i = 0; i < run->warmup + run->iterations; i++) {
+      clrt::Event kernel_completion;
+      // The kernels accumulate into dst: start every run from zero
+      CL_CHECK(clbuf_zero(&run->output_buffer, queue, 0, NULL, NULL));
+      CL_CHECK(clEnqueueNDRangeKernel(queue,
+                                      kern->kernel,
+                                      1,
+                                      NULL,
+                                      global_work_size,
+                                      local_work_size[0] > 0 ? local_work_size
+                                                             : NULL,
+                                      0,
+                                      NULL,
+                                      kernel_completion.out()));
+      cl_event wait_event = kernel_completion;
+      CL_CHECK(clWaitForEvents(1, &wait_event));
+      if (i >= run->warmup) {
+        CL_CHECK(clbench_sample(kernel_completion, &samples[i - run->warmup]));
+      }
+    }
+  }
+  cltrace_phase("kernels", phase_start);
+  printf("Enqueue'd kerenel\n");
+  fflush(stdout);
+
+  // Per element: read src and dst, write dst; one multiply/add and one add
+  clbench_result(bench,
+                 run->device,
+                 run->operation,
+                 kern->label,
+                 vector_len,
+                 3.0 * elem * vector_len,
+                 2.0 * vector_len,
+                 samples,
+                 run->iterations,
+                 run->warmup);
+  printf("time(ns):%lg\n", bench->exec.median);
+  printf("throughput %s: %.3f GB/s, %.3f Gelem/s\n",
+         cldtype_name(run->dtype),
+         bench->exec.median > 0 ? bench->bytes / bench->exec.median : 0,
+         bench->exec.median > 0 ? vector_len / bench->exec.median : 0);
+  if (run->iterations > 1) {
+    clbench_print(bench);
+  }
+
+  char* out;
+  double read_start = now_ns();
+  phase_start = read_start;
+  // Converted runs kept their input in src_view
+  bool remap_input = run->check_res && !convert;
+  if (run->memory == MEMORY_COPY) {
+    out = (char*)run->output_buffer.host;
+    for (size_t i = 0; i < vector_len; i += chunk_len) {
+      size_t len = vector_len - i < chunk_len ? vector_len - i : chunk_len;
+      CL_CHECK(clEnqueueReadBuffer(queue,
+                                   run->output_buffer.mem,
+                                   CL_TRUE,
+                                   i * elem,
+                                   len * elem,
+                                   out + i * elem,
+                                   0,
+                                   NULL,
+                                   NULL));
+    }
+  } else {
+    CL_CHECK(
+      clbuf_map(&run->output_buffer, queue, CL_MAP_READ, (void**)&out));
+    if (remap_input) {
+      // Not part of the timed read: the host needs the inputs back to check
+      double input_start = now_ns();
+      CL_CHECK(
+        clbuf_map(&run->input_buffer, queue, CL_MAP_READ, (void**)&arr1));
+      read_start += now_ns() - input_start;
+    }
+  }
+  double read_elapsed = now_ns() - read_start;
+  cltrace_phase("read output", phase_start);
+  const float* arr2 =
+    LoadStorage(run, out, dst_view.data(), vector_len, &convert_ns);
+  bench->write_ns = write_elapsed;
+  bench->read_ns = read_elapsed;
+  printf("alloc(ns):%lg\n", alloc_elapsed);
+  printf("transfer write(ns):%lg\n", write_elapsed);
+  printf("transfer read(ns):%lg\n", read_elapsed);
+  printf("transfer total(ns):%lg\n", write_elapsed + read_elapsed);
+  if (convert) {
+    printf("host convert(ns):%lg\n", convert_ns);
+  }
+
+  printf("Result:\n");
+  if (run->check_res) {
+    CheckOutput(run, arr1, arr2, vector_len);
+  }
+  printf("\n");
+
+  printf("computed %ld elements\n", vector_len);
+
+  if (run->memory != MEMORY_COPY) {
+    CL_CHECK(clbuf_unmap(&run->output_buffer, queue));
+    if (remap_input) {
+      CL_CHECK(clbuf_unmap(&run->input_buffer, queue));
+    }
+  }
+}
+
+///
+//  SPECIALIZE: RunVector with kernelfile specialized for vector_len
+//
+bool
+RunSpecialized(clrt::ProgramCache* programs,
+               cl_context context,
+               struct SaxpyRun* run,
+               const char* kernelfile,
+               size_t vector_len,
+               struct BenchResult* bench)
+{
+  struct SaxpyKernel spec;
+  if (!CreateSaxpyKernel(
+        programs, context, run, kernelfile, vector_len, &spec)) {
+    return false;
+  }
+  RunVector(run, &spec, vector_len, bench);
+  return true;
+}
+
+///
+//  MULTI_DEVICE: the settings, kernel and buffers of one device
+//
+struct MultiSlice
+{
+  struct SaxpyRun run; // the shared settings on the device's queue
+  struct SaxpyKernel kern;
+  clrt::Mem src;
+  clrt::Mem dst;
+  size_t capacity;   // elements the buffers hold
+  size_t global;     // work-items for a slice of global_len elements
+  size_t global_len;
+};
+
+///
+//  One pass over the vector: every device writes its slice of src, zeroes
+//  its dst, runs the kernel and reads its slice back, all of them enqueued
+//  before any is waited for. kernels[d] gets the kernel sample of device d
+//  and spans[d] its write start to read end. Returns the wall time.
+//
+double
+MultiPass(const struct MultiDevice* devs,
+          struct MultiSlice* slices,
+          size_t n_devs,
+          const float* src,
+          float* dst,
+          struct BenchSample* kernels,
+          struct BenchSample* spans)
+{
+  for (size_t d = 0; d < n_devs; d++) {
+    struct MultiSlice* s = &slices[d];
+    size_t len = devs[d].len;
+    if (len > s->capacity) {
+      s->src = clrt::Mem(CL_CHECK_ERR(clCreateBuffer(
+        devs[d].context, CL_MEM_READ_ONLY, sizeof(float) * len, NULL, &_err)));
+      s->dst = clrt::Mem(CL_CHECK_ERR(clCreateBuffer(
+        devs[d].context, CL_MEM_READ_WRITE, sizeof(float) * len, NULL, &_err)));
+      s->capacity = len;
+    }
+    if (len > 0 && len != s->global_len) {
+      s->global = s->kern.grid_stride
+                    ? cltune_grid_items(devs[d].device, len)
+                    : (len + s->kern.width - 1) / s->kern.width;
+      s->global_len = len;
+    }
+  }
+
+  // write src, zero dst, kernel, read dst per device
+  clrt::EventTimer events[CLMULTI_MAX_DEVICES];
+  double start = now_ns();
+  for (size_t d = 0; d < n_devs; d++) {
+    struct MultiSlice* s = &slices[d];
+    size_t offset = devs[d].offset;
+    size_t len = devs[d].len;
+    if (len == 0) {
+      continue;
+    }
+    clrt::set_arg(s->kern.kernel, 0, s->src.get());
+    clrt::set_arg(s->kern.kernel, 1, s->dst.get());
+    if (s->kern.bounds) {
+      clrt::set_arg(s->kern.kernel, 3, (cl_int)len);
+    }
+    CL_CHECK(clEnqueueWriteBuffer(devs[d].queue,
+                                  s->src,
+                                  CL_FALSE,
+                                  0,
+                                  sizeof(float) * len,
+                                  &src[offset],
+                                  0,
+                                  NULL,
+                                  events[d].next()));
+    const cl_uint zero = 0;
+    CL_CHECK(clEnqueueFillBuffer(devs[d].queue,
+                                 s->dst,
+                                 &zero,
+                                 sizeof(zero),
+                                 0,
+                                 sizeof(float) * len,
+                                 0,
+                                 NULL,
+                                 events[d].next()));
+    cl_event writes[2] = { events[d][0], events[d][1] };
+    CL_CHECK(clEnqueueNDRangeKernel(devs[d].queue,
+                                    s->kern.kernel,
+                                    1,
+                                    NULL,
+                                    &s->global,
+                                    NULL,
+                                    2,
+                                    writes,
+                                    events[d].next()));
+    cl_event kernel_event = events[d][2];
+    CL_CHECK(clEnqueueReadBuffer(devs[d].queue,
+                                 s->dst,
+                                 CL_FALSE,
+                                 0,
+                                 sizeof(float) * len,
+                                 &dst[offset],
+                                 1,
+                                 &kernel_event,
+                                 events[d].next()));
+    CL_CHECK(clFlush(devs[d].queue));
+  }
+  for (size_t d = 0; d < n_devs; d++) {
+    CL_CHECK(clFinish(devs[d].queue));
+  }
+  double wall = now_ns() - start;
+
+  for (size_t d = 0; d < n_devs; d++) {
+    memset(&kernels[d], 0, sizeof(kernels[d]));
+    memset(&spans[d], 0, sizeof(spans[d]));
+    if (devs[d].len == 0) {
+      continue;
+    }
+    std::vector<struct BenchSample> commands;
+    events[d].collect(&commands);
+    kernels[d] = commands[2];
+    spans[d] = commands[0];
+    spans[d].end = commands[3].end;
+  }
+  return wall;
+}
+
+///
+//  MULTI_DEVICE: split the vector across the devices, weighted by a
+//  calibration pass over calibrate_len elements, and run it ITERATIONS
+//  times. Device d builds its own kernel and gets results[d] (its slice and
+//  kernel times); the samples are allocated here and owned by the caller.
+//  Returns false if a kernel does not build.
+//
+bool
+RunMulti(const struct SaxpyRun* base,
+         struct MultiDevice* devs,
+         size_t n_devs,
+         const char* kernelfile,
+         size_t vector_len,
+         size_t calibrate_len,
+         struct BenchResult* results)
+{
+  // Devices of a platform share a context, and so the program built on it
+  clrt::ProgramCache programs;
+  std::vector<struct MultiSlice> slices(n_devs);
+  for (size_t d = 0; d < n_devs; d++) {
+    struct MultiSlice* s = &slices[d];
+    s->run = *base;
+    s->run.device = devs[d].device;
+    s->run.queue = devs[d].queue;
+    if (!CreateSaxpyKernel(
+          &programs, devs[d].context, &s->run, kernelfile, 0, &s->kern)) {
+      return false;
+    }
+  }
+
+  float* src = (float*)malloc(sizeof(float) * vector_len);
+  float* dst = (float*)malloc(sizeof(float) * vector_len);
+  FillInput(src, vector_len, base->fill);
+  struct BenchSample kernels[CLMULTI_MAX_DEVICES];
+  struct BenchSample spans[CLMULTI_MAX_DEVICES];
+  double elapsed[CLMULTI_MAX_DEVICES];
+
+  // The first pass also warms the devices up: weight by the second one
+  if (calibrate_len > 0) {
+    size_t len = calibrate_len < vector_len ? calibrate_len : vector_len;
+    clmulti_split(devs, n_devs, len);
+    for (int pass = 0; pass < 2; pass++) {
+      MultiPass(devs, slices.data(), n_devs, src, dst, kernels, spans);
+    }
+    for (size_t d = 0; d < n_devs; d++) {
+      elapsed[d] = (double)(spans[d].end - spans[d].start);
+    }
+    clmulti_reweight(devs, n_devs, elapsed);
+    printf("calibrated on %ld elements\n", len);
+  }
+  clmulti_split(devs, n_devs, vector_len);
+  clmulti_print_split(devs, n_devs);
+
+  struct BenchSample* samples[CLMULTI_MAX_DEVICES];
+  for (size_t d = 0; d < n_devs; d++) {
+    samples[d] = (struct BenchSample*)malloc(sizeof(struct BenchSample) *
+                                             base->iterations);
+  }
+  double best_wall = 0;
+  for (int i = 0; i < base->warmup + base->iterations; i++) {
+    double wall =
+      MultiPass(devs, slices.data(), n_devs, src, dst, kernels, spans);
+    if (i < base->warmup) {
+      continue;
+    }
+    for (size_t d = 0; d < n_devs; d++) {
+      samples[d][i - base->warmup] = kernels[d];
+    }
+    if (best_wall == 0 || wall < best_wall) {
+      best_wall = wall;
+    }
+  }
+
+  // Per element: read src and dst, write dst; one multiply/add and one add
+  for (size_t d = 0; d < n_devs; d++) {
+    size_t len = devs[d].len;
+    clbench_result(&results[d],
+                   devs[d].device,
+                   base->operation,
+                   slices[d].kern.label,
+                   len,
+                   3.0 * sizeof(float) * len,
+                   2.0 * len,
+                   samples[d],
+                   base->iterations,
+                   base->warmup);
+    // Last pass: the slice with its transfers, on the device clock
+    double span = (double)(spans[d].end - spans[d].start);
+    printf("device %ld: %s time(ns):%lg %.3f GB/s slice(ns):%lg %.3f GB/s\n",
+           d,
+           devs[d].name,
+           results[d].exec.median,
+           results[d].exec.median > 0
+             ? results[d].bytes / results[d].exec.median
+             : 0,
+           span,
+           span > 0 ? results[d].bytes / span : 0);
+  }
+  printf("multi wall(ns):%lg (best) throughput:%.3f GB/s\n",
+         best_wall,
+         best_wall > 0 ? 3.0 * sizeof(float) * vector_len / best_wall : 0);
+
+  if (base->check_res) {
+    CheckOutput(base, src, dst, vector_len);
+  }
+  printf("computed %ld elements\n", vector_len);
+
+  free(src);
+  free(dst);
+  return true;
+}
+
+///
+//  Env vars:
+//  - SCHEDULE: (str) STATIC|DYNAMIC (default STATIC)
+//  - SCHED_CHUNK: (int) elements per DYNAMIC chunk (default 262144)
+//  - SCHED_QUEUES: (int) queues (and host threads) per device (default 1)
+//
+struct SchedConfig
+{
+  bool dynamic;
+  size_t chunk_len;
+  int queues;
+};
+
+///
+//  SCHEDULE=DYNAMIC: one host thread per queue, each running whole chunks
+//  (write src, zero dst, kernel over the chunk, blocking read) on
+//  chunk-sized buffers of its own: memory objects changed from several
+//  queues without synchronization are undefined, even over disjoint ranges
+//
+struct SchedWorker
+{
+  const struct MultiDevice* dev;
+  const struct SaxpyKernel* kern; // the device build
+  clrt::Queue queue;
+  clrt::Kernel kernel; // own kernel object: arguments are per worker
+  clrt::Mem src;       // the worker's own, one chunk long
+  clrt::Mem dst;
+  size_t items;       // grid-stride work-items of a full chunk
+  size_t first_chunk; // static split: [first_chunk, last_chunk)
+  size_t last_chunk;
+  size_t chunks; // run in the last pass
+  size_t elements;
+  double busy_ns; // summed over its chunks, enqueue to read back
+};
+
+struct SchedPass
+{
+  bool dynamic;
+  size_t vector_len;
+  size_t chunk_len;
+  size_t n_chunks;
+  const float* src;
+  float* dst;
+  std::atomic<size_t> next; // DYNAMIC: next chunk to hand out
+};
+
+void
+SchedWork(struct SchedPass* pass, struct SchedWorker* w)
+{
+  w->chunks = 0;
+  w->elements = 0;
+  w->busy_ns = 0;
+  size_t static_next = w->first_chunk;
+  for (;;) {
+    size_t chunk;
+    if (pass->dynamic) {
+      chunk = pass->next.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      chunk = static_next < w->last_chunk ? static_next++ : pass->n_chunks;
+    }
+    if (chunk >= pass->n_chunks) {
+      break;
+    }
+    size_t start = chunk * pass->chunk_len;
+    size_t len = pass->vector_len - start < pass->chunk_len
+                   ? pass->vector_len - start
+                   : pass->chunk_len;
+    // The chunk sits at the start of the worker buffers; the kernels stop
+    // at n: its length
+    double chunk_start = now_ns();
+    clrt::set_arg(w->kernel, 3, (cl_int)len);
+    size_t global = w->kern->grid_stride
+                      ? (len < w->items ? len : w->items)
+                      : (len + w->kern->width - 1) / w->kern->width;
+    const cl_uint zero = 0;
+    CL_CHECK(clEnqueueWriteBuffer(w->queue,
+                                  w->src,
+                                  CL_FALSE,
+                                  0,
+                                  sizeof(float) * len,
+                                  &pass->src[start],
+                                  0,
+                                  NULL,
+                                  NULL));
+    CL_CHECK(clEnqueueFillBuffer(w->queue,
+                                 w->dst,
+                                 &zero,
+                                 sizeof(zero),
+                                 0,
+                                 sizeof(float) * len,
+                                 0,
+                                 NULL,
+                                 NULL));
+    CL_CHECK(clEnqueueNDRangeKernel(
+      w->queue, w->kernel, 1, NULL, &global, NULL, 0, NULL, NULL));
+    CL_CHECK(clEnqueueReadBuffer(w->queue,
+                                 w->dst,
+                                 CL_TRUE,
+                                 0,
+                                 sizeof(float) * len,
+                                 &pass->dst[start],
+                                 0,
+                                 NULL,
+                                 NULL));
+    w->busy_ns += now_ns() - chunk_start;
+    cltrace_phase("chunk", chunk_start);
+    w->chunks++;
+    w->elements += len;
+  }
+}
+
+///
+//  Run every chunk once, handed out dynamically or by the static split.
+//  Returns the wall time.
+//
+double
+SchedRun(struct SchedPass* pass, struct SchedWorker* workers, size_t n_workers)
+{
+  std::vector<std::thread> threads;
+  pass->next.store(0);
+  double start = now_ns();
+  for (size_t i = 0; i < n_workers; i++) {
+    threads.push_back(std::thread(SchedWork, pass, &workers[i]));
+  }
+  for (size_t i = 0; i < n_workers; i++) {
+    threads[i].join();
+  }
+  return now_ns() - start;
+}
+
+///
+//  Per-worker chunks and busy time of the last pass, and the imbalance:
+//  the longest busy time over the mean, minus one
+//
+void
+SchedPrint(const char* name,
+           const struct SchedWorker* workers,
+           size_t n_workers,
+           double wall_ns,
+           size_t vector_len)
+{
+  double sum = 0, longest = 0;
+  for (size_t i = 0; i < n_workers; i++) {
+    printf("%s worker %ld: %s chunks %ld elements %ld busy(ns):%lg\n",
+           name,
+           i,
+           workers[i].dev->name,
+           workers[i].chunks,
+           workers[i].elements,
+           workers[i].busy_ns);
+    sum += workers[i].busy_ns;
+    if (workers[i].busy_ns > longest) {
+      longest = workers[i].busy_ns;
+    }
+  }
+  double mean = n_workers > 0 ? sum / n_workers : 0;
+  printf("%s wall(ns):%lg (best) throughput:%.3f GB/s imbalance:%.1f%%\n",
+         name,
+         wall_ns,
+         wall_ns > 0 ? 3.0 * sizeof(float) * vector_len / wall_ns : 0,
+         mean > 0 ? 100.0 * (longest / mean - 1) : 0);
+}
+
+///
+//  SCHEDULE=DYNAMIC: SCHED_QUEUES workers per device pull SCHED_CHUNK
+//  element chunks from a shared atomic index, ITERATIONS times; then the
+//  same chunks are split statically (by the device weights, evenly among
+//  the queues of a device) for comparison. Returns false if a kernel does
+//  not build.
+//
+bool
+RunSchedule(const struct SaxpyRun* base,
+            struct MultiDevice* devs,
+            size_t n_devs,
+            const char* kernelfile,
+            size_t vector_len,
+            size_t chunk_len,
+            int queues)
+{
+  clrt::ProgramCache programs;
+  struct SaxpyKernel kerns[CLMULTI_MAX_DEVICES];
+  for (size_t d = 0; d < n_devs; d++) {
+    struct SaxpyRun run = *base;
+    run.device = devs[d].device;
+    run.queue = devs[d].queue;
+    if (!CreateSaxpyKernel(
+          &programs, devs[d].context, &run, kernelfile, 0, &kerns[d])) {
+      return false;
+    }
+    if (!kerns[d].bounds) {
+      printf("%s has no vector length argument to bound the chunks\n",
+             kernelfile);
+      return false;
+    }
+    // Chunks start on a work-item of the vector kernels
+    if (chunk_len % kerns[d].width != 0) {
+      chunk_len += kerns[d].width - chunk_len % kerns[d].width;
+    }
+  }
+
+  struct SchedPass pass;
+  pass.vector_len = vector_len;
+  pass.chunk_len = chunk_len;
+  pass.n_chunks = (vector_len + chunk_len - 1) / chunk_len;
+  float* src = (float*)malloc(sizeof(float) * vector_len);
+  float* dst = (float*)malloc(sizeof(float) * vector_len);
+  FillInput(src, vector_len, base->fill);
+  pass.src = src;
+  pass.dst = dst;
+  printf("schedule: %ld chunks of %ld elements, %d queue(s) per device\n",
+         pass.n_chunks,
+         chunk_len,
+         queues);
+
+  size_t n_workers = n_devs * queues;
+  std::vector<struct SchedWorker> workers(n_workers);
+  size_t buf_len = chunk_len < vector_len ? chunk_len : vector_len;
+  double cumulative = 0;
+  for (size_t d = 0; d < n_devs; d++) {
+    size_t items = cltune_grid_items(devs[d].device, chunk_len);
+    for (int q = 0; q < queues; q++) {
+      struct SchedWorker* w = &workers[d * queues + q];
+      w->dev = &devs[d];
+      w->kern = &kerns[d];
+      w->queue = clrt::Queue(CL_CHECK_ERR(clCreateCommandQueueWithProperties(
+        devs[d].context, devs[d].device, NULL, &_err)));
+      w->kernel = clrt::create_kernel(kerns[d].program, base->operation);
+      w->src = clrt::Mem(CL_CHECK_ERR(clCreateBuffer(devs[d].context,
+                                                     CL_MEM_READ_ONLY,
+                                                     sizeof(float) * buf_len,
+                                                     NULL,
+                                                     &_err)));
+      w->dst = clrt::Mem(CL_CHECK_ERR(clCreateBuffer(devs[d].context,
+                                                     CL_MEM_READ_WRITE,
+                                                     sizeof(float) * buf_len,
+                                                     NULL,
+                                                     &_err)));
+      clrt::set_arg(w->kernel, 0, w->src.get());
+      clrt::set_arg(w->kernel, 1, w->dst.get());
+      clrt::set_arg(w->kernel, 2, base->factor);
+      w->items = items;
+      // Static split: the device weight, evenly among its queues
+      w->first_chunk = (size_t)(cumulative * pass.n_chunks + 0.5);
+      cumulative += devs[d].weight / queues;
+      w->last_chunk = d + 1 == n_devs && q + 1 == queues
+                        ? pass.n_chunks
+                        : (size_t)(cumulative * pass.n_chunks + 0.5);
+    }
+  }
+
+  // Dynamic first, then static; the best wall time of each
+  double best[2] = { 0, 0 };
+  const char* names[2] = { "dynamic", "static" };
+  for (int mode = 0; mode < 2; mode++) {
+    pass.dynamic = mode == 0;
+    for (int i = 0; i < base->warmup + base->iterations; i++) {
+      double wall = SchedRun(&pass, workers.data(), n_workers);
+      if (i >= base->warmup && (best[mode] == 0 || wall < best[mode])) {
+        best[mode] = wall;
+      }
+    }
+    SchedPrint(
+      names[mode], workers.data(), n_workers, best[mode], vector_len);
+    if (base->check_res) {
+      CheckOutput(base, src, dst, vector_len);
+    }
+  }
+  printf("dynamic speedup over static: %.3fx\n",
+         best[0] > 0 ? best[1] / best[0] : 0);
+  printf("computed %ld elements\n", vector_len);
+
+  free(src);
+  free(dst);
+  return true;
+}
+
+///
+//  MULTI_DEVICE: run VECTOR across the devices and report each of them
+//
+int
+MultiMain(enum MultiMode mode,
+          int platform_id,
+          int device_id,
+          const struct SaxpyRun* base,
+          const char* kernelfile,
+          size_t vector_len,
+          size_t calibrate_len,
+          const struct SchedConfig* sched)
+{
+  printf("multi-device: %s\n", clmulti_mode_name(mode));
+  if (getenv("SWEEP") != NULL || getenv("BASELINE") != NULL ||
+      getenv("SPECIALIZE") != NULL || getenv("DTYPE") != NULL) {
+    printf("multi-device: SWEEP, BASELINE, SPECIALIZE and DTYPE are "
+           "ignored\n");
+  }
+  struct MultiDevice devs[CLMULTI_MAX_DEVICES];
+  size_t n_devs = clmulti_open(
+    mode, platform_id, device_id, devs, CLMULTI_MAX_DEVICES);
+  if (n_devs == 0) {
+    fprintf(stderr, "No device to run on\n");
+    return 1;
+  }
+
+  if (sched->dynamic) {
+    bool ok = RunSchedule(base,
+                          devs,
+                          n_devs,
+                          kernelfile,
+                          vector_len,
+                          sched->chunk_len,
+                          sched->queues);
+    clmulti_release(devs, n_devs);
+    return ok ? 0 : 1;
+  }
+
+  struct BenchResult results[CLMULTI_MAX_DEVICES];
+  if (!RunMulti(
+        base, devs, n_devs, kernelfile, vector_len, calibrate_len, results)) {
+    clmulti_release(devs, n_devs);
+    return 1;
+  }
+
+  char* bench_out = getenv("BENCH_OUT");
+  if (bench_out != NULL && !clbench_write(bench_out, results, n_devs)) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", bench_out);
+  }
+  for (size_t d = 0; d < n_devs; d++) {
+    free((void*)results[d].samples);
+  }
+  clmulti_release(devs, n_devs);
+  return 0;
+}
+
+#define PIPE_MAX_STAGES 16
+
+///
+//  One element-wise operation of a PIPELINE: the OpenCL C expression of the
+//  new x, from x, b[i] and factor
+//
+struct PipeStage
+{
+  enum clrt::HostOp op; // the host reference
+  const char* name;
+  const char* expr;
+  bool binary; // reads the second input vector b
+};
+
+static const struct PipeStage pipe_stages[] = {
+  { clrt::HOST_SAXPY, "saxpy", "x * factor", false },
+  { clrt::HOST_DSUM, "dsum", "x + x", false },
+  { clrt::HOST_DMUL, "dmul", "2.0f * x", false },
+  { clrt::HOST_VECADD, "vecadd", "x + b[i]", true },
+  { clrt::HOST_VECMUL, "vecmul", "x * b[i]", true },
+};
+
+///
+//  Parse a comma-separated list of stage names into stages. Returns the
+//  number of stages, 0 on an unknown name or too many stages.
+//
+size_t
+ParsePipeline(const char* spec, const struct PipeStage** stages)
+{
+  size_t n = 0;
+  const char* p = spec;
+  while (*p != '\0') {
+    size_t len = strcspn(p, ",");
+    const struct PipeStage* found = NULL;
+    for (size_t k = 0; k < sizeof(pipe_stages) / sizeof(pipe_stages[0]); k++) {
+      if (strlen(pipe_stages[k].name) == len &&
+          strncmp(pipe_stages[k].name, p, len) == 0) {
+        found = &pipe_stages[k];
+      }
+    }
+    if (found == NULL || n == PIPE_MAX_STAGES) {
+      return 0;
+    }
+    stages[n++] = found;
+    p += len;
+    if (*p == ',') {
+      p++;
+    }
+  }
+  return n;
+}
+
+// Append a kernel applying stages in turn: dst = stages(src)
+static void
+AppendPipeKernel(std::string* source,
+                 const char* name,
+                 const struct PipeStage* const* stages,
+                 size_t n_stages)
+{
+  *source += std::string("__kernel void\n") + name +
+             "(__global const float* src,\n"
+             "  __global const float* b,\n"
+             "  __global float* dst,\n"
+             "  float factor,\n"
+             "  int n)\n"
+             "{\n"
+             "  int i = get_global_id(0);\n"
+             "  if (i < n) {\n"
+             "    float x = src[i];\n";
+  for (size_t k = 0; k < n_stages; k++) {
+    *source += std::string("    x = ") + stages[k]->expr + ";\n";
+  }
+  *source += "    dst[i] = x;\n"
+             "  }\n"
+             "}\n";
+}
+
+///
+//  OpenCL source with a kernel per stage (pipe_<k>) and pipe_fused applying
+//  every stage in one pass. Contraction is off, so the fused chain rounds
+//  like the separate kernels and the host.
+//
+std::string
+PipelineSource(const struct PipeStage** stages, size_t n_stages)
+{
+  std::string source = "#pragma OPENCL FP_CONTRACT OFF\n";
+  char name[32];
+  for (size_t k = 0; k < n_stages; k++) {
+    snprintf(name, sizeof(name), "pipe_%lu", (unsigned long)k);
+    AppendPipeKernel(&source, name, &stages[k], 1);
+  }
+  AppendPipeKernel(&source, "pipe_fused", stages, n_stages);
+  return source;
+}
+
+enum PipeMode
+{
+  PIPE_SEPARATE, // every stage its own write, kernel and read
+  PIPE_CHAINED,  // one write and read, the stages on device buffers
+  PIPE_FUSED,    // one write, one kernel, one read
+};
+
+///
+//  The buffers and kernels of a pipeline on one queue
+//
+struct Pipeline
+{
+  const struct PipeStage** stages;
+  size_t n_stages;
+  bool binary; // some stage reads b
+  cl_command_queue queue;
+  clrt::Kernel kernels[PIPE_MAX_STAGES];
+  clrt::Kernel fused;
+  clrt::Mem in, b, tmp[2];
+  size_t len;
+};
+
+static void
+PipeKernel(struct Pipeline* pipe,
+           cl_kernel kernel,
+           cl_mem src,
+           cl_mem dst,
+           float factor,
+           clrt::EventTimer* events)
+{
+  size_t global = pipe->len;
+  clrt::set_arg(kernel, 0, src);
+  clrt::set_arg(kernel, 1, pipe->b.get());
+  clrt::set_arg(kernel, 2, dst);
+  clrt::set_arg(kernel, 3, factor);
+  clrt::set_arg(kernel, 4, (cl_int)pipe->len);
+  CL_CHECK(clEnqueueNDRangeKernel(
+    pipe->queue, kernel, 1, NULL, &global, NULL, 0, NULL, events->next()));
+}
+
+///
+//  One pass of the pipeline over x (in place) with b as the second input.
+//  Blocking; events gets the kernels.
+//
+static void
+PipePass(struct Pipeline* pipe,
+         enum PipeMode mode,
+         float* x,
+         const float* b,
+         float factor,
+         clrt::EventTimer* events)
+{
+  size_t bytes = sizeof(float) * pipe->len;
+  cl_command_queue queue = pipe->queue;
+  if (mode == PIPE_SEPARATE) {
+    for (size_t k = 0; k < pipe->n_stages; k++) {
+      CL_CHECK(clEnqueueWriteBuffer(
+        queue, pipe->in, CL_FALSE, 0, bytes, x, 0, NULL, NULL));
+      if (pipe->stages[k]->binary) {
+        CL_CHECK(clEnqueueWriteBuffer(
+          queue, pipe->b, CL_FALSE, 0, bytes, b, 0, NULL, NULL));
+      }
+      PipeKernel(
+        pipe, pipe->kernels[k], pipe->in, pipe->tmp[0], factor, events);
+      CL_CHECK(clEnqueueReadBuffer(
+        queue, pipe->tmp[0], CL_TRUE, 0, bytes, x, 0, NULL, NULL));
+    }
+    return;
+  }
+
+  CL_CHECK(clEnqueueWriteBuffer(
+    queue, pipe->in, CL_FALSE, 0, bytes, x, 0, NULL, NULL));
+  if (pipe->binary) {
+    CL_CHECK(clEnqueueWriteBuffer(
+      queue, pipe->b, CL_FALSE, 0, bytes, b, 0, NULL, NULL));
+  }
+  cl_mem out = pipe->tmp[0];
+  if (mode == PIPE_FUSED) {
+    PipeKernel(pipe, pipe->fused, pipe->in, out, factor, events);
+  } else {
+    // Ping-pong between the temporaries: stage k writes tmp[k % 2]
+    for (size_t k = 0; k < pipe->n_stages; k++) {
+      cl_mem src = k == 0 ? pipe->in.get() : pipe->tmp[(k - 1) % 2].get();
+      out = pipe->tmp[k % 2];
+      PipeKernel(pipe, pipe->kernels[k], src, out, factor, events);
+    }
+  }
+  CL_CHECK(
+    clEnqueueReadBuffer(queue, out, CL_TRUE, 0, bytes, x, 0, NULL, NULL));
+}
+
+///
+//  PIPELINE: run the stages over VECTOR elements separately (a host round
+//  trip per stage, like one process per operation), chained on device
+//  buffers, and as one generated fused kernel; ITERATIONS times each.
+//  Prints the best wall time, the kernel time and the modelled device
+//  memory traffic of each mode. Returns false if the source does not build.
+//
+bool
+RunPipeline(clrt::Runtime* rt,
+            clrt::HostEngine* host,
+            const struct PipeStage** stages,
+            size_t n_stages,
+            size_t vector_len,
+            enum Fill fill,
+            float factor,
+            bool check_res,
+            int iterations,
+            int warmup)
+{
+  std::string source = PipelineSource(stages, n_stages);
+  enum CacheStatus cache_status;
+  double build_start = now_ns();
+  clrt::Program program(clcache_program(rt->context(),
+                                        rt->device(),
+                                        source.c_str(),
+                                        source.size(),
+                                        "",
+                                        &cache_status));
+  if (program == NULL) {
+    return false;
+  }
+  printf("program build(ns):%lg (cache %s)\n",
+         now_ns() - build_start,
+         clcache_status_name(cache_status));
+
+  struct Pipeline pipe;
+  pipe.stages = stages;
+  pipe.n_stages = n_stages;
+  pipe.binary = false;
+  pipe.queue = rt->queue();
+  pipe.len = vector_len;
+  char name[32];
+  for (size_t k = 0; k < n_stages; k++) {
+    snprintf(name, sizeof(name), "pipe_%lu", (unsigned long)k);
+    pipe.kernels[k] = clrt::create_kernel(program, name);
+    pipe.binary = pipe.binary || stages[k]->binary;
+  }
+  pipe.fused = clrt::create_kernel(program, "pipe_fused");
+  size_t bytes = sizeof(float) * vector_len;
+  pipe.in = rt->pool().acquire(CL_MEM_READ_ONLY, bytes);
+  pipe.b = rt->pool().acquire(CL_MEM_READ_ONLY, bytes);
+  pipe.tmp[0] = rt->pool().acquire(CL_MEM_READ_WRITE, bytes);
+  pipe.tmp[1] = rt->pool().acquire(CL_MEM_READ_WRITE, bytes);
+
+  std::vector<float> src(vector_len), b(vector_len);
+  FillInput(src.data(), vector_len, fill);
+  FillInput(b.data(), vector_len, fill);
+  // Input of the last stage on the host: the outputs are checked against
+  // the host engine running that stage on it
+  std::vector<float> ref = src;
+  for (size_t k = 0; k + 1 < n_stages; k++) {
+    host->compute(stages[k]->op,
+                  ref.data(),
+                  b.data(),
+                  factor,
+                  ref.data(),
+                  vector_len);
+  }
+  const struct PipeStage* last = stages[n_stages - 1];
+
+  // Device memory traffic per element, in vectors: every kernel reads its
+  // input (and b) and writes its output
+  size_t stage_vectors = 0;
+  for (size_t k = 0; k < n_stages; k++) {
+    stage_vectors += stages[k]->binary ? 3 : 2;
+  }
+  size_t fused_vectors = pipe.binary ? 3 : 2;
+
+  const char* names[3] = { "separate", "chained", "fused" };
+  double best[3] = { 0, 0, 0 };
+  std::vector<float> x(vector_len);
+  for (int mode = PIPE_SEPARATE; mode <= PIPE_FUSED; mode++) {
+    double kernel_ns = 0;
+    for (int i = 0; i < warmup + iterations; i++) {
+      x = src;
+      clrt::EventTimer events;
+      double start = now_ns();
+      PipePass(&pipe, (enum PipeMode)mode, x.data(), b.data(), factor, &events);
+      double wall = now_ns() - start;
+      if (i < warmup) {
+        continue;
+      }
+      if (best[mode] == 0 || wall < best[mode]) {
+        best[mode] = wall;
+        std::vector<struct BenchSample> samples;
+        events.collect(&samples);
+        kernel_ns = 0;
+        for (size_t k = 0; k < samples.size(); k++) {
+          kernel_ns += (double)(samples[k].end - samples[k].start);
+        }
+      }
+    }
+    size_t vectors = mode == PIPE_FUSED ? fused_vectors : stage_vectors;
+    double traffic = (double)sizeof(float) * vector_len * vectors;
+    printf("pipeline %s wall(ns):%lg (best) kernel(ns):%lg "
+           "traffic(bytes):%.0f %.3f GB/s\n",
+           names[mode],
+           best[mode],
+           kernel_ns,
+           traffic,
+           kernel_ns > 0 ? traffic / kernel_ns : 0);
+
+    if (check_res) {
+      struct clrt::VerifyReport report;
+      host->verify(last->op,
+                   ref.data(),
+                   b.data(),
+                   factor,
+                   x.data(),
+                   vector_len,
+                   &report);
+      host->print_report(names[mode], &report);
+    }
+  }
+  printf("fused speedup: %.3fx over separate, %.3fx over chained "
+         "(traffic %.1fx less)\n",
+         best[PIPE_FUSED] > 0 ? best[PIPE_SEPARATE] / best[PIPE_FUSED] : 0,
+         best[PIPE_FUSED] > 0 ? best[PIPE_CHAINED] / best[PIPE_FUSED] : 0,
+         (double)stage_vectors / fused_vectors);
+  printf("computed %ld elements\n", vector_len);
+
+  rt->pool().release(pipe.in);
+  rt->pool().release(pipe.b);
+  rt->pool().release(pipe.tmp[0]);
+  rt->pool().release(pipe.tmp[1]);
+  return true;
+}
+
+///
+//  PIPELINE: run the stages of spec on one device
+//
+int
+PipelineMain(const char* spec,
+             clrt::HostEngine* host,
+             int platform_id,
+             int device_id,
+             size_t vector_len,
+             enum Fill fill,
+             float factor,
+             bool check_res)
+{
+  const struct PipeStage* stages[PIPE_MAX_STAGES];
+  size_t n_stages = ParsePipeline(spec, stages);
+  if (n_stages == 0) {
+    printf("not recognized pipeline (saxpy|dsum|dmul|vecadd|vecmul,...)\n");
+    return 1;
+  }
+  printf("pipeline:");
+  for (size_t k = 0; k < n_stages; k++) {
+    printf("%s%s", k > 0 ? " -> " : " ", stages[k]->name);
+  }
+  printf(" (%ld stages)\n", n_stages);
+
+  cl_device_id device = clrt::select_device(platform_id, device_id, false);
+  if (device == NULL) {
+    fprintf(stderr, "No device to run on\n");
+    return 1;
+  }
+  size_t pool_arena;
+  int pool_bench;
+  clrt::pool_config(&pool_arena, &pool_bench);
+  // The writes, kernels and reads of a pass follow each other on an
+  // in-order queue
+  enum QueueMode queue_mode = QUEUE_BLOCKING;
+  clrt::Runtime rt(device, &queue_mode, pool_arena);
+  int iterations, warmup;
+  clbench_config(&iterations, &warmup);
+  if (!RunPipeline(&rt,
+                   host,
+                   stages,
+                   n_stages,
+                   vector_len,
+                   fill,
+                   factor,
+                   check_res,
+                   iterations,
+                   warmup)) {
+    return 1;
+  }
+  return host->failures() > 0 ? 1 : 0;
+}
+
+///
+//  Time the host engine computing the same vector, to find where offloading
+//  pays off. Best of the same number of iterations as the kernel.
+//
+double
+HostTime(const struct SaxpyRun* run, size_t vector_len)
+{
+  std::vector<float> src(vector_len), dst(vector_len);
+  FillInput(src.data(), vector_len, run->fill);
+  std::vector<struct BenchSample> samples;
+  run->host->bench(HostEngineOp(run->op),
+                   src.data(),
+                   NULL,
+                   run->factor,
+                   dst.data(),
+                   vector_len,
+                   run->iterations,
+                   run->warmup,
+                   &samples);
+  double best = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    double elapsed = (double)(samples[i].end - samples[i].start);
+    if (best == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+///
+//  BACKEND=HOST: time the host engine on each vector length, reported like
+//  the kernel runs
+//
+int
+HostMain(const struct SaxpyRun* base,
+         size_t vector_len,
+         const struct SweepRange* range)
+{
+  size_t n_sizes = 0;
+  for (size_t len = vector_len; len != 0;
+       len = range != NULL ? clbench_sweep_next(range, len) : 0) {
+    n_sizes++;
+  }
+  std::vector<struct BenchResult> results(n_sizes);
+  std::vector<std::vector<struct BenchSample>> samples(n_sizes);
+  size_t i = 0;
+  for (size_t len = vector_len; len != 0;
+       len = range != NULL ? clbench_sweep_next(range, len) : 0) {
+    printf("=== vector_len: %ld ===\n", len);
+    std::vector<float> src(len), dst(len);
+    FillInput(src.data(), len, base->fill);
+    base->host->bench(HostEngineOp(base->op),
+                      src.data(),
+                      NULL,
+                      base->factor,
+                      dst.data(),
+                      len,
+                      base->iterations,
+                      base->warmup,
+                      &samples[i]);
+    // No OpenCL device: the result is named after the engine
+    clbench_result(&results[i],
+                   NULL,
+                   base->operation,
+                   "host",
+                   len,
+                   2.0 * sizeof(float) * len,
+                   1.0 * len,
+                   samples[i].data(),
+                   samples[i].size(),
+                   base->warmup);
+    base->host->name(results[i].device, sizeof(results[i].device));
+    printf("time(ns):%lg\n", results[i].exec.median);
+    clbench_print(&results[i]);
+    printf("computed %ld elements\n", len);
+    i++;
+  }
+  char* bench_out = getenv("BENCH_OUT");
+  if (bench_out != NULL &&
+      !clbench_write(bench_out, results.data(), results.size())) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", bench_out);
+  }
+  return 0;
+}
+
+///
+//  dot, sum and minmax kernel files hold a first stage named after the
+//  operation, leaving one partial result per work-group, and <op>_final
+//  reducing them with a single work-group. scan.cl holds scan, scanning
+//  blocks of 2 * local elements, and scan_add. All of them need a power of
+//  two local size.
+//
+struct ReduceKernels
+{
+  clrt::Program program;
+  clrt::Kernel first;
+  clrt::Kernel final;
+  char label[256];
+  size_t local;
 };
 
-#define CL_CHECK(_expr)                                                        \
-  do {                                                                         \
-    cl_int _err = _expr;                                                       \
-    if (_err == CL_SUCCESS)                                                    \
-      break;                                                                   \
-    fprintf(stderr, "OpenCL Error: '%s' returned %d!\n", #_expr, (int)_err);   \
-    abort();                                                                   \
-  } while (0)
-
-#define CL_CHECK_ERR(_expr)                                                    \
-  ({                                                                           \
-    cl_int _err = CL_INVALID_VALUE;                                            \
-    typeof(_expr) _ret = _expr;                                                \
-    if (_err != CL_SUCCESS) {                                                  \
-      fprintf(stderr, "OpenCL Error: '%s' returned %d!\n", #_expr, (int)_err); \
-      abort();                                                                 \
-    }                                                                          \
-    _ret;                                                                      \
-  })
+// Local size of the reductions, unless LOCAL=<n> asks for less
+#define REDUCE_LOCAL 256
 
-void
-pfn_notify(const char* errinfo,
-           const void* private_info,
-           size_t cb,
-           void* user_data)
+static bool
+DeviceSubgroups(cl_device_id device)
 {
-  fprintf(stderr, "OpenCL Error (via pfn_notify): %s\n", errinfo);
+  size_t size = 0;
+  CL_CHECK(clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, NULL, &size));
+  std::string extensions(size, '\0');
+  CL_CHECK(clGetDeviceInfo(
+    device, CL_DEVICE_EXTENSIONS, size, &extensions[0], NULL));
+  return extensions.find("cl_khr_subgroups") != std::string::npos;
 }
 
 ///
-//  Create an OpenCL program from the kernel source file
+//  Build kernelfile on the runtime's device, with -DSUBGROUPS if subgroups,
+//  and pick the largest power of two local size both kernels can run
 //
-cl_program
-CreateProgram(cl_context context, cl_device_id device, const char* fileName)
+bool
+CreateReduceKernels(clrt::Runtime* rt,
+                    const struct SaxpyRun* run,
+                    const char* kernelfile,
+                    bool subgroups,
+                    struct ReduceKernels* kern)
 {
-  cl_int errNum;
-  cl_program program;
-
-  std::ifstream kernelFile(fileName, std::ios::in);
-  if (!kernelFile.is_open()) {
-    std::cerr << "Failed to open file for reading: " << fileName << std::endl;
-    return NULL;
+  const char* options = subgroups && run->op != OP_SCAN ? "-DSUBGROUPS" : "";
+  snprintf(kern->label,
+           sizeof(kern->label),
+           "%s%s%s",
+           kernelfile,
+           options[0] ? " " : "",
+           options);
+
+  std::cout << "Building program " << kern->label << "..." << std::endl;
+  enum CacheStatus cache_status;
+  double build_start = now_ns();
+  kern->program = rt->programs().get(
+    rt->context(), rt->device(), kernelfile, options, &cache_status);
+  if (kern->program == NULL) {
+    return false;
   }
-
-  std::ostringstream oss;
-  oss << kernelFile.rdbuf();
-
-  std::string srcStdStr = oss.str();
-  const char* srcStr = srcStdStr.c_str();
-  program =
-    clCreateProgramWithSource(context, 1, (const char**)&srcStr, NULL, NULL);
-  if (program == NULL) {
-    std::cerr << "Failed to create CL program from source." << std::endl;
-    return NULL;
+  printf("program build(ns):%lg (cache %s)\n",
+         now_ns() - build_start,
+         clcache_status_name(cache_status));
+
+  char final_name[64];
+  snprintf(final_name,
+           sizeof(final_name),
+           run->op == OP_SCAN ? "%s_add" : "%s_final",
+           run->operation);
+  kern->first = clrt::create_kernel(kern->program, run->operation);
+  kern->final = clrt::create_kernel(kern->program, final_name);
+
+  size_t limit = REDUCE_LOCAL;
+  if (run->local_config.mode == LOCAL_FIXED) {
+    limit = run->local_config.local;
   }
-
-  errNum = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-  if (errNum != CL_SUCCESS) {
-    // Determine the reason for the error
-    char buildLog[16384];
-    clGetProgramBuildInfo(
-      program, device, CL_PROGRAM_BUILD_LOG, sizeof(buildLog), buildLog, NULL);
-
-    std::cerr << "Error in kernel: " << std::endl;
-    std::cerr << buildLog;
-    clReleaseProgram(program);
-    return NULL;
+  cl_kernel kernels[2] = { kern->first, kern->final };
+  for (int k = 0; k < 2; k++) {
+    size_t max_local;
+    CL_CHECK(clGetKernelWorkGroupInfo(kernels[k],
+                                      rt->device(),
+                                      CL_KERNEL_WORK_GROUP_SIZE,
+                                      sizeof(max_local),
+                                      &max_local,
+                                      NULL));
+    limit = max_local < limit ? max_local : limit;
   }
-
-  return program;
+  kern->local = 1;
+  while (2 * kern->local <= limit) {
+    kern->local *= 2;
+  }
+  return true;
 }
 
+///
+//  One pass of dot, sum or minmax: x (and b) reduced into partial, one
+//  result (a min, max pair for minmax) per work-group, then into out
 //
+static void
+EnqueueReduce(cl_command_queue queue,
+              const struct ReduceKernels* kern,
+              enum Operation op,
+              cl_mem x,
+              cl_mem b,
+              cl_mem partial,
+              cl_mem out,
+              size_t vector_len,
+              size_t groups,
+              clrt::EventTimer* events)
+{
+  size_t local = kern->local;
+  size_t scratch = sizeof(float) * local;
+  // minmax reduces a min and a max array in local memory
+  int n_scratch = op == OP_MINMAX ? 2 : 1;
+  cl_uint arg = 0;
+  clrt::set_arg(kern->first, arg++, x);
+  if (op == OP_DOT) {
+    clrt::set_arg(kern->first, arg++, b);
+  }
+  clrt::set_arg(kern->first, arg++, partial);
+  clrt::set_arg(kern->first, arg++, (cl_int)vector_len);
+  for (int s = 0; s < n_scratch; s++) {
+    CL_CHECK(clSetKernelArg(kern->first, arg++, scratch, NULL));
+  }
+  size_t global = groups * local;
+  CL_CHECK(clEnqueueNDRangeKernel(
+    queue, kern->first, 1, NULL, &global, &local, 0, NULL, events->next()));
+
+  arg = 0;
+  clrt::set_arg(kern->final, arg++, partial);
+  clrt::set_arg(kern->final, arg++, out);
+  clrt::set_arg(kern->final, arg++, (cl_int)groups);
+  for (int s = 0; s < n_scratch; s++) {
+    CL_CHECK(clSetKernelArg(kern->final, arg++, scratch, NULL));
+  }
+  CL_CHECK(clEnqueueNDRangeKernel(
+    queue, kern->final, 1, NULL, &local, &local, 0, NULL, events->next()));
+}
+
 ///
-//  Retreive program binary for all of the devices attached to the
-//  program an and store the one for the device passed in
+//  One scan of x into levels[0]: levels[k + 1] holds the block totals of
+//  levels[k] (lens[k] elements), scanned in place up to a single block,
+//  then added back down
 //
-bool
-SaveProgramBinary(cl_program program, cl_device_id device, const char* fileName)
-{
-  // cl_uint numDevices = malloc(sizeof(cl_uint));
-  // cl_uint* numDevices = malloc(sizeof(cl_uint));
-  cl_int errNum;
-
-  printf("try getting program info\n");
-  // 1 - Query for number of devices attached to program
-  /*errNum = clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(cl_uint),
-                            &numDevices, NULL);
-  printf("Got program_num_devices\n");
-  if (errNum != CL_SUCCESS)
-  {
-      std::cerr << "Error querying for number of devices." << std::endl;
-      return false;
-  }*/
-
-  // 2 - Get all of the Device IDs
-  cl_device_id* devices = new cl_device_id[1];
-  errNum = clGetProgramInfo(
-    program, CL_PROGRAM_DEVICES, sizeof(cl_device_id) * 1, devices, NULL);
-  printf("Got program_devices\n");
-  if (errNum != CL_SUCCESS) {
-    std::cerr << "Error querying for devices." << std::endl;
-    delete[] devices;
-    return false;
+static void
+EnqueueScan(cl_command_queue queue,
+            const struct ReduceKernels* kern,
+            cl_mem x,
+            const std::vector<clrt::Mem>& levels,
+            const std::vector<size_t>& lens,
+            clrt::EventTimer* events)
+{
+  size_t local = kern->local;
+  for (size_t k = 0; k + 1 < lens.size(); k++) {
+    clrt::set_arg(kern->first, 0, k == 0 ? x : levels[k].get());
+    clrt::set_arg(kern->first, 1, levels[k].get());
+    clrt::set_arg(kern->first, 2, levels[k + 1].get());
+    clrt::set_arg(kern->first, 3, (cl_int)lens[k]);
+    CL_CHECK(clSetKernelArg(kern->first, 4, 2 * sizeof(float) * local, NULL));
+    size_t global = lens[k + 1] * local;
+    CL_CHECK(clEnqueueNDRangeKernel(queue,
+                                    kern->first,
+                                    1,
+                                    NULL,
+                                    &global,
+                                    &local,
+                                    0,
+                                    NULL,
+                                    events->next()));
   }
+  for (size_t k = lens.size() - 2; k-- > 0;) {
+    clrt::set_arg(kern->final, 0, levels[k].get());
+    clrt::set_arg(kern->final, 1, levels[k + 1].get());
+    clrt::set_arg(kern->final, 2, (cl_int)lens[k]);
+    size_t global = lens[k + 1] * local;
+    CL_CHECK(clEnqueueNDRangeKernel(queue,
+                                    kern->final,
+                                    1,
+                                    NULL,
+                                    &global,
+                                    &local,
+                                    0,
+                                    NULL,
+                                    events->next()));
+  }
+}
 
-  // 3 - Determine the size of each program binary
-  size_t* programBinarySizes = new size_t[1];
-  errNum = clGetProgramInfo(program,
-                            CL_PROGRAM_BINARY_SIZES,
-                            sizeof(size_t) * 1,
-                            programBinarySizes,
-                            NULL);
-  printf("Got program_binary_sizes\n");
-  if (errNum != CL_SUCCESS) {
-    std::cerr << "Error querying for program binary sizes." << std::endl;
-    delete[] devices;
-    delete[] programBinarySizes;
-    return false;
+///
+//  CHECK of a reduction or scan against the host, summing in double. Float
+//  sums depend on their order: an element passes within the first-order
+//  error bound of the kernels' summation tree, depth * FLT_EPSILON * (sum of
+//  the |terms|), or within VERIFY_REL. min and max are exact. Returns the
+//  failures.
+//
+static size_t
+CheckReduce(const struct SaxpyRun* run,
+            const float* x,
+            const float* b,
+            const float* out,
+            size_t vector_len,
+            double depth)
+{
+  const struct clrt::VerifyConfig& verify = run->host->verify_config();
+  double start = now_ns();
+  size_t elements = run->op == OP_SCAN     ? vector_len
+                    : run->op == OP_MINMAX ? 2
+                                           : 1;
+  std::vector<double> expected(elements);
+  std::vector<double> bound(elements, 0.0);
+  if (run->op == OP_MINMAX) {
+    float lo = INFINITY;
+    float hi = -INFINITY;
+    for (size_t i = 0; i < vector_len; i++) {
+      lo = fminf(lo, x[i]);
+      hi = fmaxf(hi, x[i]);
+    }
+    expected[0] = lo;
+    expected[1] = hi;
+  } else {
+    double acc = 0;
+    double magnitude = 0;
+    for (size_t i = 0; i < vector_len; i++) {
+      double term = run->op == OP_DOT ? (double)x[i] * b[i] : x[i];
+      acc += term;
+      magnitude += fabs(term);
+      if (run->op == OP_SCAN) {
+        expected[i] = acc;
+        bound[i] = depth * FLT_EPSILON * magnitude;
+      }
+    }
+    if (run->op != OP_SCAN) {
+      expected[0] = acc;
+      bound[0] = depth * FLT_EPSILON * magnitude;
+    }
   }
 
-  unsigned char** programBinaries = new unsigned char*[1];
-  for (cl_uint i = 0; i < 1; i++) {
-    programBinaries[i] = new unsigned char[programBinarySizes[i]];
+  size_t failures = 0;
+  size_t max_index = 0;
+  double max_err = 0;
+  std::vector<size_t> shown;
+  for (size_t i = 0; i < elements; i++) {
+    double err = fabs((double)out[i] - expected[i]);
+    double tol = bound[i];
+    if (verify.max_rel * fabs(expected[i]) > tol) {
+      tol = verify.max_rel * fabs(expected[i]);
+    }
+    // NaN fails
+    if (!(err <= tol)) {
+      failures++;
+      if (shown.size() < (size_t)verify.show) {
+        shown.push_back(i);
+      }
+    }
+    if (!(err <= max_err)) {
+      max_err = err;
+      max_index = i;
+    }
+  }
+  printf("verify %s: %ld elements, %ld failures (depth %.0f, rel %lg) "
+         "check(ns):%lg\n",
+         run->operation,
+         elements,
+         failures,
+         depth,
+         verify.max_rel,
+         now_ns() - start);
+  printf("verify %s: max error %lg at index %ld (bound %lg)\n",
+         run->operation,
+         max_err,
+         max_index,
+         bound[max_index]);
+  for (size_t k = 0; k < shown.size(); k++) {
+    size_t i = shown[k];
+    printf("[FAILURE] at index %ld:  %f != %f (bound %lg)\n",
+           i,
+           expected[i],
+           out[i],
+           bound[i]);
   }
+  if (failures > shown.size()) {
+    printf("[FAILURE] ... %ld more\n", failures - shown.size());
+  }
+  return failures;
+}
 
-  // 4 - Get all of the program binaries
-  errNum = clGetProgramInfo(program,
-                            CL_PROGRAM_BINARIES,
-                            sizeof(unsigned char*) * 1,
-                            programBinaries,
-                            NULL);
-  printf("Got program_binarys\n");
-  if (errNum != CL_SUCCESS) {
-    std::cerr << "Error querying for program binaries" << std::endl;
+///
+//  The element-wise kernel the reductions are measured against, timed over
+//  vector_len elements (inputs zeroed, output not read)
+//
+static void
+RunPeak(clrt::Runtime* rt,
+        const struct SaxpyRun* run,
+        const struct SaxpyKernel* kern,
+        size_t vector_len,
+        struct BenchResult* bench)
+{
+  size_t bytes = sizeof(float) * vector_len;
+  clrt::Mem src = rt->pool().acquire(CL_MEM_READ_ONLY, bytes);
+  clrt::Mem dst = rt->pool().acquire(CL_MEM_READ_WRITE, bytes);
+  const cl_uint zero = 0;
+  CL_CHECK(clEnqueueFillBuffer(
+    rt->queue(), src, &zero, sizeof(zero), 0, bytes, 0, NULL, NULL));
+  CL_CHECK(clEnqueueFillBuffer(
+    rt->queue(), dst, &zero, sizeof(zero), 0, bytes, 0, NULL, NULL));
+  clrt::set_arg(kern->kernel, 0, src.get());
+  clrt::set_arg(kern->kernel, 1, dst.get());
+  if (kern->bounds) {
+    clrt::set_arg(kern->kernel, 3, (cl_int)vector_len);
+  }
+  size_t global = kern->grid_stride
+                    ? cltune_grid_items(run->device, vector_len)
+                    : (vector_len + kern->width - 1) / kern->width;
+
+  struct BenchSample* samples =
+    (struct BenchSample*)malloc(sizeof(struct BenchSample) * run->iterations);
+  for (int i = 0; i < run->warmup + run->iterations; i++) {
+    clrt::Event event;
+    CL_CHECK(clEnqueueNDRangeKernel(
+      rt->queue(), kern->kernel, 1, NULL, &global, NULL, 0, NULL, event.out()));
+    cl_event wait_event = event;
+    CL_CHECK(clWaitForEvents(1, &wait_event));
+    if (i >= run->warmup) {
+      CL_CHECK(clbench_sample(event, &samples[i - run->warmup]));
+    }
+  }
+  // Traffic accounted like RunVector
+  clbench_result(bench,
+                 run->device,
+                 run->operation,
+                 kern->label,
+                 vector_len,
+                 3.0 * bytes,
+                 2.0 * vector_len,
+                 samples,
+                 run->iterations,
+                 run->warmup);
+  rt->pool().release(src);
+  rt->pool().release(dst);
+}
 
-    delete[] devices;
-    delete[] programBinarySizes;
-    for (cl_uint i = 0; i < 1; i++) {
-      delete[] programBinaries[i];
+///
+//  Write the input, run the reduction or scan iterations (one sample from
+//  the start of the first kernel of a pass to the end of its last), read
+//  back, check and report the bandwidth against peak. Returns the CHECK
+//  failures.
+//
+static size_t
+RunReduce(clrt::Runtime* rt,
+          const struct SaxpyRun* run,
+          const struct ReduceKernels* kern,
+          size_t vector_len,
+          const struct BenchResult* peak,
+          struct BenchResult* bench)
+{
+  cl_command_queue queue = rt->queue();
+  enum Operation op = run->op;
+  size_t bytes = sizeof(float) * vector_len;
+  std::vector<float> x(vector_len);
+  std::vector<float> b(op == OP_DOT ? vector_len : 0);
+  FillInput(x.data(), vector_len, run->fill);
+  FillInput(b.data(), b.size(), run->fill);
+
+  clrt::Mem x_buf = rt->pool().acquire(CL_MEM_READ_ONLY, bytes);
+  clrt::Mem b_buf;
+  double write_start = now_ns();
+  CL_CHECK(clEnqueueWriteBuffer(
+    queue, x_buf, CL_TRUE, 0, bytes, x.data(), 0, NULL, NULL));
+  if (op == OP_DOT) {
+    b_buf = rt->pool().acquire(CL_MEM_READ_ONLY, bytes);
+    CL_CHECK(clEnqueueWriteBuffer(
+      queue, b_buf, CL_TRUE, 0, bytes, b.data(), 0, NULL, NULL));
+  }
+  double write_ns = now_ns() - write_start;
+
+  // scan: the output and the block totals of every level. Reductions: the
+  // partial results of a grid-stride launch and the result. depth bounds
+  // the additions on the way to any result, for CHECK.
+  std::vector<clrt::Mem> levels;
+  std::vector<size_t> lens(1, vector_len);
+  size_t groups = 0;
+  int log_local = 0;
+  while (((size_t)1 << log_local) < kern->local) {
+    log_local++;
+  }
+  double depth;
+  if (op == OP_SCAN) {
+    size_t block = 2 * kern->local;
+    do {
+      lens.push_back((lens.back() + block - 1) / block);
+    } while (lens.back() > 1);
+    for (size_t k = 0; k < lens.size(); k++) {
+      levels.push_back(
+        rt->pool().acquire(CL_MEM_READ_WRITE, sizeof(float) * lens[k]));
     }
-    delete[] programBinaries;
-    return false;
+    depth = (lens.size() - 1) * (2.0 * (log_local + 1) + 2) + 2;
+  } else {
+    size_t items = cltune_grid_items(run->device, vector_len);
+    groups = (items + kern->local - 1) / kern->local;
+    levels.push_back(
+      rt->pool().acquire(CL_MEM_READ_WRITE, 2 * sizeof(float) * groups));
+    levels.push_back(rt->pool().acquire(CL_MEM_READ_WRITE, 2 * sizeof(float)));
+    size_t per_item = (vector_len + groups * kern->local - 1) /
+                      (groups * kern->local);
+    size_t per_final = (groups + kern->local - 1) / kern->local;
+    // min/max round nothing
+    depth = op == OP_MINMAX
+              ? 0
+              : per_item + per_final + 2 * (2.0 * log_local + 2) + 2;
   }
 
-  // 5 - Finally store the binaries for the device requested out to disk for
-  // future reading.
-  for (cl_uint i = 0; i < 1; i++) {
-    // Store the binary just for the device requested.  In a scenario where
-    // multiple devices were being used you would save all of the binaries out
-    // here.
-    if (devices[i] == device) {
-      FILE* fp = fopen(fileName, "wb");
-      if (fp == NULL) {
-        delete[] devices;
-        delete[] programBinarySizes;
-        for (cl_uint i = 0; i < 1; i++) {
-          delete[] programBinaries[i];
-        }
-        delete[] programBinaries;
-        return false;
-      }
-      printf("Opened file\n");
-      fwrite(programBinaries[i], 1, programBinarySizes[i], fp);
-      printf("wrote file\n");
-      fclose(fp);
-      printf("close file\n");
-      break;
+  printf("local work size: %ld (%ld %s)\n",
+         kern->local,
+         op == OP_SCAN ? lens.size() - 1 : groups,
+         op == OP_SCAN ? "levels" : "groups");
+  printf("attempting to enqueue kernel\n");
+  fflush(stdout);
+  struct BenchSample* samples =
+    (struct BenchSample*)malloc(sizeof(struct BenchSample) * run->iterations);
+  for (int i = 0; i < run->warmup + run->iterations; i++) {
+    clrt::EventTimer events;
+    if (op == OP_SCAN) {
+      EnqueueScan(queue, kern, x_buf, levels, lens, &events);
+    } else {
+      EnqueueReduce(queue,
+                    kern,
+                    op,
+                    x_buf,
+                    b_buf,
+                    levels[0],
+                    levels[1],
+                    vector_len,
+                    groups,
+                    &events);
+    }
+    std::vector<struct BenchSample> stages;
+    events.collect(&stages);
+    if (i >= run->warmup) {
+      struct BenchSample* s = &samples[i - run->warmup];
+      *s = stages[0];
+      s->end = stages.back().end;
     }
   }
 
-  // Cleanup
-  delete[] devices;
-  delete[] programBinarySizes;
-  for (cl_uint i = 0; i < 1; i++) {
-    delete[] programBinaries[i];
+  // Compulsory traffic: the inputs read once (and the scan written once)
+  size_t vectors = op == OP_DOT || op == OP_SCAN ? 2 : 1;
+  clbench_result(bench,
+                 run->device,
+                 run->operation,
+                 kern->label,
+                 vector_len,
+                 (double)vectors * bytes,
+                 (op == OP_SUM || op == OP_SCAN ? 1.0 : 2.0) * vector_len,
+                 samples,
+                 run->iterations,
+                 run->warmup);
+
+  std::vector<float> out(op == OP_SCAN ? vector_len : 2);
+  double read_start = now_ns();
+  CL_CHECK(clEnqueueReadBuffer(queue,
+                               op == OP_SCAN ? levels[0] : levels[1],
+                               CL_TRUE,
+                               0,
+                               sizeof(float) * out.size(),
+                               out.data(),
+                               0,
+                               NULL,
+                               NULL));
+  bench->write_ns = write_ns;
+  bench->read_ns = now_ns() - read_start;
+  printf("time(ns):%lg\n", bench->exec.median);
+  if (run->iterations > 1) {
+    clbench_print(bench);
   }
-  delete[] programBinaries;
-  return true;
+  if (op == OP_MINMAX) {
+    printf("result: min %.9g max %.9g\n", out[0], out[1]);
+  } else {
+    // scan: the total, in its last element
+    printf("result: %.9g\n", op == OP_SCAN ? out.back() : out[0]);
+  }
+  double gbps = bench->bytes / bench->exec.median;
+  double peak_gbps = peak->bytes / peak->exec.median;
+  printf("bandwidth: %.3f GB/s, %.1f%% of %s (%.3f GB/s)\n",
+         gbps,
+         100.0 * gbps / peak_gbps,
+         peak->kernel,
+         peak_gbps);
+
+  size_t failures = 0;
+  if (run->check_res) {
+    failures =
+      CheckReduce(run, x.data(), b.data(), out.data(), vector_len, depth);
+  }
+  printf("computed %ld elements\n", vector_len);
+
+  rt->pool().release(x_buf);
+  if (op == OP_DOT) {
+    rt->pool().release(b_buf);
+  }
+  for (size_t k = 0; k < levels.size(); k++) {
+    rt->pool().release(levels[k]);
+  }
+  return failures;
 }
 
 ///
-//  Attempt to create the program object from a cached binary.  Note that
-//  on first run this will fail because the binary has not yet been created.
+//  dot, sum, minmax and scan: every vector length is run, checked and
+//  measured against the bandwidth of an element-wise kernel (PEAK) on the
+//  same device
 //
-cl_program
-CreateProgramFromBinary(cl_context context,
-                        cl_device_id device,
-                        const char* fileName)
+int
+ReduceMain(const struct SaxpyRun* base,
+           const char* kernelfile,
+           int platform_id,
+           int device_id,
+           size_t vector_len,
+           const struct SweepRange* range)
 {
-  FILE* fp = fopen(fileName, "rb");
-  if (fp == NULL) {
-    return NULL;
+  cl_device_id device = clrt::select_device(platform_id, device_id, true);
+  if (device == NULL) {
+    return 1;
+  }
+  size_t pool_arena;
+  int pool_bench;
+  clrt::pool_config(&pool_arena, &pool_bench);
+  // The kernels of a pass follow each other on an in-order queue
+  enum QueueMode queue_mode = QUEUE_BLOCKING;
+  clrt::Runtime rt(device, &queue_mode, pool_arena);
+  struct SaxpyRun run = *base;
+  run.device = device;
+  run.queue = rt.queue();
+
+  char* subgroups_str = getenv("SUBGROUPS");
+  bool subgroups = (subgroups_str == NULL || atoi(subgroups_str) != 0) &&
+                   DeviceSubgroups(device);
+  printf("subgroups: %s\n", subgroups ? "true" : "false");
+  struct ReduceKernels kern;
+  if (!CreateReduceKernels(&rt, &run, kernelfile, subgroups, &kern)) {
+    return 1;
   }
 
-  // Determine the size of the binary
-  size_t binarySize;
-  fseek(fp, 0, SEEK_END);
-  binarySize = ftell(fp);
-  rewind(fp);
+  char* peak_str = getenv("PEAK");
+  const char* peakfile = peak_str != NULL ? peak_str : "dmul.cl";
+  struct SaxpyRun peak_run = run;
+  peak_run.operation = ParseOperation(peakfile, &peak_run.op);
+  if (peak_run.operation == NULL || peak_run.op >= OP_DOT) {
+    printf("peak %s is not an element-wise kernel\n", peakfile);
+    return 1;
+  }
+  struct SaxpyKernel peak;
+  if (!CreateSaxpyKernel(
+        &rt.programs(), rt.context(), &peak_run, peakfile, 0, &peak)) {
+    return 1;
+  }
 
-  unsigned char* programBinary = new unsigned char[binarySize];
-  fread(programBinary, 1, binarySize, fp);
-  fclose(fp);
+  // The results of the peak kernel follow the ones of the operation
+  size_t n_sizes = 0;
+  for (size_t len = vector_len; len != 0;
+       len = range != NULL ? clbench_sweep_next(range, len) : 0) {
+    n_sizes++;
+  }
+  struct BenchResult* results =
+    (struct BenchResult*)malloc(sizeof(struct BenchResult) * 2 * n_sizes);
+  size_t failures = 0;
+  size_t i = 0;
+  for (size_t len = vector_len; len != 0;
+       len = range != NULL ? clbench_sweep_next(range, len) : 0) {
+    if (range != NULL) {
+      printf("=== vector_len: %ld ===\n", len);
+    }
+    RunPeak(&rt, &peak_run, &peak, len, &results[n_sizes + i]);
+    failures +=
+      RunReduce(&rt, &run, &kern, len, &results[n_sizes + i], &results[i]);
+    i++;
+  }
 
-  cl_int errNum = 0;
-  cl_program program;
-  cl_int binaryStatus;
+  char* bench_out = getenv("BENCH_OUT");
+  if (bench_out != NULL && !clbench_write(bench_out, results, 2 * n_sizes)) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", bench_out);
+  }
+  for (size_t k = 0; k < 2 * n_sizes; k++) {
+    free((void*)results[k].samples);
+  }
+  free(results);
+  return failures > 0 ? 1 : 0;
+}
 
-  program = clCreateProgramWithBinary(context,
-                                      1,
-                                      &device,
-                                      &binarySize,
-                                      (const unsigned char**)&programBinary,
-                                      &binaryStatus,
-                                      &errNum);
-  delete[] programBinary;
-  if (errNum != CL_SUCCESS) {
-    std::cerr << "Error loading program binary." << std::endl;
-    return NULL;
+///
+//  *.batch.cl: BATCH jobs packed into one launch. Every batch writes the
+//  inputs and the offsets, runs the kernel and reads the outputs back, timed
+//  on the host from the first write to the end of the read. A pass with one
+//  launch per job follows, to compare against.
+//
+int
+BatchMain(const struct SaxpyRun* run,
+          const char* kernelfile,
+          int platform_id,
+          int device_id,
+          const struct BatchConfig* config)
+{
+  if (getenv("SWEEP") != NULL || getenv("BASELINE") != NULL ||
+      getenv("SPECIALIZE") != NULL || getenv("DTYPE") != NULL) {
+    printf("batch: SWEEP, BASELINE, SPECIALIZE and DTYPE are ignored\n");
+  }
+  cl_device_id device = clrt::select_device(platform_id, device_id, true);
+  if (device == NULL) {
+    return 1;
+  }
+  size_t pool_arena;
+  int pool_bench;
+  clrt::pool_config(&pool_arena, &pool_bench);
+  // The commands of a batch follow each other on an in-order queue
+  enum QueueMode queue_mode = QUEUE_BLOCKING;
+  clrt::Runtime rt(device, &queue_mode, pool_arena);
+  cl_command_queue queue = rt.queue();
+
+  std::cout << "Building program " << kernelfile << "..." << std::endl;
+  enum CacheStatus cache_status;
+  double build_start = now_ns();
+  clrt::Program program = rt.programs().get(
+    rt.context(), device, kernelfile, "", &cache_status);
+  if (program == NULL) {
+    return 1;
+  }
+  printf("program build(ns):%lg (cache %s)\n",
+         now_ns() - build_start,
+         clcache_status_name(cache_status));
+  clrt::Kernel kernel = clrt::create_kernel(program, run->operation);
+  size_t local = clbatch_local(kernel, device, &run->local_config);
+
+  size_t jobs = config->jobs;
+  std::vector<cl_int> offsets(jobs + 1);
+  size_t total = clbatch_pack(config, offsets.data());
+  std::vector<float> src(total), dst(total);
+  FillInput(src.data(), total, run->fill);
+  printf("batch: %ld jobs of %ld..%ld elements (%ld), local %ld\n",
+         jobs,
+         config->min_len,
+         config->max_len,
+         total,
+         local);
+
+  size_t bytes = sizeof(float) * total;
+  size_t offsets_bytes = sizeof(cl_int) * (jobs + 1);
+  clrt::Mem src_buf = rt.pool().acquire(CL_MEM_READ_ONLY, bytes);
+  clrt::Mem dst_buf = rt.pool().acquire(CL_MEM_WRITE_ONLY, bytes);
+  clrt::Mem offsets_buf = rt.pool().acquire(CL_MEM_READ_ONLY, offsets_bytes);
+  clrt::set_arg(kernel, 0, src_buf.get());
+  clrt::set_arg(kernel, 1, dst_buf.get());
+  clrt::set_arg(kernel, 2, run->factor);
+  clrt::set_arg(kernel, 3, offsets_buf.get());
+
+  printf("attempting to enqueue batches\n");
+  fflush(stdout);
+  std::vector<struct BenchSample> samples(run->iterations);
+  std::vector<struct BenchSample> kernels(run->iterations);
+  size_t global = jobs * local;
+  clrt::set_arg(kernel, 4, (cl_int)jobs);
+  double phase_start = now_ns();
+  for (int i = 0; i < run->warmup + run->iterations; i++) {
+    clrt::Event kernel_completion;
+    cl_ulong start = (cl_ulong)now_ns();
+    CL_CHECK(clEnqueueWriteBuffer(
+      queue, src_buf, CL_FALSE, 0, bytes, src.data(), 0, NULL, NULL));
+    CL_CHECK(clEnqueueWriteBuffer(queue,
+                                  offsets_buf,
+                                  CL_FALSE,
+                                  0,
+                                  offsets_bytes,
+                                  offsets.data(),
+                                  0,
+                                  NULL,
+                                  NULL));
+    CL_CHECK(clEnqueueNDRangeKernel(queue,
+                                    kernel,
+                                    1,
+                                    NULL,
+                                    &global,
+                                    &local,
+                                    0,
+                                    NULL,
+                                    kernel_completion.out()));
+    CL_CHECK(clEnqueueReadBuffer(
+      queue, dst_buf, CL_TRUE, 0, bytes, dst.data(), 0, NULL, NULL));
+    cl_ulong end = (cl_ulong)now_ns();
+    if (i >= run->warmup) {
+      struct BenchSample* s = &samples[i - run->warmup];
+      s->queued = s->submit = s->start = start;
+      s->end = end;
+      CL_CHECK(clbench_sample(kernel_completion, &kernels[i - run->warmup]));
+    }
+  }
+  cltrace_phase("batches", phase_start);
+
+  // Per element: read src, write dst; the offsets once per batch
+  struct BenchResult bench, kernel_bench;
+  clbench_result(&bench,
+                 device,
+                 run->operation,
+                 kernelfile,
+                 total,
+                 2.0 * bytes + offsets_bytes,
+                 1.0 * total,
+                 samples.data(),
+                 run->iterations,
+                 run->warmup);
+  clbench_result(&kernel_bench,
+                 device,
+                 run->operation,
+                 kernelfile,
+                 total,
+                 2.0 * bytes + offsets_bytes,
+                 1.0 * total,
+                 kernels.data(),
+                 run->iterations,
+                 run->warmup);
+
+  for (size_t j = 0; j < jobs && j < 3; j++) {
+    cl_int first = offsets[j];
+    printf("[job %ld] %d elements, [%d] Host: %.6f  Device: %.6f\n",
+           j,
+           offsets[j + 1] - first,
+           first,
+           HostOp(run->op, src[first], run->factor),
+           dst[first]);
+  }
+  if (run->check_res) {
+    struct clrt::VerifyReport report;
+    run->host->verify(HostEngineOp(run->op),
+                      src.data(),
+                      NULL,
+                      run->factor,
+                      dst.data(),
+                      total,
+                      &report);
+    run->host->print_report(run->operation, &report);
   }
 
-  if (binaryStatus != CL_SUCCESS) {
-    std::cerr << "Invalid binary for device" << std::endl;
-    return NULL;
+  // One launch per job: the same kernel on a batch of one, its transfers
+  // limited to the job
+  phase_start = now_ns();
+  clrt::set_arg(kernel, 4, (cl_int)1);
+  for (size_t j = 0; j < jobs; j++) {
+    size_t offset = sizeof(float) * offsets[j];
+    size_t len = sizeof(float) * (offsets[j + 1] - offsets[j]);
+    CL_CHECK(clEnqueueWriteBuffer(queue,
+                                  src_buf,
+                                  CL_FALSE,
+                                  offset,
+                                  len,
+                                  &src[offsets[j]],
+                                  0,
+                                  NULL,
+                                  NULL));
+    CL_CHECK(clEnqueueWriteBuffer(queue,
+                                  offsets_buf,
+                                  CL_FALSE,
+                                  0,
+                                  2 * sizeof(cl_int),
+                                  &offsets[j],
+                                  0,
+                                  NULL,
+                                  NULL));
+    CL_CHECK(clEnqueueNDRangeKernel(
+      queue, kernel, 1, NULL, &local, &local, 0, NULL, NULL));
+    CL_CHECK(clEnqueueReadBuffer(
+      queue, dst_buf, CL_TRUE, offset, len, &dst[offsets[j]], 0, NULL, NULL));
   }
+  double unbatched_ns = (now_ns() - phase_start) / jobs;
+  cltrace_phase("unbatched", phase_start);
 
-  errNum = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
-  if (errNum != CL_SUCCESS) {
-    printf("build errNum:%d\n", errNum);
-    // Determine the reason for the error
-    char buildLog[16384];
-    clGetProgramBuildInfo(
-      program, device, CL_PROGRAM_BUILD_LOG, sizeof(buildLog), buildLog, NULL);
+  clbatch_print(&bench, jobs, kernel_bench.exec.median, unbatched_ns);
+  printf("computed %ld jobs\n", jobs);
 
-    std::cerr << "Error in program: " << std::endl;
-    std::cerr << buildLog << std::endl;
-    clReleaseProgram(program);
-    return NULL;
+  char* bench_out = getenv("BENCH_OUT");
+  if (bench_out != NULL && !clbench_write(bench_out, &bench, 1)) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", bench_out);
   }
+  rt.pool().release(src_buf);
+  rt.pool().release(dst_buf);
+  rt.pool().release(offsets_buf);
+  return run->host->failures() > 0 ? 1 : 0;
+}
 
-  return program;
+// Median of the ingest or egress times of a shared run
+static double
+MedianNs(std::vector<double> ns)
+{
+  std::sort(ns.begin(), ns.end());
+  return ns.empty() ? 0 : ns[ns.size() / 2];
 }
 
 ///
-//  Cleanup any created OpenCL resources
+//  The vectors of another process (INPUT, OUTPUT; see clshm.h): mapped and
+//  wrapped by the buffers (no copy where the device shares host memory),
+//  then read() into and written back from private copies, for comparison.
+//  Each iteration times the whole path: ingest (open, map or read, buffers
+//  and transfer), kernel, egress (the output visible to the other process).
 //
-void
-Cleanup(cl_context context,
-        cl_command_queue commandQueue,
-        cl_program program,
-        cl_kernel kernel,
-        cl_mem memObjects[3])
+int
+SharedMain(const struct SaxpyRun* base,
+           const char* kernelfile,
+           int platform_id,
+           int device_id,
+           size_t vector_len,
+           const char* input,
+           const char* output)
 {
-  for (int i = 0; i < 3; i++) {
-    if (memObjects[i] != 0)
-      clReleaseMemObject(memObjects[i]);
+  if (getenv("SWEEP") != NULL || getenv("DTYPE") != NULL ||
+      getenv("MEMORY") != NULL || getenv("TRANSFER") != NULL) {
+    printf("shared: SWEEP, DTYPE, MEMORY and TRANSFER are ignored\n");
   }
-  if (commandQueue != 0)
-    clReleaseCommandQueue(commandQueue);
-
-  if (kernel != 0)
-    clReleaseKernel(kernel);
+  struct SaxpyRun run = *base;
+  run.device = clrt::select_device(platform_id, device_id, true);
+  if (run.device == NULL) {
+    return 1;
+  }
+  run.dtype = DTYPE_F32;
+  size_t pool_arena;
+  int pool_bench;
+  clrt::pool_config(&pool_arena, &pool_bench);
+  enum QueueMode queue_mode = QUEUE_BLOCKING;
+  clrt::Runtime rt(run.device, &queue_mode, pool_arena);
+  cl_command_queue queue = rt.queue();
+  struct SaxpyKernel kern;
+  if (!CreateSaxpyKernel(
+        &rt.programs(), rt.context(), &run, kernelfile, 0, &kern)) {
+    return 1;
+  }
+  if (kern.bounds) {
+    clrt::set_arg(kern.kernel, 3, (cl_int)vector_len);
+  }
+  size_t global = kern.grid_stride
+                    ? cltune_grid_items(run.device, vector_len)
+                    : (vector_len + kern.width - 1) / kern.width;
+  printf("shared: input %s, output %s\n",
+         input,
+         output != NULL ? output : "(none)");
+
+  size_t bytes = sizeof(float) * vector_len;
+  const enum HostIo ios[2] = { HOSTIO_MMAP, HOSTIO_READ };
+  struct BenchResult results[2];
+  std::vector<struct BenchSample> samples[2];
+  for (int m = 0; m < 2; m++) {
+    enum HostIo io = ios[m];
+    const char* io_name = io == HOSTIO_MMAP ? "mmap" : "read";
+    std::vector<double> ingest, egress;
+    bool src_wrapped = false, dst_wrapped = false;
+    samples[m].resize(run.iterations);
+    double phase_start = now_ns();
+    for (int i = 0; i < run.warmup + run.iterations; i++) {
+      double ingest_start = now_ns();
+      struct HostFile in, out;
+      if (!clshm_open(&in, input, bytes, io, false)) {
+        return 1;
+      }
+      if (!clshm_open(&out, output, bytes, io, true)) {
+        clshm_close(&in);
+        return 1;
+      }
+      clrt::Mem src_buf, dst_buf;
+      if (io == HOSTIO_MMAP) {
+        cl_int err;
+        src_buf = clrt::Mem(clshm_buffer(rt.context(),
+                                         run.device,
+                                         CL_MEM_READ_ONLY,
+                                         in.addr,
+                                         bytes,
+                                         &src_wrapped,
+                                         &err));
+        CL_CHECK(err);
+        dst_buf = clrt::Mem(clshm_buffer(rt.context(),
+                                         run.device,
+                                         CL_MEM_READ_WRITE,
+                                         out.addr,
+                                         bytes,
+                                         &dst_wrapped,
+                                         &err));
+        CL_CHECK(err);
+      } else {
+        src_buf = rt.pool().acquire(CL_MEM_READ_ONLY, bytes);
+        dst_buf = rt.pool().acquire(CL_MEM_READ_WRITE, bytes);
+        CL_CHECK(clEnqueueWriteBuffer(
+          queue, src_buf, CL_TRUE, 0, bytes, in.addr, 0, NULL, NULL));
+      }
+      double ingest_ns = now_ns() - ingest_start;
+
+      // dst starts from zero: the kernels add to it
+      float zero = 0;
+      CL_CHECK(clEnqueueFillBuffer(
+        queue, dst_buf, &zero, sizeof(zero), 0, bytes, 0, NULL, NULL));
+      clrt::set_arg(kern.kernel, 0, src_buf.get());
+      clrt::set_arg(kern.kernel, 1, dst_buf.get());
+      clrt::Event kernel_completion;
+      CL_CHECK(clEnqueueNDRangeKernel(queue,
+                                      kern.kernel,
+                                      1,
+                                      NULL,
+                                      &global,
+                                      NULL,
+                                      0,
+                                      NULL,
+                                      kernel_completion.out()));
+
+      // A wrapped output only needs the device copy synced back (map);
+      // a copied one is read into the mapping
+      double egress_start = now_ns();
+      if (io == HOSTIO_MMAP && dst_wrapped) {
+        void* mapped = clEnqueueMapBuffer(
+          queue, dst_buf, CL_TRUE, CL_MAP_READ, 0, bytes, 0, NULL, NULL, NULL);
+        CL_CHECK(
+          clEnqueueUnmapMemObject(queue, dst_buf, mapped, 0, NULL, NULL));
+        CL_CHECK(clFinish(queue));
+      } else {
+        CL_CHECK(clEnqueueReadBuffer(
+          queue, dst_buf, CL_TRUE, 0, bytes, out.addr, 0, NULL, NULL));
+      }
+      if (!clshm_sync(&out)) {
+        return 1;
+      }
+      double egress_ns = now_ns() - egress_start;
 
-  if (program != 0)
-    clReleaseProgram(program);
+      if (i >= run.warmup) {
+        ingest.push_back(ingest_ns);
+        egress.push_back(egress_ns);
+        CL_CHECK(clbench_sample(kernel_completion,
+                                &samples[m][i - run.warmup]));
+      }
+      if (i == run.warmup + run.iterations - 1) {
+        const float* src = (const float*)in.addr;
+        const float* dst = (const float*)out.addr;
+        for (size_t k = 0; k < vector_len && k < 3; k++) {
+          printf("[%ld] Host: %.6f  Device: %.6f\n",
+                 k,
+                 HostOp(run.op, src[k], run.factor),
+                 dst[k]);
+        }
+        if (run.check_res) {
+          struct clrt::VerifyReport report;
+          run.host->verify(HostEngineOp(run.op),
+                           src,
+                           NULL,
+                           run.factor,
+                           dst,
+                           vector_len,
+                           &report);
+          run.host->print_report(run.operation, &report);
+        }
+      }
+      if (io == HOSTIO_READ) {
+        rt.pool().release(src_buf);
+        rt.pool().release(dst_buf);
+      }
+      src_buf.reset();
+      dst_buf.reset();
+      clshm_close(&in);
+      clshm_close(&out);
+    }
+    cltrace_phase(io_name, phase_start);
+
+    char label[300];
+    snprintf(label, sizeof(label), "%s %s", kern.label, io_name);
+    struct BenchResult* r = &results[m];
+    clbench_result(r,
+                   run.device,
+                   run.operation,
+                   label,
+                   vector_len,
+                   3.0 * bytes,
+                   2.0 * vector_len,
+                   samples[m].data(),
+                   run.iterations,
+                   run.warmup);
+    r->write_ns = MedianNs(ingest);
+    r->read_ns = MedianNs(egress);
+    clbench_print(r);
+    printf("%s: ingest(ns):%lg egress(ns):%lg",
+           io_name,
+           r->write_ns,
+           r->read_ns);
+    if (io == HOSTIO_MMAP) {
+      printf(" wrapped: src %s dst %s",
+             src_wrapped ? "yes" : "no (copied)",
+             dst_wrapped ? "yes" : "no (copied)");
+    }
+    printf("\n");
+  }
+  clbench_print_speedup(&results[0], &results[1]);
 
-  if (context != 0)
-    clReleaseContext(context);
+  char* bench_out = getenv("BENCH_OUT");
+  if (bench_out != NULL && !clbench_write(bench_out, results, 2)) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", bench_out);
+  }
+  return run.host->failures() > 0 ? 1 : 0;
 }
 
 int
 main(int argc, char** argv)
 {
+  cltrace_config();
+
   size_t vector_len = 65536;
   char* vector_str = getenv("VECTOR");
   if (vector_str != NULL) {
     vector_len = atoi(vector_str);
   }
   printf("vector_len: %ld\n", vector_len);
+  char* sweep_str = getenv("SWEEP");
+  struct SweepRange range;
+  bool sweep = false;
+  if (sweep_str != NULL) {
+    if (!clbench_parse_sweep(sweep_str, &range)) {
+      printf("not recognized sweep (min:max:factor, factor > 1)\n");
+      exit(1);
+    }
+    sweep = true;
+    vector_len = range.min;
+    printf("sweep: %ld..%ld (x%g)\n", range.min, range.max, range.factor);
+  }
   char* check_str = getenv("CHECK");
   bool check_res = false;
   if (check_str != NULL && atoi(check_str) > 0) {
@@ -348,9 +2688,74 @@ main(int argc, char** argv)
   }
   printf("factor: %f\n", factor);
 
+  enum clrt::HostIsa host_isa;
+  int host_threads;
+  if (!clrt::host_config(&host_isa, &host_threads)) {
+    printf("not recognized host isa (AUTO|SCALAR|AVX2|AVX512|NEON)\n");
+    exit(1);
+  }
+  clrt::HostEngine host(host_isa, host_threads);
+  struct clrt::VerifyConfig verify;
+  clrt::verify_config(&verify);
+  host.set_verify(verify);
+  char host_name[64];
+  host.name(host_name, sizeof(host_name));
+  printf("host: %s\n", host_name);
+
+  char* transfer_str = getenv("TRANSFER");
+  enum Transfer transfer = TRANSFER_ELEMENT;
+  if (transfer_str != NULL) {
+    if (strcmp(transfer_str, "ELEMENT") == 0) {
+      transfer = TRANSFER_ELEMENT;
+    } else if (strcmp(transfer_str, "CHUNK") == 0) {
+      transfer = TRANSFER_CHUNK;
+    } else if (strcmp(transfer_str, "BULK") == 0) {
+      transfer = TRANSFER_BULK;
+    } else {
+      printf("not recognized transfer (ELEMENT|CHUNK|BULK)\n");
+      exit(1);
+    }
+  }
+  // Elements per clEnqueue{Write,Read}Buffer call
+  size_t chunk_len = 4096;
+  char* chunk_str = getenv("CHUNK");
+  if (chunk_str != NULL && atol(chunk_str) > 0) {
+    chunk_len = atol(chunk_str);
+  }
+  if (transfer == TRANSFER_ELEMENT) {
+    chunk_len = 1;
+  } else if (transfer == TRANSFER_BULK) {
+    chunk_len = vector_len;
+  }
+  printf("transfer: %s (chunk: %ld)\n",
+         transfer == TRANSFER_ELEMENT ? "element"
+         : transfer == TRANSFER_CHUNK ? "chunk"
+                                      : "bulk",
+         chunk_len);
+
+  char* memory_str = getenv("MEMORY");
+  enum MemoryMode memory = MEMORY_COPY;
+  if (memory_str != NULL && !clbuf_parse_mode(memory_str, &memory)) {
+    printf("not recognized memory (COPY|USE_HOST_PTR|ALLOC_HOST_PTR|SVM)\n");
+    exit(1);
+  }
+  printf("memory: %s\n", clbuf_mode_name(memory));
+
+  enum DataType dtype;
+  if (!cldtype_config(&dtype)) {
+    printf("not recognized dtype (f16|f32|f64)\n");
+    exit(1);
+  }
+  printf("dtype: %s\n", cldtype_name(dtype));
+
+  enum QueueMode queue_mode;
+  if (!clbench_queue_config(&queue_mode)) {
+    printf("not recognized queue (BLOCKING|IN_ORDER|OUT_OF_ORDER)\n");
+    exit(1);
+  }
+
   char* platform_str = getenv("PLATFORM");
   char* device_str = getenv("DEVICE");
-  cl_device_type deviceType = CL_DEVICE_TYPE_ALL;
   int platformId = 0;
   int deviceId = 0;
   if (platform_str != NULL) {
@@ -361,6 +2766,22 @@ main(int argc, char** argv)
   }
   printf("using platform.device: %d.%d\n", platformId, deviceId);
 
+  // A chain of operations instead of a kernel file
+  char* pipeline_str = getenv("PIPELINE");
+  if (pipeline_str != NULL) {
+    if (dtype != DTYPE_F32) {
+      printf("pipeline: DTYPE is ignored\n");
+    }
+    return PipelineMain(pipeline_str,
+                        &host,
+                        platformId,
+                        deviceId,
+                        vector_len,
+                        fill,
+                        factor,
+                        check_res);
+  }
+
   char* kernelfile;
   if (argc >= 2) {
     kernelfile = argv[1];
@@ -371,24 +2792,100 @@ main(int argc, char** argv)
   printf("%s\n", kernelfile);
 
   enum Operation op;
-  char operation[6];
-  memcpy(operation, kernelfile, 5);
-  operation[5] = '\0';
-  if (strcmp(operation, "saxpy") == 0) {
-    op = OP_SAXPY;
-    printf("operation: saxpy\n");
-  } else {
-    operation[4] = '\0';
-    if (strcmp(operation, "dsum") == 0) {
-      op = OP_DSUM;
-      printf("operation: dsum\n");
-    } else if (strcmp(operation, "dmul") == 0) {
-      op = OP_DMUL;
-      printf("operation: dmul\n");
-    } else {
-      printf("not recognized operation (saxpy|dsum|dmul) in kernelfile\n");
+  const char* operation = ParseOperation(kernelfile, &op);
+  if (operation == NULL) {
+    printf("not recognized operation "
+           "(saxpy|dsum|dmul|dot|sum|minmax|scan) in kernelfile\n");
+    exit(1);
+  }
+  printf("operation: %s\n", operation);
+
+  // Reductions and scan have their own harness on one device
+  if (op >= OP_DOT) {
+    if (dtype != DTYPE_F32) {
+      printf("%s: DTYPE is ignored\n", operation);
+    }
+    struct SaxpyRun base = {};
+    base.op = op;
+    base.operation = operation;
+    base.fill = fill;
+    base.check_res = check_res;
+    base.host = &host;
+    clbench_config(&base.iterations, &base.warmup);
+    if (!cltune_config(&base.local_config)) {
+      printf("not recognized local work size (DRIVER|AUTO|<n>)\n");
+      exit(1);
+    }
+    return ReduceMain(&base,
+                      kernelfile,
+                      platformId,
+                      deviceId,
+                      vector_len,
+                      sweep ? &range : NULL);
+  }
+
+  // Many small jobs in one launch, on one device
+  if (strstr(kernelfile, ".batch.") != NULL) {
+    struct BatchConfig batch;
+    if (!clbatch_config(&batch)) {
+      printf("not recognized batch job length (min:max, with BATCH * max "
+             "elements at most INT_MAX)\n");
+      exit(1);
+    }
+    struct SaxpyRun base = {};
+    base.op = op;
+    base.operation = operation;
+    base.fill = fill;
+    base.factor = factor;
+    base.check_res = check_res;
+    base.host = &host;
+    clbench_config(&base.iterations, &base.warmup);
+    if (!cltune_config(&base.local_config)) {
+      printf("not recognized local work size (DRIVER|AUTO|<n>)\n");
+      exit(1);
+    }
+    return BatchMain(&base, kernelfile, platformId, deviceId, &batch);
+  }
+
+  // The vectors of another process, mapped or read
+  const char* input_spec;
+  const char* output_spec;
+  clshm_config(&input_spec, &output_spec);
+  if (input_spec != NULL) {
+    struct SaxpyRun base = {};
+    base.op = op;
+    base.operation = operation;
+    base.factor = factor;
+    base.check_res = check_res;
+    base.host = &host;
+    clbench_config(&base.iterations, &base.warmup);
+    return SharedMain(&base,
+                      kernelfile,
+                      platformId,
+                      deviceId,
+                      vector_len,
+                      input_spec,
+                      output_spec);
+  }
+
+  // The host engine instead of an OpenCL device
+  char* backend_str = getenv("BACKEND");
+  if (backend_str != NULL && strcmp(backend_str, "OPENCL") != 0) {
+    if (strcmp(backend_str, "HOST") != 0) {
+      printf("not recognized backend (OPENCL|HOST)\n");
       exit(1);
     }
+    if (dtype != DTYPE_F32) {
+      printf("host backend: DTYPE is ignored\n");
+    }
+    struct SaxpyRun base = {};
+    base.op = op;
+    base.operation = operation;
+    base.fill = fill;
+    base.factor = factor;
+    base.host = &host;
+    clbench_config(&base.iterations, &base.warmup);
+    return HostMain(&base, vector_len, sweep ? &range : NULL);
   }
 
   fflush(stdout);
@@ -420,267 +2917,232 @@ main(int argc, char** argv)
   // putenv("LTDL_LIBRARY_PATH=/scratch/colins/build/linux/fs/lib");
   // lt_dlsetsearchpath("/scratch/colins/build/linux/fs/lib");
   // printf("SEARCH_PATH:%s\n",lt_dlgetsearchpath());
-  cl_platform_id platforms[100];
-  cl_uint platforms_n = 0;
-  CL_CHECK(clGetPlatformIDs(100, platforms, &platforms_n));
-
-  printf("=== %d OpenCL platform(s) found: ===\n", platforms_n);
-  int buff_size = 10240;
-  char buffer[buff_size];
-  for (unsigned int i = 0; i < platforms_n; i++) {
-    printf("  -- %d --\n", i);
-    CL_CHECK(clGetPlatformInfo(
-      platforms[i], CL_PLATFORM_PROFILE, buff_size, buffer, NULL));
-    printf("  PROFILE = %s\n", buffer);
-    CL_CHECK(clGetPlatformInfo(
-      platforms[i], CL_PLATFORM_VERSION, buff_size, buffer, NULL));
-    printf("  VERSION = %s\n", buffer);
-    CL_CHECK(clGetPlatformInfo(
-      platforms[i], CL_PLATFORM_NAME, buff_size, buffer, NULL));
-    printf("  NAME = %s\n", buffer);
-    CL_CHECK(clGetPlatformInfo(
-      platforms[i], CL_PLATFORM_VENDOR, buff_size, buffer, NULL));
-    printf("  VENDOR = %s\n", buffer);
-    CL_CHECK(clGetPlatformInfo(
-      platforms[i], CL_PLATFORM_EXTENSIONS, buff_size, buffer, NULL));
-    printf("  EXTENSIONS = %s\n", buffer);
-  }
-
-  if (platforms_n == 0)
-    return 1;
+  enum MultiMode multi_mode;
+  size_t calibrate_len;
+  if (!clmulti_config(&multi_mode, &calibrate_len)) {
+    printf("not recognized multi-device mode (PLATFORM|ALL)\n");
+    exit(1);
+  }
+  struct SchedConfig sched = { false, 262144, 1 };
+  char* schedule_str = getenv("SCHEDULE");
+  if (schedule_str != NULL && strcmp(schedule_str, "DYNAMIC") == 0) {
+    sched.dynamic = true;
+  } else if (schedule_str != NULL && strcmp(schedule_str, "STATIC") != 0) {
+    printf("not recognized schedule (STATIC|DYNAMIC)\n");
+    exit(1);
+  }
+  char* sched_chunk_str = getenv("SCHED_CHUNK");
+  if (sched_chunk_str != NULL && atol(sched_chunk_str) > 0) {
+    sched.chunk_len = atol(sched_chunk_str);
+  }
+  char* sched_queues_str = getenv("SCHED_QUEUES");
+  if (sched_queues_str != NULL && atoi(sched_queues_str) > 0) {
+    sched.queues = atoi(sched_queues_str);
+  }
+  if (multi_mode != MULTI_OFF || sched.dynamic) {
+    struct SaxpyRun base = {};
+    base.op = op;
+    base.operation = operation;
+    base.fill = fill;
+    base.factor = factor;
+    base.check_res = check_res;
+    base.host = &host;
+    clbench_config(&base.iterations, &base.warmup);
+    int status = MultiMain(multi_mode,
+                           platformId,
+                           deviceId,
+                           &base,
+                           kernelfile,
+                           vector_len,
+                           calibrate_len,
+                           &sched);
+    return host.failures() > 0 ? 1 : status;
+  }
 
-  cl_device_id devices[100];
-  cl_uint devices_n = 0;
-  // CL_CHECK(clGetDeviceIDs(NULL, CL_DEVICE_TYPE_ALL, 100, devices,
-  // &devices_n));
-  CL_CHECK(clGetDeviceIDs(
-    platforms[platformId], deviceType, 100, devices, &devices_n));
-
-  printf("=== %d OpenCL device(s) found on platform:\n", platforms_n);
-  for (unsigned int i = 0; i < devices_n; i++) {
-    cl_uint buf_uint;
-    cl_ulong buf_ulong;
-    size_t wi_size[3];
-    printf("  -- %d --\n", i);
-    CL_CHECK(clGetDeviceInfo(
-      devices[i], CL_DEVICE_NAME, sizeof(buffer), buffer, NULL));
-    printf("  DEVICE_NAME = %s\n", buffer);
-    CL_CHECK(clGetDeviceInfo(
-      devices[i], CL_DEVICE_VENDOR, sizeof(buffer), buffer, NULL));
-    printf("  DEVICE_VENDOR = %s\n", buffer);
-    CL_CHECK(clGetDeviceInfo(
-      devices[i], CL_DEVICE_VERSION, sizeof(buffer), buffer, NULL));
-    printf("  DEVICE_VERSION = %s\n", buffer);
-    CL_CHECK(clGetDeviceInfo(
-      devices[i], CL_DRIVER_VERSION, sizeof(buffer), buffer, NULL));
-    printf("  DRIVER_VERSION = %s\n", buffer);
-    CL_CHECK(clGetDeviceInfo(devices[i],
-                             CL_DEVICE_MAX_COMPUTE_UNITS,
-                             sizeof(buf_uint),
-                             &buf_uint,
-                             NULL));
-    printf("  DEVICE_MAX_COMPUTE_UNITS = %u\n", (unsigned int)buf_uint);
-    CL_CHECK(clGetDeviceInfo(devices[i],
-                             CL_DEVICE_MAX_CLOCK_FREQUENCY,
-                             sizeof(buf_uint),
-                             &buf_uint,
-                             NULL));
-    printf("  DEVICE_MAX_CLOCK_FREQUENCY = %u\n", (unsigned int)buf_uint);
-    CL_CHECK(clGetDeviceInfo(devices[i],
-                             CL_DEVICE_GLOBAL_MEM_SIZE,
-                             sizeof(buf_ulong),
-                             &buf_ulong,
-                             NULL));
-    printf("  DEVICE_GLOBAL_MEM_SIZE = %llu\n", (unsigned long long)buf_ulong);
-    CL_CHECK(clGetDeviceInfo(devices[i],
-                             CL_DEVICE_MAX_WORK_ITEM_SIZES,
-                             sizeof(wi_size),
-                             &wi_size,
-                             NULL));
-    printf("  DEVICE_MAX_WG_SIZE X=%ld,Y=%ld,Z=%ld\n",
-           wi_size[0],
-           wi_size[1],
-           wi_size[2]);
-  }
-
-  if (devices_n == 0)
+  cl_device_id device = clrt::select_device(platformId, deviceId, true);
+  if (device == NULL) {
     return 1;
+  }
+  bool dtype_native;
+  if (!cldtype_supported(device, dtype, &dtype_native)) {
+    printf("%s is not supported by the device (cl_khr_fp64)\n",
+           cldtype_name(dtype));
+    return 1;
+  }
+  if (dtype == DTYPE_F16) {
+    printf("f16: half storage, float compute (cl_khr_fp16: %s)\n",
+           dtype_native ? "yes" : "no");
+  }
+  host.set_storage(dtype);
 
-  printf("Creating context...\n");
-  cl_context context;
-  context = CL_CHECK_ERR(
-    clCreateContext(NULL, 1, &devices[deviceId], &pfn_notify, NULL, &_err));
-
-  printf("Creating command queue...\n");
-  cl_command_queue queue;
-  const cl_queue_properties qproperties[] = { CL_QUEUE_PROPERTIES,
-                                              CL_QUEUE_PROFILING_ENABLE,
-                                              0 };
-  queue = CL_CHECK_ERR(clCreateCommandQueueWithProperties(
-    context, devices[deviceId], qproperties, &_err));
-  // queue = CL_CHECK_ERR(clCreateCommandQueue(context, devices[deviceId], 0,
-  // &_err)); queue = CL_CHECK_ERR(clCreateCommandQueueWithProperties(context,
-  // devices[deviceId], NULL, &_err));
-  // cl_int st;
-  // queue = clCreateCommandQueueWithProperties(context, devices[deviceId],
-  // NULL, &st);
+  printf("Creating context and command queue...\n");
+  size_t pool_arena;
+  int pool_bench;
+  clrt::pool_config(&pool_arena, &pool_bench);
+  clrt::Runtime rt(device, &queue_mode, pool_arena);
+  cl_context context = rt.context();
+  cl_command_queue queue = rt.queue();
+  printf("queue: %s\n", clbench_queue_name(queue_mode));
 
   printf("Creating program...\n");
-  cl_kernel kernel = 0;
-  cl_mem memObjects[2] = { 0, 0 };
+  struct SaxpyRun run;
+  run.device = device;
+  run.queue = queue;
+  run.queue_mode = queue_mode;
+  run.op = op;
+  run.operation = operation;
+  run.memory = memory;
+  run.transfer = transfer;
+  run.chunk_len = chunk_len;
+  run.fill = fill;
+  run.factor = factor;
+  run.dtype = dtype;
+  run.check_res = check_res;
+  run.host = &host;
+  clbench_config(&run.iterations, &run.warmup);
+  if (!cltune_config(&run.local_config)) {
+    printf("not recognized local work size (DRIVER|AUTO|<n>)\n");
+    exit(1);
+  }
 
-  std::cout << "Building program from source..." << std::endl;
-  cl_program program;
-  program = CreateProgram(context, devices[deviceId], kernelfile);
-  if (program == NULL) {
-    Cleanup(context, queue, program, kernel, memObjects);
+  // Allocation latency of the buffers of each vector length, instead of a
+  // run
+  if (pool_bench > 0) {
+    for (size_t len = vector_len; len != 0;
+         len = sweep ? clbench_sweep_next(&range, len) : 0) {
+      clrt::pool_bench(context,
+                       queue,
+                       cldtype_size(dtype) * len,
+                       pool_bench,
+                       run.iterations,
+                       pool_arena);
+    }
+    return 0;
+  }
+
+  struct SaxpyKernel kern;
+  if (!CreateSaxpyKernel(
+        &rt.programs(), context, &run, kernelfile, 0, &kern)) {
     return 1;
   }
-  // Create OpenCL program - first attempt to load cached binary.
-  //  If that is not available, then create the program from source
-  //  and store the binary for future use.
-  // std::cout << "Attempting to create program from binary..." << std::endl;
-  // cl_program program = CreateProgramFromBinary(context, devices[deviceId],
-  // "kernel.cl.bin"); if (program == NULL)
-  //{
-  //    std::cout << "Binary not loaded, create from source..." << std::endl;
-  //    program = CreateProgram(context, devices[deviceId], "kernel.cl");
-  //    if (program == NULL)
-  //    {
-  //        Cleanup(context, queue, program, kernel, memObjects);
-  //        return 1;
-  //    }
-
-  //    std::cout << "Save program binary for future run..." << std::endl;
-  //    if (SaveProgramBinary(program, devices[deviceId], "kernel.cl.bin") ==
-  //    false)
-  //    {
-  //        std::cerr << "Failed to write program binary" << std::endl;
-  //        Cleanup(context, queue, program, kernel, memObjects);
-  //        return 1;
-  //    }
-  //}
-  // else
-  //{
-  //    std::cout << "Read program from binary." << std::endl;
-  //}
+  // Same operation from another kernel file, to compare against
+  struct SaxpyKernel base;
+  char* baseline_str = getenv("BASELINE");
+  if (baseline_str != NULL) {
+    if (strncmp(baseline_str, operation, strlen(operation)) != 0) {
+      printf("baseline %s is not a %s kernel\n", baseline_str, operation);
+      exit(1);
+    }
+    if (!CreateSaxpyKernel(
+          &rt.programs(), context, &run, baseline_str, 0, &base)) {
+      return 1;
+    }
+  }
 
   printf("attempting to create input buffer\n");
   fflush(stdout);
-  cl_mem input_buffer;
-  input_buffer = CL_CHECK_ERR(clCreateBuffer(
-    context, CL_MEM_READ_ONLY, sizeof(float) * vector_len, NULL, &_err));
+  CL_CHECK(clbuf_create(&run.input_buffer,
+                        context,
+                        memory,
+                        CL_MEM_READ_ONLY,
+                        cldtype_size(dtype) * vector_len));
 
   printf("attempting to create output buffer\n");
   fflush(stdout);
-  cl_mem output_buffer;
-  output_buffer = CL_CHECK_ERR(clCreateBuffer(
-    context, CL_MEM_WRITE_ONLY, sizeof(float) * vector_len, NULL, &_err));
-
-  memObjects[0] = input_buffer;
-  memObjects[1] = output_buffer;
-
-  printf("attempting to create kernel\n");
-  fflush(stdout);
-  kernel = CL_CHECK_ERR(clCreateKernel(program, operation, &_err));
-  printf("setting up kernel args cl_mem: %p \n", input_buffer);
-  fflush(stdout);
-  CL_CHECK(clSetKernelArg(kernel, 0, sizeof(input_buffer), &input_buffer));
-  CL_CHECK(clSetKernelArg(kernel, 1, sizeof(output_buffer), &output_buffer));
-  CL_CHECK(clSetKernelArg(kernel, 2, sizeof(factor), &factor));
-
-  float* arr1 = (float*)malloc(sizeof(float) * vector_len);
-
-  printf("attempting to enqueue write buffer\n");
-  fflush(stdout);
-
-  for (size_t i = 0; i < vector_len; i++) {
-    float in;
-    if (fill == FILL_INDEX) {
-      in = (float)i;
-    } else {
-      in = ((float)rand() / (float)(RAND_MAX)) * 100.0;
+  CL_CHECK(clbuf_create(&run.output_buffer,
+                        context,
+                        memory,
+                        CL_MEM_READ_WRITE,
+                        cldtype_size(dtype) * vector_len));
+
+
+  // SPECIALIZE: the kernel again, built for the factor and each length
+  char* specialize_str = getenv("SPECIALIZE");
+  bool specialize = specialize_str != NULL && atoi(specialize_str) != 0;
+
+  // With a baseline, its results follow the ones of the kernel, and the
+  // specialized ones follow both
+  size_t n_sizes = 1;
+  if (sweep) {
+    n_sizes = 0;
+    for (size_t len = range.min; len != 0;
+         len = clbench_sweep_next(&range, len)) {
+      n_sizes++;
     }
-    arr1[i] = in;
-    CL_CHECK(clEnqueueWriteBuffer(
-      queue, input_buffer, CL_TRUE, i * sizeof(float), 4, &in, 0, NULL, NULL));
   }
-
-  cl_event kernel_completion;
-  size_t global_work_size[1] = { vector_len };
-  printf("attempting to enqueue kernel\n");
-  fflush(stdout);
-  CL_CHECK(clEnqueueNDRangeKernel(queue,
-                                  kernel,
-                                  1,
-                                  NULL,
-                                  global_work_size,
-                                  NULL,
-                                  0,
-                                  NULL,
-                                  &kernel_completion));
-  printf("Enqueue'd kerenel\n");
-  fflush(stdout);
-  cl_ulong time_start, time_end;
-  CL_CHECK(clWaitForEvents(1, &kernel_completion));
-  CL_CHECK(clGetEventProfilingInfo(kernel_completion,
-                                   CL_PROFILING_COMMAND_START,
-                                   sizeof(time_start),
-                                   &time_start,
-                                   NULL));
-  CL_CHECK(clGetEventProfilingInfo(kernel_completion,
-                                   CL_PROFILING_COMMAND_END,
-                                   sizeof(time_end),
-                                   &time_end,
-                                   NULL));
-  double elapsed = time_end - time_start;
-  printf("time(ns):%lg\n", elapsed);
-  CL_CHECK(clReleaseEvent(kernel_completion));
-
-  printf("Result:\n");
-  int show = 3;
-  for (size_t i = 0; i < vector_len; i++) {
-    float data;
-    CL_CHECK(clEnqueueReadBuffer(queue,
-                                 output_buffer,
-                                 CL_TRUE,
-                                 i * sizeof(float),
-                                 4,
-                                 &data,
-                                 0,
-                                 NULL,
-                                 NULL));
-    if (check_res) {
-      float comp;
-      if (op == OP_SAXPY) {
-        comp = arr1[i] * factor;
-      } else if (op == OP_DSUM) {
-        comp = arr1[i] + arr1[i];
-      } else if (op == OP_DMUL) {
-        comp = 2.0f * arr1[i];
-      }
-      // float comp = arr1[i] + arr1[i];
-      if (show > 0) {
-        printf("[%ld] Host: %.6f  Device: %.6f\n", i, comp, data);
-        show--;
+  size_t n_results = baseline_str != NULL ? 2 * n_sizes : n_sizes;
+  struct BenchResult* spec_results = NULL;
+  if (specialize) {
+    n_results += n_sizes;
+  }
+  struct BenchResult* results =
+    (struct BenchResult*)malloc(sizeof(struct BenchResult) * n_results);
+  struct BenchResult* base_results = &results[n_sizes];
+  if (specialize) {
+    spec_results = &results[n_results - n_sizes];
+  }
+  if (sweep) {
+    double* host_ns = (double*)malloc(sizeof(double) * n_sizes);
+    size_t i = 0;
+    for (size_t len = range.min; len != 0;
+         len = clbench_sweep_next(&range, len)) {
+      printf("=== vector_len: %ld ===\n", len);
+      RunVector(&run, &kern, len, &results[i]);
+      if (baseline_str != NULL) {
+        RunVector(&run, &base, len, &base_results[i]);
       }
-      if (comp != data) {
-        printf("[FAILURE] at index %ld:  %.6f != %.6f\n", i, comp, data);
-        // exit(1);
+      if (specialize && !RunSpecialized(&rt.programs(),
+                                        context,
+                                        &run,
+                                        kernelfile,
+                                        len,
+                                        &spec_results[i])) {
+        return 1;
       }
+      host_ns[i] = HostTime(&run, len);
+      i++;
+    }
+    printf("=== sweep ===\n");
+    clbench_print_sweep(results, host_ns, n_sizes);
+    free(host_ns);
+  } else {
+    RunVector(&run, &kern, vector_len, &results[0]);
+    if (baseline_str != NULL) {
+      RunVector(&run, &base, vector_len, &base_results[0]);
+    }
+    if (specialize && !RunSpecialized(&rt.programs(),
+                                      context,
+                                      &run,
+                                      kernelfile,
+                                      vector_len,
+                                      &spec_results[0])) {
+      return 1;
+    }
+  }
+  if (baseline_str != NULL) {
+    for (size_t i = 0; i < n_sizes; i++) {
+      clbench_print_speedup(&results[i], &base_results[i]);
+    }
+  }
+  // Specialized over generic
+  if (specialize) {
+    for (size_t i = 0; i < n_sizes; i++) {
+      clbench_print_speedup(&spec_results[i], &results[i]);
     }
-    // printf(" %f", data);
   }
-  printf("\n");
-
-  printf("computed %ld elements\n", vector_len);
 
-  CL_CHECK(clReleaseMemObject(memObjects[0]));
-  CL_CHECK(clReleaseMemObject(memObjects[1]));
+  char* bench_out = getenv("BENCH_OUT");
+  if (bench_out != NULL && !clbench_write(bench_out, results, n_results)) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", bench_out);
+  }
+  for (size_t i = 0; i < n_results; i++) {
+    free((void*)results[i].samples);
+  }
+  free(results);
 
-  CL_CHECK(clReleaseKernel(kernel));
-  CL_CHECK(clReleaseProgram(program));
-  CL_CHECK(clReleaseContext(context));
+  clbuf_release(&run.input_buffer);
+  clbuf_release(&run.output_buffer);
 
-  return 0;
+  // CHECK failures make the run fail
+  return host.failures() > 0 ? 1 : 0;
 }
@@ -0,0 +1,12 @@
+// From clrt::kernel_preamble: N, FACTOR, DATA, LOAD and STORE
+
+// Grid-stride loop: each work-item handles elements i, i + global size, ...
+// so the host can launch a few work-items per compute unit whatever n is
+__kernel void
+saxpy(__global DATA* src, __global DATA* dst, float factor, int n)
+{
+  int stride = get_global_size(0);
+  for (int i = get_global_id(0); i < N; i += stride) {
+    STORE(LOAD(i, dst) + LOAD(i, src) * FACTOR, i, dst);
+  }
+}
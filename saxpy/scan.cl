@@ -0,0 +1,74 @@
+// Inclusive prefix sum (Blelloch). scan() scans blocks of 2 * local size
+// elements in local memory, two per work-item: an up-sweep builds the
+// partial sums of a balanced tree in place, a down-sweep turns them into
+// exclusive prefix sums. It writes the total of every block to sums. The
+// host scans sums the same way (recursively, until a single block is left)
+// and scan_add() adds to every block the scanned total of the blocks before
+// it. x and y may be the same buffer. The local size is a power of two.
+__kernel void
+scan(__global const float* x,
+     __global float* y,
+     __global float* sums,
+     int n,
+     __local float* tmp)
+{
+  int lid = get_local_id(0);
+  int span = get_local_size(0);
+  int m = 2 * span;
+  int base = get_group_id(0) * m;
+  float a = base + lid < n ? x[base + lid] : 0.0f;
+  float b = base + lid + span < n ? x[base + lid + span] : 0.0f;
+  tmp[lid] = a;
+  tmp[lid + span] = b;
+
+  int offset = 1;
+  for (int d = span; d > 0; d /= 2) {
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid < d) {
+      tmp[offset * (2 * lid + 2) - 1] += tmp[offset * (2 * lid + 1) - 1];
+    }
+    offset *= 2;
+  }
+  if (lid == 0) {
+    sums[get_group_id(0)] = tmp[m - 1];
+    tmp[m - 1] = 0.0f;
+  }
+  for (int d = 1; d < m; d *= 2) {
+    offset /= 2;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid < d) {
+      int i = offset * (2 * lid + 1) - 1;
+      int j = offset * (2 * lid + 2) - 1;
+      float t = tmp[i];
+      tmp[i] = tmp[j];
+      tmp[j] += t;
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (base + lid < n) {
+    y[base + lid] = tmp[lid] + a;
+  }
+  if (base + lid + span < n) {
+    y[base + lid + span] = tmp[lid + span] + b;
+  }
+}
+
+// sums: the inclusive scan of the block totals
+__kernel void
+scan_add(__global float* y, __global const float* sums, int n)
+{
+  int group = get_group_id(0);
+  if (group == 0) {
+    return;
+  }
+  int span = get_local_size(0);
+  float offset = sums[group - 1];
+  int i = group * 2 * span + get_local_id(0);
+  if (i < n) {
+    y[i] += offset;
+  }
+  if (i + span < n) {
+    y[i + span] += offset;
+  }
+}
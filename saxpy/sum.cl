@@ -0,0 +1,75 @@
+// Two-stage sum: sum() accumulates a grid-stride slice of x per work-item,
+// reduces the work-group in local memory and writes one partial sum per
+// work-group; sum_final() reduces the partial sums with a single work-group.
+// The local size is a power of two.
+//
+// Built with -DSUBGROUPS (devices with cl_khr_subgroups), each sub-group
+// reduces in registers and local memory holds one value per sub-group.
+#ifdef SUBGROUPS
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#endif
+
+// The sum of x over the work-group, in work-item 0
+float
+group_sum(float x, __local float* scratch)
+{
+#ifdef SUBGROUPS
+  x = sub_group_reduce_add(x);
+  if (get_sub_group_local_id() == 0) {
+    scratch[get_sub_group_id()] = x;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  x = 0.0f;
+  if (get_sub_group_id() == 0) {
+    for (uint i = get_sub_group_local_id(); i < get_num_sub_groups();
+         i += get_sub_group_size()) {
+      x += scratch[i];
+    }
+    x = sub_group_reduce_add(x);
+  }
+  return x;
+#else
+  uint lid = get_local_id(0);
+  scratch[lid] = x;
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (uint s = get_local_size(0) / 2; s > 0; s /= 2) {
+    if (lid < s) {
+      scratch[lid] += scratch[lid + s];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+  return scratch[0];
+#endif
+}
+
+__kernel void
+sum(__global const float* x,
+    __global float* partial,
+    int n,
+    __local float* scratch)
+{
+  float acc = 0.0f;
+  for (int i = get_global_id(0); i < n; i += get_global_size(0)) {
+    acc += x[i];
+  }
+  acc = group_sum(acc, scratch);
+  if (get_local_id(0) == 0) {
+    partial[get_group_id(0)] = acc;
+  }
+}
+
+__kernel void
+sum_final(__global const float* partial,
+          __global float* out,
+          int n,
+          __local float* scratch)
+{
+  float acc = 0.0f;
+  for (int i = get_local_id(0); i < n; i += get_local_size(0)) {
+    acc += partial[i];
+  }
+  acc = group_sum(acc, scratch);
+  if (get_local_id(0) == 0) {
+    out[0] = acc;
+  }
+}
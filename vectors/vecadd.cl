@@ -1,6 +1,13 @@
+// From clrt::kernel_preamble: DATA, LOAD and STORE
+
 __kernel void
-vecadd(__global const float* a, __global const float* b, __global float* c)
+vecadd(__global const DATA* a,
+       __global const DATA* b,
+       __global DATA* c,
+       int n)
 {
   int gid = get_global_id(0);
-  c[gid] = a[gid] + b[gid];
+  if (gid < n) {
+    STORE(LOAD(gid, a) + LOAD(gid, b), gid, c);
+  }
 }
@@ -0,0 +1,41 @@
+// From clrt::kernel_preamble: DATA, REAL, LOAD and STORE
+
+// Elements per work-item, set by the host (-DVW=<n>): 1, 2, 4, 8 or 16
+#ifndef VW
+#define VW 4
+#endif
+
+#define CAT_(a, b) a##b
+#define CAT(a, b) CAT_(a, b)
+
+#if VW == 1
+#define REALN REAL
+#define LOADN(i, p) LOAD(i, p)
+#define STOREN(v, i, p) STORE(v, i, p)
+#elif defined(DTYPE_F16)
+#define REALN CAT(float, VW)
+#define LOADN(i, p) CAT(vload_half, VW)(i, p)
+#define STOREN(v, i, p) CAT(vstore_half, VW)(v, i, p)
+#else
+#define REALN CAT(REAL, VW)
+#define LOADN(i, p) CAT(vload, VW)(i, p)
+#define STOREN(v, i, p) CAT(vstore, VW)(v, i, p)
+#endif
+
+// Work-item i handles elements [i * VW, (i + 1) * VW). The one straddling n
+// handles the n % VW remaining elements one at a time.
+__kernel void
+vecadd(__global const DATA* a,
+       __global const DATA* b,
+       __global DATA* c,
+       int n)
+{
+  int i = get_global_id(0);
+  if ((i + 1) * VW <= n) {
+    STOREN(LOADN(i, a) + LOADN(i, b), i, c);
+  } else {
+    for (int j = i * VW; j < n; j++) {
+      STORE(LOAD(j, a) + LOAD(j, b), j, c);
+    }
+  }
+}
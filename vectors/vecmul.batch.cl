@@ -0,0 +1,18 @@
+// Batched jobs: job j is elements [offsets[j], offsets[j + 1]) of the packed
+// vectors. Work-groups take the jobs in turn and their work-items stride
+// over the elements of a job, so a few hundred elements fill a work-group.
+__kernel void
+vecmul(__global const float* a,
+       __global const float* b,
+       __global float* c,
+       __global const int* offsets,
+       int jobs)
+{
+  for (int job = get_group_id(0); job < jobs; job += get_num_groups(0)) {
+    int end = offsets[job + 1];
+    for (int i = offsets[job] + get_local_id(0); i < end;
+         i += get_local_size(0)) {
+      c[i] = a[i] * b[i];
+    }
+  }
+}
@@ -0,0 +1,15 @@
+// From clrt::kernel_preamble: DATA, LOAD and STORE
+
+// Grid-stride loop: each work-item handles elements i, i + global size, ...
+// so the host can launch a few work-items per compute unit whatever n is
+__kernel void
+vecmul(__global const DATA* a,
+       __global const DATA* b,
+       __global DATA* c,
+       int n)
+{
+  int stride = get_global_size(0);
+  for (int i = get_global_id(0); i < n; i += stride) {
+    STORE(LOAD(i, a) * LOAD(i, b), i, c);
+  }
+}
@@ -0,0 +1,1878 @@
+/*
+
+Sources:
+http://www.eriksmistad.no/getting-started-with-opencl-and-gpu-computing/
+
+*/
+
+// openCL headers
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <algorithm>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "clbatch.h"
+#include "clbench.h"
+#include "clcache.h"
+#include "clcheck.h"
+#include "cldtype.h"
+#include "clhost.hpp"
+#include "clmem.h"
+#include "clmulti.h"
+#include "clrt.hpp"
+#include "clshm.h"
+#include "cltime.h"
+#include "cltrace.h"
+#include "cltune.h"
+
+#define STREAM_CHUNK_DEFAULT (1 << 20)
+#define STREAM_MAX_SETS 3
+
+enum Operation
+{
+  OP_ADD,
+  OP_MUL,
+};
+
+///
+//  One stage of the STREAM pipeline: a queue and device buffers for a chunk
+//
+struct StreamSet
+{
+  clrt::Queue queue;
+  clrt::Mem a, b, c;
+};
+
+///
+//  Everything a run needs besides the vector length: a SWEEP reuses it
+//  (context, queue, program and buffers) across sizes
+//
+struct VectorsRun
+{
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  enum QueueMode queueMode;
+  enum Operation op;
+  const char* operation;
+  enum DataType dtype; // of aBuf, bBuf and cBuf; the host side stays float
+  bool check_res;
+  clrt::HostEngine* host; // CHECK reference and HostTime
+  int iterations;
+  int warmup;
+  struct LocalConfig localConfig;
+  struct ClBuffer aBuf, bBuf, cBuf;
+  // STREAM mode: chunks go through streamSets sets in turn, from/to whole
+  // host vectors of hostLen elements
+  int streamSets;
+  size_t streamChunk;
+  struct StreamSet sets[STREAM_MAX_SETS];
+  float* hostA;
+  float* hostB;
+  float* hostC;
+  size_t hostLen;
+};
+
+///
+//  A kernel file built for the run. *.vec.cl kernels are built with
+//  -DVW=<width> and process width elements per work-item; *.gs.cl kernels
+//  loop over the vector with a grid stride.
+//
+struct VectorsKernel
+{
+  clrt::Program program;
+  clrt::Kernel kernel;
+  char label[256]; // kernel file and build options, for the results
+  int width;
+  bool grid_stride;
+  bool bounds; // the kernel takes the vector length and can be padded
+};
+
+///
+//  Build kernelfile on the context of the run (through the program caches)
+//  and create its kernel, for the element type of the run
+//
+static void
+CreateVectorsKernel(clrt::ProgramCache* programs,
+                    const struct VectorsRun* run,
+                    const char* kernelfile,
+                    struct VectorsKernel* kern)
+{
+  char options[64] = "";
+  size_t len = 0;
+  kern->width = 1;
+  kern->grid_stride = strstr(kernelfile, ".gs.") != NULL;
+  if (strstr(kernelfile, ".vec.") != NULL) {
+    kern->width = cltune_vector_width(run->device);
+    len = snprintf(options, sizeof(options), "-DVW=%d", kern->width);
+  }
+  if (run->dtype != DTYPE_F32) {
+    snprintf(options + len,
+             sizeof(options) - len,
+             "%s%s",
+             len > 0 ? " " : "",
+             cldtype_option(run->dtype));
+  }
+  snprintf(kern->label,
+           sizeof(kern->label),
+           "%s%s%s",
+           kernelfile,
+           options[0] ? " " : "",
+           options);
+
+  // Create program from kernel source (or the cached binary)
+  enum CacheStatus cacheStatus;
+  double buildStart = now_ns();
+  kern->program =
+    programs->get(run->context, run->device, kernelfile, options, &cacheStatus);
+  if (kern->program == NULL) {
+    fprintf(stderr, "Failed to build program from %s\n", kernelfile);
+    abort();
+  }
+  printf("program build(ns):%lg (cache %s) %s\n",
+         now_ns() - buildStart,
+         clcache_status_name(cacheStatus),
+         kern->label);
+
+  // Create kernel
+  kern->kernel = clrt::create_kernel(kern->program, run->operation);
+  cl_uint numArgs;
+  CL_CHECK(clGetKernelInfo(
+    kern->kernel, CL_KERNEL_NUM_ARGS, sizeof(numArgs), &numArgs, NULL));
+  kern->bounds = numArgs > 3;
+}
+
+static inline float
+HostOp(enum Operation op, float a, float b)
+{
+  return op == OP_ADD ? a + b : a * b;
+}
+
+static inline enum clrt::HostOp
+HostEngineOp(enum Operation op)
+{
+  return op == OP_ADD ? clrt::HOST_VECADD : clrt::HOST_VECMUL;
+}
+
+///
+//  Print the first and last elements of C next to the host reference and,
+//  with CHECK, verify all of them against the host engine (VERIFY_*
+//  tolerance)
+//
+static void
+CheckOutput(const struct VectorsRun* run,
+            const float* A,
+            const float* B,
+            const float* C,
+            size_t vector_len)
+{
+  for (size_t i = 0; i < vector_len; ++i) {
+    if (i == 4 && vector_len > 8) {
+      i = vector_len - 4;
+    }
+    printf("[%ld] OpenCL (%.5f) Host (%.5f)\n",
+           i,
+           C[i],
+           HostOp(run->op, A[i], B[i]));
+  }
+  if (!run->check_res) {
+    return;
+  }
+  struct clrt::VerifyReport report;
+  bool ok =
+    run->host->verify(HostEngineOp(run->op), A, B, 0, C, vector_len, &report);
+  run->host->print_report(run->operation, &report);
+  if (ok) {
+    printf("Everything seems to work fine! \n");
+  }
+}
+
+static void
+FillInputs(float* A, float* B, size_t vector_len)
+{
+  for (size_t i = 0; i < vector_len; ++i) {
+    A[i] = i + 1;
+    B[i] = (i + 1) * 2;
+  }
+}
+
+///
+//  Fill the inputs at A and B, stored as the element type of the run. For
+//  other types than f32 the float values go through views, left holding
+//  what the device sees (rounded to half for f16). Returns the conversion
+//  time.
+//
+static double
+FillStorage(const struct VectorsRun* run,
+            void* A,
+            void* B,
+            float* viewA,
+            float* viewB,
+            size_t vector_len)
+{
+  if (run->dtype == DTYPE_F32) {
+    FillInputs((float*)A, (float*)B, vector_len);
+    return 0;
+  }
+  FillInputs(viewA, viewB, vector_len);
+  double start = now_ns();
+  run->host->store(run->dtype, viewA, A, vector_len);
+  run->host->store(run->dtype, viewB, B, vector_len);
+  double convertTime = now_ns() - start;
+  if (run->dtype == DTYPE_F16) {
+    run->host->load(run->dtype, A, viewA, vector_len);
+    run->host->load(run->dtype, B, viewB, vector_len);
+  }
+  return convertTime;
+}
+
+///
+//  Work-items for vector_len elements. Vector kernels: one per width
+//  elements, the last one also handling the remainder. Grid-stride kernels:
+//  a few per compute unit.
+//
+static size_t
+KernelItems(const struct VectorsRun* run,
+            const struct VectorsKernel* kern,
+            size_t vector_len)
+{
+  return kern->grid_stride ? cltune_grid_items(run->device, vector_len)
+                           : (vector_len + kern->width - 1) / kern->width;
+}
+
+///
+//  QUEUE=IN_ORDER|OUT_OF_ORDER: every iteration hands A and B over, runs
+//  the kernel and maps C back as one event graph. Only the wait lists order
+//  it: the writes of A and B are independent, the kernel waits on both and
+//  the read on the kernel. The inputs are refilled (untimed) before each
+//  graph, through viewA and viewB for other types than f32. samples gets
+//  the kernel of each iteration.
+//
+static void
+RunGraph(struct VectorsRun* run,
+         const struct VectorsKernel* kern,
+         size_t vector_len,
+         size_t globalItemSize,
+         size_t localItemSize,
+         float* viewA,
+         float* viewB,
+         struct BenchSample* samples)
+{
+  cl_command_queue commandQueue = run->queue;
+  struct BenchOverlap* graphs =
+    (struct BenchOverlap*)malloc(sizeof(struct BenchOverlap) * run->iterations);
+  for (int i = 0; i < run->warmup + run->iterations; i++) {
+    void* A;
+    void* B;
+    void* C;
+    CL_CHECK(clbuf_map(
+      &run->aBuf, commandQueue, CL_MAP_WRITE_INVALIDATE_REGION, &A));
+    CL_CHECK(clbuf_map(
+      &run->bBuf, commandQueue, CL_MAP_WRITE_INVALIDATE_REGION, &B));
+    FillStorage(run, A, B, viewA, viewB, vector_len);
+
+    // write A, write B, kernel, read C
+    clrt::EventTimer events;
+    CL_CHECK(
+      clbuf_unmap_async(&run->aBuf, commandQueue, 0, NULL, events.next()));
+    CL_CHECK(
+      clbuf_unmap_async(&run->bBuf, commandQueue, 0, NULL, events.next()));
+    cl_event writes[2] = { events[0], events[1] };
+    CL_CHECK(clEnqueueNDRangeKernel(commandQueue,
+                                    kern->kernel,
+                                    1,
+                                    NULL,
+                                    &globalItemSize,
+                                    localItemSize > 0 ? &localItemSize : NULL,
+                                    2,
+                                    writes,
+                                    events.next()));
+    cl_event kernelEvent = events[2];
+    CL_CHECK(clbuf_map_async(&run->cBuf,
+                             commandQueue,
+                             CL_MAP_READ,
+                             1,
+                             &kernelEvent,
+                             &C,
+                             events.next()));
+    std::vector<struct BenchSample> commands;
+    events.collect(&commands);
+    CL_CHECK(clbuf_unmap(&run->cBuf, commandQueue));
+
+    if (i >= run->warmup) {
+      samples[i - run->warmup] = commands[2];
+      clbench_overlap(commands.data(), 4, &graphs[i - run->warmup]);
+    }
+  }
+  clbench_print_graph(graphs, run->iterations);
+  free(graphs);
+}
+
+///
+//  Write the inputs, run the kernel iterations, read back and check the
+//  result of one vector length. The buffers only grow. bench->samples is
+//  allocated here and owned by the caller.
+//
+static void
+RunVector(struct VectorsRun* run,
+          const struct VectorsKernel* kern,
+          size_t vector_len,
+          struct BenchResult* bench)
+{
+  cl_command_queue commandQueue = run->queue;
+  // Other types than float go through float views on the host
+  size_t elem = cldtype_size(run->dtype);
+  bool convert = run->dtype != DTYPE_F32;
+  std::vector<float> viewA(convert ? vector_len : 0);
+  std::vector<float> viewB(convert ? vector_len : 0);
+  std::vector<float> viewC(convert ? vector_len : 0);
+
+  double allocStart = now_ns();
+  CL_CHECK(clbuf_resize(&run->aBuf, vector_len * elem));
+  CL_CHECK(clbuf_resize(&run->bBuf, vector_len * elem));
+  CL_CHECK(clbuf_resize(&run->cBuf, vector_len * elem));
+  double allocTime = now_ns() - allocStart;
+
+  // Initialize values for array members in place, and hand them to the
+  // device. Only the map/unmap calls are timed, not the host fill.
+  void* mapA;
+  void* mapB;
+  double writeStart = now_ns();
+  double phaseStart = writeStart;
+  CL_CHECK(clbuf_map(
+    &run->aBuf, commandQueue, CL_MAP_WRITE_INVALIDATE_REGION, &mapA));
+  CL_CHECK(clbuf_map(
+    &run->bBuf, commandQueue, CL_MAP_WRITE_INVALIDATE_REGION, &mapB));
+  double writeTime = now_ns() - writeStart;
+  double convertTime =
+    FillStorage(run, mapA, mapB, viewA.data(), viewB.data(), vector_len);
+  writeStart = now_ns();
+  CL_CHECK(clbuf_unmap(&run->aBuf, commandQueue));
+  CL_CHECK(clbuf_unmap(&run->bBuf, commandQueue));
+  writeTime += now_ns() - writeStart;
+  cltrace_phase("write inputs", phaseStart);
+
+  // Set arguments for kernel
+  cl_int ret;
+  ret = clbuf_set_arg(&run->aBuf, kern->kernel, 0);
+  ret |= clbuf_set_arg(&run->bBuf, kern->kernel, 1);
+  ret |= clbuf_set_arg(&run->cBuf, kern->kernel, 2);
+  if (kern->bounds) {
+    cl_int n = vector_len;
+    ret |= clSetKernelArg(kern->kernel, 3, sizeof(n), &n);
+  }
+  if (ret != CL_SUCCESS) {
+    fprintf(stderr, "OpenCL Error: '%s' returned %d!\n", "clSetKernelArg", ret);
+    abort();
+  }
+
+  // Execute the kernel
+  size_t globalItemSize;
+  size_t localItemSize;
+  enum TuneStatus tuneStatus;
+  CL_CHECK(cltune_select(&run->localConfig,
+                         commandQueue,
+                         kern->kernel,
+                         kern->label,
+                         KernelItems(run, kern, vector_len),
+                         kern->bounds,
+                         &globalItemSize,
+                         &localItemSize,
+                         &tuneStatus));
+  printf("local work size: %ld (global %ld, tune %s)\n",
+         localItemSize,
+         globalItemSize,
+         cltune_status_name(tuneStatus));
+  struct BenchSample* samples =
+    (struct BenchSample*)malloc(sizeof(struct BenchSample) * run->iterations);
+  phaseStart = now_ns();
+  if (run->queueMode != QUEUE_BLOCKING) {
+    RunGraph(run,
+             kern,
+             vector_len,
+             globalItemSize,
+             localItemSize,
+             viewA.data(),
+             viewB.data(),
+             samples);
+  } else {
+    for (int i = 0; i < run->warmup + run->iterations; i++) {
+      clrt::Event kernelEvent;
+      CL_CHECK(clEnqueueNDRangeKernel(commandQueue,
+                                      kern->kernel,
+                                      1,
+                                      NULL,
+                                      &globalItemSize,
+                                      localItemSize > 0 ? &localItemSize : NULL,
+                                      0,
+                                      NULL,
+                                      kernelEvent.out()));
+      cl_event waitEvent = kernelEvent;
+      CL_CHECK(clWaitForEvents(1, &waitEvent));
+      if (i >= run->warmup) {
+        CL_CHECK(clbench_sample(kernelEvent, &samples[i - run->warmup]));
+      }
+    }
+  }
+  cltrace_phase("kernels", phaseStart);
+
+  // Per element: read a and b, write c; one add or multiply
+  clbench_result(bench,
+                 run->device,
+                 run->operation,
+                 kern->label,
+                 vector_len,
+                 3.0 * elem * vector_len,
+                 1.0 * vector_len,
+                 samples,
+                 run->iterations,
+                 run->warmup);
+
+  // Read from device back to host.
+  void* mapC;
+  double readStart = now_ns();
+  CL_CHECK(clbuf_map(&run->cBuf, commandQueue, CL_MAP_READ, &mapC));
+  double readTime = now_ns() - readStart;
+  cltrace_phase("read output", readStart);
+  const float* A = viewA.data();
+  const float* B = viewB.data();
+  const float* C = (const float*)mapC;
+  if (convert) {
+    double convertStart = now_ns();
+    run->host->load(run->dtype, mapC, viewC.data(), vector_len);
+    convertTime += now_ns() - convertStart;
+    C = viewC.data();
+  } else {
+    // The inputs are read back only to compare against (not timed)
+    CL_CHECK(clbuf_map(&run->aBuf, commandQueue, CL_MAP_READ, &mapA));
+    CL_CHECK(clbuf_map(&run->bBuf, commandQueue, CL_MAP_READ, &mapB));
+    A = (const float*)mapA;
+    B = (const float*)mapB;
+  }
+
+  // Write result
+  /*
+  for (i=0; i<vector_len; ++i) {
+
+          printf("%f + %f = %f\n", A[i], B[i], C[i]);
+
+  }
+  */
+
+  // Test if correct answer
+  CheckOutput(run, A, B, C, vector_len);
+
+  readStart = now_ns();
+  CL_CHECK(clbuf_unmap(&run->cBuf, commandQueue));
+  readTime += now_ns() - readStart;
+  if (!convert) {
+    CL_CHECK(clbuf_unmap(&run->aBuf, commandQueue));
+    CL_CHECK(clbuf_unmap(&run->bBuf, commandQueue));
+  }
+  bench->write_ns = writeTime;
+  bench->read_ns = readTime;
+
+  printf("alloc(ns):%lg\n", allocTime);
+  printf("write(ns):%lg\n", writeTime);
+  printf("kernel(ns):%lg\n", bench->exec.median);
+  printf("read(ns):%lg\n", readTime);
+  if (convert) {
+    printf("host convert(ns):%lg\n", convertTime);
+  }
+  printf("throughput %s: %.3f GB/s, %.3f Gelem/s\n",
+         cldtype_name(run->dtype),
+         bench->exec.median > 0 ? bench->bytes / bench->exec.median : 0,
+         bench->exec.median > 0 ? vector_len / bench->exec.median : 0);
+  if (run->iterations > 1) {
+    clbench_print(bench);
+  }
+}
+
+static void
+SetStreamArgs(const struct VectorsKernel* kern,
+              const struct StreamSet* set,
+              size_t len)
+{
+  clrt::set_arg(kern->kernel, 0, set->a.get());
+  clrt::set_arg(kern->kernel, 1, set->b.get());
+  clrt::set_arg(kern->kernel, 2, set->c.get());
+  if (kern->bounds) {
+    clrt::set_arg(kern->kernel, 3, (cl_int)len);
+  }
+}
+
+///
+//  Global and local size for a chunk of len elements, with the local size
+//  chosen for full chunks
+//
+static void
+ChunkGeometry(const struct VectorsRun* run,
+              const struct VectorsKernel* kern,
+              size_t len,
+              size_t chunkLocal,
+              size_t* global,
+              size_t* local)
+{
+  size_t items = KernelItems(run, kern, len);
+  *global = items;
+  *local = chunkLocal;
+  if (chunkLocal > 0 && items % chunkLocal != 0) {
+    if (kern->bounds) {
+      *global = (items + chunkLocal - 1) / chunkLocal * chunkLocal;
+    } else {
+      *local = 0;
+    }
+  }
+}
+
+///
+//  STREAM mode: split the vectors in chunks that fit on the device and run
+//  them through the sets in turn, each set on its own queue. Every chunk is
+//  a non-blocking write of A and B, the kernel waiting on both writes and a
+//  non-blocking read waiting on the kernel, so the transfers of a chunk
+//  overlap the kernel of the previous one. bench->samples is allocated here
+//  and owned by the caller; each sample spans a whole pipeline run.
+//
+static void
+RunStream(struct VectorsRun* run,
+          const struct VectorsKernel* kern,
+          size_t vector_len,
+          struct BenchResult* bench)
+{
+  size_t chunk = run->streamChunk;
+  size_t nChunks = (vector_len + chunk - 1) / chunk;
+  if (nChunks == 1) {
+    chunk = vector_len;
+  }
+  printf("stream: %ld chunks of %ld elements through %d sets\n",
+         nChunks,
+         chunk,
+         run->streamSets);
+
+  if (vector_len > run->hostLen) {
+    free(run->hostA);
+    free(run->hostB);
+    free(run->hostC);
+    run->hostA = (float*)malloc(vector_len * sizeof(float));
+    run->hostB = (float*)malloc(vector_len * sizeof(float));
+    run->hostC = (float*)malloc(vector_len * sizeof(float));
+    run->hostLen = vector_len;
+  }
+  FillInputs(run->hostA, run->hostB, vector_len);
+
+  // Geometry of a full chunk (tuned on the first set) and of the last one
+  size_t chunkGlobal, chunkLocal, tailGlobal, tailLocal;
+  enum TuneStatus tuneStatus;
+  SetStreamArgs(kern, &run->sets[0], chunk);
+  CL_CHECK(cltune_select(&run->localConfig,
+                         run->sets[0].queue,
+                         kern->kernel,
+                         kern->label,
+                         KernelItems(run, kern, chunk),
+                         kern->bounds,
+                         &chunkGlobal,
+                         &chunkLocal,
+                         &tuneStatus));
+  printf("local work size: %ld (global %ld per chunk, tune %s)\n",
+         chunkLocal,
+         chunkGlobal,
+         cltune_status_name(tuneStatus));
+  size_t tailLen = vector_len - (nChunks - 1) * chunk;
+  ChunkGeometry(run, kern, tailLen, chunkLocal, &tailGlobal, &tailLocal);
+
+  // Per chunk: write A, write B, kernel, read C
+  clrt::EventTimer events;
+  std::vector<struct BenchSample> commands;
+  struct BenchSample* samples =
+    (struct BenchSample*)malloc(sizeof(struct BenchSample) * run->iterations);
+  struct BenchOverlap overlap;
+  double phaseTime[3];
+  double wallTime = 0;
+  for (int i = 0; i < run->warmup + run->iterations; i++) {
+    double wallStart = now_ns();
+    for (size_t k = 0; k < nChunks; k++) {
+      struct StreamSet* set = &run->sets[k % run->streamSets];
+      size_t offset = k * chunk;
+      size_t len = k + 1 < nChunks ? chunk : tailLen;
+      size_t global = k + 1 < nChunks ? chunkGlobal : tailGlobal;
+      size_t local = k + 1 < nChunks ? chunkLocal : tailLocal;
+      CL_CHECK(clEnqueueWriteBuffer(set->queue,
+                                    set->a,
+                                    CL_FALSE,
+                                    0,
+                                    len * sizeof(float),
+                                    &run->hostA[offset],
+                                    0,
+                                    NULL,
+                                    events.next()));
+      CL_CHECK(clEnqueueWriteBuffer(set->queue,
+                                    set->b,
+                                    CL_FALSE,
+                                    0,
+                                    len * sizeof(float),
+                                    &run->hostB[offset],
+                                    0,
+                                    NULL,
+                                    events.next()));
+      cl_event writes[2] = { events[4 * k], events[4 * k + 1] };
+      // Arguments are captured at enqueue time: one kernel serves all sets
+      SetStreamArgs(kern, set, len);
+      CL_CHECK(clEnqueueNDRangeKernel(set->queue,
+                                      kern->kernel,
+                                      1,
+                                      NULL,
+                                      &global,
+                                      local > 0 ? &local : NULL,
+                                      2,
+                                      writes,
+                                      events.next()));
+      cl_event kernelEvent = events[4 * k + 2];
+      CL_CHECK(clEnqueueReadBuffer(set->queue,
+                                   set->c,
+                                   CL_FALSE,
+                                   0,
+                                   len * sizeof(float),
+                                   &run->hostC[offset],
+                                   1,
+                                   &kernelEvent,
+                                   events.next()));
+      CL_CHECK(clFlush(set->queue));
+    }
+    for (int s = 0; s < run->streamSets; s++) {
+      CL_CHECK(clFinish(run->sets[s].queue));
+    }
+    wallTime = now_ns() - wallStart;
+
+    commands.clear();
+    events.collect(&commands);
+    events.clear();
+    if (i < run->warmup) {
+      continue;
+    }
+    // The whole pipeline as one sample: first queued to last end
+    struct BenchSample* sample = &samples[i - run->warmup];
+    *sample = commands[0];
+    phaseTime[0] = phaseTime[1] = phaseTime[2] = 0;
+    for (size_t k = 0; k < 4 * nChunks; k++) {
+      const struct BenchSample* c = &commands[k];
+      sample->queued = c->queued < sample->queued ? c->queued : sample->queued;
+      sample->submit = c->submit < sample->submit ? c->submit : sample->submit;
+      sample->start = c->start < sample->start ? c->start : sample->start;
+      sample->end = c->end > sample->end ? c->end : sample->end;
+      // write A and B, kernel, read
+      int phase = k % 4 < 2 ? 0 : k % 4 - 1;
+      phaseTime[phase] += (double)(c->end - c->start);
+    }
+    clbench_overlap(commands.data(), 4 * nChunks, &overlap);
+  }
+
+  // Per element: read a and b, write c; one add or multiply. The transfers
+  // are inside the timed span.
+  clbench_result(bench,
+                 run->device,
+                 run->operation,
+                 kern->label,
+                 vector_len,
+                 3.0 * sizeof(float) * vector_len,
+                 1.0 * vector_len,
+                 samples,
+                 run->iterations,
+                 run->warmup);
+
+  CheckOutput(run, run->hostA, run->hostB, run->hostC, vector_len);
+
+  // Last run: busy time of each phase summed over the chunks
+  printf("stream write(ns):%lg kernel(ns):%lg read(ns):%lg\n",
+         phaseTime[0],
+         phaseTime[1],
+         phaseTime[2]);
+  printf("stream span(ns):%lg serial(ns):%lg overlap:%.1f%%\n",
+         overlap.span_ns,
+         overlap.serial_ns,
+         100.0 * overlap.overlap);
+  printf("stream wall(ns):%lg throughput:%.3f GB/s\n",
+         wallTime,
+         wallTime > 0 ? bench->bytes / wallTime : 0);
+  printf("kernel(ns):%lg\n", bench->exec.median);
+  if (run->iterations > 1) {
+    clbench_print(bench);
+  }
+}
+
+static void
+Run(struct VectorsRun* run,
+    const struct VectorsKernel* kern,
+    size_t vector_len,
+    struct BenchResult* bench)
+{
+  if (run->streamSets > 0) {
+    RunStream(run, kern, vector_len, bench);
+  } else {
+    RunVector(run, kern, vector_len, bench);
+  }
+}
+
+///
+//  MULTI_DEVICE: the settings, kernel and buffers of one device
+//
+struct MultiSlice
+{
+  struct VectorsRun run; // the shared settings on the device's queue
+  struct VectorsKernel kern;
+  struct StreamSet set; // device buffers of the slice
+  size_t capacity;      // elements the buffers hold
+  size_t global;        // work-items for a slice of globalLen elements
+  size_t globalLen;
+};
+
+///
+//  One pass over the vector: every device writes its slice of A and B,
+//  runs the kernel and reads its slice of C back, all of them enqueued
+//  before any is waited for. kernels[d] gets the kernel sample of device d
+//  and spans[d] its first write start to read end. Returns the wall time.
+//
+static double
+MultiPass(const struct MultiDevice* devs,
+          struct MultiSlice* slices,
+          size_t nDevs,
+          const float* A,
+          const float* B,
+          float* C,
+          struct BenchSample* kernels,
+          struct BenchSample* spans)
+{
+  for (size_t d = 0; d < nDevs; d++) {
+    struct MultiSlice* s = &slices[d];
+    size_t len = devs[d].len;
+    if (len > s->capacity) {
+      s->set.a = clrt::Mem(CL_CHECK_ERR(clCreateBuffer(
+        devs[d].context, CL_MEM_READ_ONLY, len * sizeof(float), NULL, &_err)));
+      s->set.b = clrt::Mem(CL_CHECK_ERR(clCreateBuffer(
+        devs[d].context, CL_MEM_READ_ONLY, len * sizeof(float), NULL, &_err)));
+      s->set.c = clrt::Mem(CL_CHECK_ERR(clCreateBuffer(
+        devs[d].context, CL_MEM_WRITE_ONLY, len * sizeof(float), NULL, &_err)));
+      s->capacity = len;
+    }
+    if (len > 0 && len != s->globalLen) {
+      s->global = KernelItems(&s->run, &s->kern, len);
+      s->globalLen = len;
+    }
+  }
+
+  // write A, write B, kernel, read C per device
+  clrt::EventTimer events[CLMULTI_MAX_DEVICES];
+  double start = now_ns();
+  for (size_t d = 0; d < nDevs; d++) {
+    struct MultiSlice* s = &slices[d];
+    size_t offset = devs[d].offset;
+    size_t len = devs[d].len;
+    if (len == 0) {
+      continue;
+    }
+    SetStreamArgs(&s->kern, &s->set, len);
+    CL_CHECK(clEnqueueWriteBuffer(devs[d].queue,
+                                  s->set.a,
+                                  CL_FALSE,
+                                  0,
+                                  len * sizeof(float),
+                                  &A[offset],
+                                  0,
+                                  NULL,
+                                  events[d].next()));
+    CL_CHECK(clEnqueueWriteBuffer(devs[d].queue,
+                                  s->set.b,
+                                  CL_FALSE,
+                                  0,
+                                  len * sizeof(float),
+                                  &B[offset],
+                                  0,
+                                  NULL,
+                                  events[d].next()));
+    cl_event writes[2] = { events[d][0], events[d][1] };
+    CL_CHECK(clEnqueueNDRangeKernel(devs[d].queue,
+                                    s->kern.kernel,
+                                    1,
+                                    NULL,
+                                    &s->global,
+                                    NULL,
+                                    2,
+                                    writes,
+                                    events[d].next()));
+    cl_event kernelEvent = events[d][2];
+    CL_CHECK(clEnqueueReadBuffer(devs[d].queue,
+                                 s->set.c,
+                                 CL_FALSE,
+                                 0,
+                                 len * sizeof(float),
+                                 &C[offset],
+                                 1,
+                                 &kernelEvent,
+                                 events[d].next()));
+    CL_CHECK(clFlush(devs[d].queue));
+  }
+  for (size_t d = 0; d < nDevs; d++) {
+    CL_CHECK(clFinish(devs[d].queue));
+  }
+  double wall = now_ns() - start;
+
+  for (size_t d = 0; d < nDevs; d++) {
+    memset(&kernels[d], 0, sizeof(kernels[d]));
+    memset(&spans[d], 0, sizeof(spans[d]));
+    if (devs[d].len == 0) {
+      continue;
+    }
+    std::vector<struct BenchSample> commands;
+    events[d].collect(&commands);
+    kernels[d] = commands[2];
+    spans[d] = commands[0];
+    spans[d].end = commands[3].end;
+  }
+  return wall;
+}
+
+///
+//  MULTI_DEVICE: split the vector across the devices, weighted by a
+//  calibration pass over calibrateLen elements, and run it ITERATIONS
+//  times. Device d builds its own kernel and gets results[d] (its slice and
+//  kernel times); the samples are allocated here and owned by the caller.
+//
+static void
+RunMulti(const struct VectorsRun* base,
+         struct MultiDevice* devs,
+         size_t nDevs,
+         const char* kernelfile,
+         size_t vector_len,
+         size_t calibrateLen,
+         struct BenchResult* results)
+{
+  // Devices of a platform share a context, and so the program built on it
+  clrt::ProgramCache programs;
+  std::vector<struct MultiSlice> slices(nDevs);
+  for (size_t d = 0; d < nDevs; d++) {
+    struct MultiSlice* s = &slices[d];
+    s->run = *base;
+    s->run.context = devs[d].context;
+    s->run.device = devs[d].device;
+    s->run.queue = devs[d].queue;
+    CreateVectorsKernel(&programs, &s->run, kernelfile, &s->kern);
+    s->set.queue = clrt::Queue::retain(devs[d].queue);
+  }
+
+  float* A = (float*)malloc(vector_len * sizeof(float));
+  float* B = (float*)malloc(vector_len * sizeof(float));
+  float* C = (float*)malloc(vector_len * sizeof(float));
+  FillInputs(A, B, vector_len);
+  struct BenchSample kernels[CLMULTI_MAX_DEVICES];
+  struct BenchSample spans[CLMULTI_MAX_DEVICES];
+  double elapsed[CLMULTI_MAX_DEVICES];
+
+  // The first pass also warms the devices up: weight by the second one
+  if (calibrateLen > 0) {
+    size_t len = calibrateLen < vector_len ? calibrateLen : vector_len;
+    clmulti_split(devs, nDevs, len);
+    for (int pass = 0; pass < 2; pass++) {
+      MultiPass(devs, slices.data(), nDevs, A, B, C, kernels, spans);
+    }
+    for (size_t d = 0; d < nDevs; d++) {
+      elapsed[d] = (double)(spans[d].end - spans[d].start);
+    }
+    clmulti_reweight(devs, nDevs, elapsed);
+    printf("calibrated on %ld elements\n", len);
+  }
+  clmulti_split(devs, nDevs, vector_len);
+  clmulti_print_split(devs, nDevs);
+
+  struct BenchSample* samples[CLMULTI_MAX_DEVICES];
+  for (size_t d = 0; d < nDevs; d++) {
+    samples[d] = (struct BenchSample*)malloc(sizeof(struct BenchSample) *
+                                             base->iterations);
+  }
+  double bestWall = 0;
+  for (int i = 0; i < base->warmup + base->iterations; i++) {
+    double wall =
+      MultiPass(devs, slices.data(), nDevs, A, B, C, kernels, spans);
+    if (i < base->warmup) {
+      continue;
+    }
+    for (size_t d = 0; d < nDevs; d++) {
+      samples[d][i - base->warmup] = kernels[d];
+    }
+    if (bestWall == 0 || wall < bestWall) {
+      bestWall = wall;
+    }
+  }
+
+  // Per element: read a and b, write c; one add or multiply
+  for (size_t d = 0; d < nDevs; d++) {
+    size_t len = devs[d].len;
+    clbench_result(&results[d],
+                   devs[d].device,
+                   base->operation,
+                   slices[d].kern.label,
+                   len,
+                   3.0 * sizeof(float) * len,
+                   1.0 * len,
+                   samples[d],
+                   base->iterations,
+                   base->warmup);
+    // Last pass: the slice with its transfers, on the device clock
+    double span = (double)(spans[d].end - spans[d].start);
+    printf("device %ld: %s kernel(ns):%lg %.3f GB/s slice(ns):%lg %.3f GB/s\n",
+           d,
+           devs[d].name,
+           results[d].exec.median,
+           results[d].exec.median > 0
+             ? results[d].bytes / results[d].exec.median
+             : 0,
+           span,
+           span > 0 ? results[d].bytes / span : 0);
+  }
+  printf("multi wall(ns):%lg (best) throughput:%.3f GB/s\n",
+         bestWall,
+         bestWall > 0 ? 3.0 * sizeof(float) * vector_len / bestWall : 0);
+
+  CheckOutput(base, A, B, C, vector_len);
+
+  free(A);
+  free(B);
+  free(C);
+}
+
+///
+//  Time the host engine computing the same vector, to find where offloading
+//  pays off. Best of the same number of iterations as the kernel.
+//
+static double
+HostTime(const struct VectorsRun* run, size_t vector_len)
+{
+  std::vector<float> A(vector_len), B(vector_len), C(vector_len);
+  FillInputs(A.data(), B.data(), vector_len);
+  std::vector<struct BenchSample> samples;
+  run->host->bench(HostEngineOp(run->op),
+                   A.data(),
+                   B.data(),
+                   0,
+                   C.data(),
+                   vector_len,
+                   run->iterations,
+                   run->warmup,
+                   &samples);
+  double best = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    double elapsed = (double)(samples[i].end - samples[i].start);
+    if (best == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+///
+//  BACKEND=HOST: time the host engine on each vector length, reported like
+//  the kernel runs
+//
+static int
+HostMain(const struct VectorsRun* base,
+         size_t vector_len,
+         const struct SweepRange* range)
+{
+  size_t nSizes = 0;
+  for (size_t len = vector_len; len != 0;
+       len = range != NULL ? clbench_sweep_next(range, len) : 0) {
+    nSizes++;
+  }
+  std::vector<struct BenchResult> results(nSizes);
+  std::vector<std::vector<struct BenchSample>> samples(nSizes);
+  size_t i = 0;
+  for (size_t len = vector_len; len != 0;
+       len = range != NULL ? clbench_sweep_next(range, len) : 0) {
+    printf("=== vector_len: %ld ===\n", len);
+    std::vector<float> A(len), B(len), C(len);
+    FillInputs(A.data(), B.data(), len);
+    base->host->bench(HostEngineOp(base->op),
+                      A.data(),
+                      B.data(),
+                      0,
+                      C.data(),
+                      len,
+                      base->iterations,
+                      base->warmup,
+                      &samples[i]);
+    // No OpenCL device: the result is named after the engine
+    clbench_result(&results[i],
+                   NULL,
+                   base->operation,
+                   "host",
+                   len,
+                   3.0 * sizeof(float) * len,
+                   1.0 * len,
+                   samples[i].data(),
+                   samples[i].size(),
+                   base->warmup);
+    base->host->name(results[i].device, sizeof(results[i].device));
+    printf("time(ns):%lg\n", results[i].exec.median);
+    clbench_print(&results[i]);
+    i++;
+  }
+  char* benchOut = getenv("BENCH_OUT");
+  if (benchOut != NULL &&
+      !clbench_write(benchOut, results.data(), results.size())) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", benchOut);
+  }
+  return 0;
+}
+
+///
+//  MULTI_DEVICE: run VECTOR across the devices and report each of them
+//
+static int
+MultiMain(enum MultiMode mode,
+          int platformId,
+          const char* kernelfile,
+          enum Operation op,
+          const char* operation,
+          bool check_res,
+          clrt::HostEngine* host,
+          size_t vector_len,
+          size_t calibrateLen)
+{
+  printf("multi-device: %s\n", clmulti_mode_name(mode));
+  if (getenv("SWEEP") != NULL || getenv("STREAM") != NULL ||
+      getenv("BASELINE") != NULL || getenv("DTYPE") != NULL) {
+    printf("multi-device: SWEEP, STREAM, BASELINE and DTYPE are ignored\n");
+  }
+  struct MultiDevice devs[CLMULTI_MAX_DEVICES];
+  size_t nDevs = clmulti_open(
+    mode, platformId, -1, devs, CLMULTI_MAX_DEVICES);
+  if (nDevs == 0) {
+    fprintf(stderr, "No device to run on\n");
+    return 1;
+  }
+
+  struct VectorsRun base = {};
+  base.op = op;
+  base.operation = operation;
+  base.check_res = check_res;
+  base.host = host;
+  clbench_config(&base.iterations, &base.warmup);
+
+  struct BenchResult results[CLMULTI_MAX_DEVICES];
+  RunMulti(&base, devs, nDevs, kernelfile, vector_len, calibrateLen, results);
+
+  char* benchOut = getenv("BENCH_OUT");
+  if (benchOut != NULL && !clbench_write(benchOut, results, nDevs)) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", benchOut);
+  }
+  for (size_t d = 0; d < nDevs; d++) {
+    free((void*)results[d].samples);
+  }
+  clmulti_release(devs, nDevs);
+  return 0;
+}
+
+///
+//  *.batch.cl: BATCH jobs packed into one launch. Every batch writes A, B
+//  and the offsets, runs the kernel and reads C back, timed on the host from
+//  the first write to the end of the read. A pass with one launch per job
+//  follows, to compare against.
+//
+static int
+BatchMain(const struct VectorsRun* run,
+          int platformId,
+          int deviceId,
+          const char* kernelfile,
+          const struct BatchConfig* config)
+{
+  if (getenv("SWEEP") != NULL || getenv("STREAM") != NULL ||
+      getenv("BASELINE") != NULL || getenv("DTYPE") != NULL) {
+    printf("batch: SWEEP, STREAM, BASELINE and DTYPE are ignored\n");
+  }
+  cl_device_id device = clrt::select_device(platformId, deviceId, false);
+  if (device == NULL) {
+    printf("no device %d.%d\n", platformId, deviceId);
+    return 1;
+  }
+  size_t poolArena;
+  int poolBench;
+  clrt::pool_config(&poolArena, &poolBench);
+  // The commands of a batch follow each other on an in-order queue
+  enum QueueMode queueMode = QUEUE_BLOCKING;
+  clrt::Runtime rt(device, &queueMode, poolArena);
+  cl_command_queue queue = rt.queue();
+
+  enum CacheStatus cacheStatus;
+  double buildStart = now_ns();
+  clrt::Program program =
+    rt.programs().get(rt.context(), device, kernelfile, "", &cacheStatus);
+  if (program == NULL) {
+    fprintf(stderr, "Failed to build program from %s\n", kernelfile);
+    return 1;
+  }
+  printf("program build(ns):%lg (cache %s) %s\n",
+         now_ns() - buildStart,
+         clcache_status_name(cacheStatus),
+         kernelfile);
+  clrt::Kernel kernel = clrt::create_kernel(program, run->operation);
+  size_t local = clbatch_local(kernel, device, &run->localConfig);
+
+  size_t jobs = config->jobs;
+  std::vector<cl_int> offsets(jobs + 1);
+  size_t total = clbatch_pack(config, offsets.data());
+  std::vector<float> A(total), B(total), C(total);
+  FillInputs(A.data(), B.data(), total);
+  printf("batch: %ld jobs of %ld..%ld elements (%ld), local %ld\n",
+         jobs,
+         config->min_len,
+         config->max_len,
+         total,
+         local);
+
+  size_t bytes = sizeof(float) * total;
+  size_t offsetsBytes = sizeof(cl_int) * (jobs + 1);
+  clrt::Mem aBuf = rt.pool().acquire(CL_MEM_READ_ONLY, bytes);
+  clrt::Mem bBuf = rt.pool().acquire(CL_MEM_READ_ONLY, bytes);
+  clrt::Mem cBuf = rt.pool().acquire(CL_MEM_WRITE_ONLY, bytes);
+  clrt::Mem offsetsBuf = rt.pool().acquire(CL_MEM_READ_ONLY, offsetsBytes);
+  clrt::set_arg(kernel, 0, aBuf.get());
+  clrt::set_arg(kernel, 1, bBuf.get());
+  clrt::set_arg(kernel, 2, cBuf.get());
+  clrt::set_arg(kernel, 3, offsetsBuf.get());
+
+  std::vector<struct BenchSample> samples(run->iterations);
+  std::vector<struct BenchSample> kernels(run->iterations);
+  size_t global = jobs * local;
+  clrt::set_arg(kernel, 4, (cl_int)jobs);
+  double phaseStart = now_ns();
+  for (int i = 0; i < run->warmup + run->iterations; i++) {
+    clrt::Event kernelEvent;
+    cl_ulong start = (cl_ulong)now_ns();
+    CL_CHECK(clEnqueueWriteBuffer(
+      queue, aBuf, CL_FALSE, 0, bytes, A.data(), 0, NULL, NULL));
+    CL_CHECK(clEnqueueWriteBuffer(
+      queue, bBuf, CL_FALSE, 0, bytes, B.data(), 0, NULL, NULL));
+    CL_CHECK(clEnqueueWriteBuffer(queue,
+                                  offsetsBuf,
+                                  CL_FALSE,
+                                  0,
+                                  offsetsBytes,
+                                  offsets.data(),
+                                  0,
+                                  NULL,
+                                  NULL));
+    CL_CHECK(clEnqueueNDRangeKernel(
+      queue, kernel, 1, NULL, &global, &local, 0, NULL, kernelEvent.out()));
+    CL_CHECK(clEnqueueReadBuffer(
+      queue, cBuf, CL_TRUE, 0, bytes, C.data(), 0, NULL, NULL));
+    cl_ulong end = (cl_ulong)now_ns();
+    if (i >= run->warmup) {
+      struct BenchSample* s = &samples[i - run->warmup];
+      s->queued = s->submit = s->start = start;
+      s->end = end;
+      CL_CHECK(clbench_sample(kernelEvent, &kernels[i - run->warmup]));
+    }
+  }
+  cltrace_phase("batches", phaseStart);
+
+  // Per element: read A and B, write C; the offsets once per batch
+  struct BenchResult bench, kernelBench;
+  clbench_result(&bench,
+                 device,
+                 run->operation,
+                 kernelfile,
+                 total,
+                 3.0 * bytes + offsetsBytes,
+                 1.0 * total,
+                 samples.data(),
+                 run->iterations,
+                 run->warmup);
+  clbench_result(&kernelBench,
+                 device,
+                 run->operation,
+                 kernelfile,
+                 total,
+                 3.0 * bytes + offsetsBytes,
+                 1.0 * total,
+                 kernels.data(),
+                 run->iterations,
+                 run->warmup);
+
+  for (size_t j = 0; j < jobs && j < 3; j++) {
+    cl_int first = offsets[j];
+    printf("[job %ld] %d elements, [%d] OpenCL (%.5f) Host (%.5f)\n",
+           j,
+           offsets[j + 1] - first,
+           first,
+           C[first],
+           HostOp(run->op, A[first], B[first]));
+  }
+  if (run->check_res) {
+    struct clrt::VerifyReport report;
+    bool ok = run->host->verify(
+      HostEngineOp(run->op), A.data(), B.data(), 0, C.data(), total, &report);
+    run->host->print_report(run->operation, &report);
+    if (ok) {
+      printf("Everything seems to work fine! \n");
+    }
+  }
+
+  // One launch per job: the same kernel on a batch of one, its transfers
+  // limited to the job
+  phaseStart = now_ns();
+  clrt::set_arg(kernel, 4, (cl_int)1);
+  for (size_t j = 0; j < jobs; j++) {
+    size_t offset = sizeof(float) * offsets[j];
+    size_t len = sizeof(float) * (offsets[j + 1] - offsets[j]);
+    CL_CHECK(clEnqueueWriteBuffer(
+      queue, aBuf, CL_FALSE, offset, len, &A[offsets[j]], 0, NULL, NULL));
+    CL_CHECK(clEnqueueWriteBuffer(
+      queue, bBuf, CL_FALSE, offset, len, &B[offsets[j]], 0, NULL, NULL));
+    CL_CHECK(clEnqueueWriteBuffer(queue,
+                                  offsetsBuf,
+                                  CL_FALSE,
+                                  0,
+                                  2 * sizeof(cl_int),
+                                  &offsets[j],
+                                  0,
+                                  NULL,
+                                  NULL));
+    CL_CHECK(clEnqueueNDRangeKernel(
+      queue, kernel, 1, NULL, &local, &local, 0, NULL, NULL));
+    CL_CHECK(clEnqueueReadBuffer(
+      queue, cBuf, CL_TRUE, offset, len, &C[offsets[j]], 0, NULL, NULL));
+  }
+  double unbatchedTime = (now_ns() - phaseStart) / jobs;
+  cltrace_phase("unbatched", phaseStart);
+
+  clbatch_print(&bench, jobs, kernelBench.exec.median, unbatchedTime);
+
+  char* benchOut = getenv("BENCH_OUT");
+  if (benchOut != NULL && !clbench_write(benchOut, &bench, 1)) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", benchOut);
+  }
+  rt.pool().release(aBuf);
+  rt.pool().release(bBuf);
+  rt.pool().release(cBuf);
+  rt.pool().release(offsetsBuf);
+  return run->host->failures() > 0 ? 1 : 0;
+}
+
+// Median of the ingest or egress times of a shared run
+static double
+MedianNs(std::vector<double> ns)
+{
+  std::sort(ns.begin(), ns.end());
+  return ns.empty() ? 0 : ns[ns.size() / 2];
+}
+
+///
+//  INPUT holds A then B, the vectors of another process (see clshm.h); C
+//  goes to OUTPUT. Mapped and wrapped by the buffers (no copy where the
+//  device shares host memory; B only if its offset meets the alignment),
+//  then read() into and written back from private copies, for comparison.
+//  Each iteration times the whole path: ingest (open, map or read, buffers
+//  and transfers), kernel, egress (C visible to the other process).
+//
+static int
+SharedMain(const struct VectorsRun* base,
+           int platformId,
+           int deviceId,
+           const char* kernelfile,
+           size_t vector_len,
+           const char* input,
+           const char* output)
+{
+  if (getenv("SWEEP") != NULL || getenv("STREAM") != NULL ||
+      getenv("MEMORY") != NULL || getenv("DTYPE") != NULL) {
+    printf("shared: SWEEP, STREAM, MEMORY and DTYPE are ignored\n");
+  }
+  struct VectorsRun run = *base;
+  run.device = clrt::select_device(platformId, deviceId, false);
+  if (run.device == NULL) {
+    printf("no device %d.%d\n", platformId, deviceId);
+    return 1;
+  }
+  run.dtype = DTYPE_F32;
+  size_t poolArena;
+  int poolBench;
+  clrt::pool_config(&poolArena, &poolBench);
+  enum QueueMode queueMode = QUEUE_BLOCKING;
+  clrt::Runtime rt(run.device, &queueMode, poolArena);
+  cl_command_queue queue = rt.queue();
+  run.context = rt.context();
+  struct VectorsKernel kern;
+  CreateVectorsKernel(&rt.programs(), &run, kernelfile, &kern);
+  if (kern.bounds) {
+    clrt::set_arg(kern.kernel, 3, (cl_int)vector_len);
+  }
+  size_t global = KernelItems(&run, &kern, vector_len);
+  printf("shared: input %s, output %s\n",
+         input,
+         output != NULL ? output : "(none)");
+
+  size_t bytes = sizeof(float) * vector_len;
+  const enum HostIo ios[2] = { HOSTIO_MMAP, HOSTIO_READ };
+  struct BenchResult results[2];
+  std::vector<struct BenchSample> samples[2];
+  for (int m = 0; m < 2; m++) {
+    enum HostIo io = ios[m];
+    const char* ioName = io == HOSTIO_MMAP ? "mmap" : "read";
+    std::vector<double> ingest, egress;
+    bool aWrapped = false, bWrapped = false, cWrapped = false;
+    samples[m].resize(run.iterations);
+    double phaseStart = now_ns();
+    for (int i = 0; i < run.warmup + run.iterations; i++) {
+      double ingestStart = now_ns();
+      struct HostFile in, out;
+      if (!clshm_open(&in, input, 2 * bytes, io, false)) {
+        return 1;
+      }
+      if (!clshm_open(&out, output, bytes, io, true)) {
+        clshm_close(&in);
+        return 1;
+      }
+      float* A = (float*)in.addr;
+      float* B = A + vector_len;
+      float* C = (float*)out.addr;
+      clrt::Mem aBuf, bBuf, cBuf;
+      if (io == HOSTIO_MMAP) {
+        cl_int err;
+        aBuf = clrt::Mem(clshm_buffer(rt.context(),
+                                      run.device,
+                                      CL_MEM_READ_ONLY,
+                                      A,
+                                      bytes,
+                                      &aWrapped,
+                                      &err));
+        CL_CHECK(err);
+        bBuf = clrt::Mem(clshm_buffer(rt.context(),
+                                      run.device,
+                                      CL_MEM_READ_ONLY,
+                                      B,
+                                      bytes,
+                                      &bWrapped,
+                                      &err));
+        CL_CHECK(err);
+        cBuf = clrt::Mem(clshm_buffer(rt.context(),
+                                      run.device,
+                                      CL_MEM_WRITE_ONLY,
+                                      C,
+                                      bytes,
+                                      &cWrapped,
+                                      &err));
+        CL_CHECK(err);
+      } else {
+        aBuf = rt.pool().acquire(CL_MEM_READ_ONLY, bytes);
+        bBuf = rt.pool().acquire(CL_MEM_READ_ONLY, bytes);
+        cBuf = rt.pool().acquire(CL_MEM_WRITE_ONLY, bytes);
+        CL_CHECK(clEnqueueWriteBuffer(
+          queue, aBuf, CL_FALSE, 0, bytes, A, 0, NULL, NULL));
+        CL_CHECK(clEnqueueWriteBuffer(
+          queue, bBuf, CL_TRUE, 0, bytes, B, 0, NULL, NULL));
+      }
+      double ingestTime = now_ns() - ingestStart;
+
+      clrt::set_arg(kern.kernel, 0, aBuf.get());
+      clrt::set_arg(kern.kernel, 1, bBuf.get());
+      clrt::set_arg(kern.kernel, 2, cBuf.get());
+      clrt::Event kernelCompletion;
+      CL_CHECK(clEnqueueNDRangeKernel(queue,
+                                      kern.kernel,
+                                      1,
+                                      NULL,
+                                      &global,
+                                      NULL,
+                                      0,
+                                      NULL,
+                                      kernelCompletion.out()));
+
+      // A wrapped C only needs the device copy synced back (map); a copied
+      // one is read into the mapping
+      double egressStart = now_ns();
+      if (io == HOSTIO_MMAP && cWrapped) {
+        void* mapped = clEnqueueMapBuffer(
+          queue, cBuf, CL_TRUE, CL_MAP_READ, 0, bytes, 0, NULL, NULL, NULL);
+        CL_CHECK(clEnqueueUnmapMemObject(queue, cBuf, mapped, 0, NULL, NULL));
+        CL_CHECK(clFinish(queue));
+      } else {
+        CL_CHECK(clEnqueueReadBuffer(
+          queue, cBuf, CL_TRUE, 0, bytes, C, 0, NULL, NULL));
+      }
+      if (!clshm_sync(&out)) {
+        return 1;
+      }
+      double egressTime = now_ns() - egressStart;
+
+      if (i >= run.warmup) {
+        ingest.push_back(ingestTime);
+        egress.push_back(egressTime);
+        CL_CHECK(
+          clbench_sample(kernelCompletion, &samples[m][i - run.warmup]));
+      }
+      if (i == run.warmup + run.iterations - 1) {
+        CheckOutput(&run, A, B, C, vector_len);
+      }
+      if (io == HOSTIO_READ) {
+        rt.pool().release(aBuf);
+        rt.pool().release(bBuf);
+        rt.pool().release(cBuf);
+      }
+      aBuf.reset();
+      bBuf.reset();
+      cBuf.reset();
+      clshm_close(&in);
+      clshm_close(&out);
+    }
+    cltrace_phase(ioName, phaseStart);
+
+    char label[300];
+    snprintf(label, sizeof(label), "%s %s", kern.label, ioName);
+    struct BenchResult* r = &results[m];
+    clbench_result(r,
+                   run.device,
+                   run.operation,
+                   label,
+                   vector_len,
+                   3.0 * bytes,
+                   1.0 * vector_len,
+                   samples[m].data(),
+                   run.iterations,
+                   run.warmup);
+    r->write_ns = MedianNs(ingest);
+    r->read_ns = MedianNs(egress);
+    clbench_print(r);
+    printf("%s: ingest(ns):%lg egress(ns):%lg",
+           ioName,
+           r->write_ns,
+           r->read_ns);
+    if (io == HOSTIO_MMAP) {
+      printf(" wrapped: A %s B %s C %s",
+             aWrapped ? "yes" : "no (copied)",
+             bWrapped ? "yes" : "no (copied)",
+             cWrapped ? "yes" : "no (copied)");
+    }
+    printf("\n");
+  }
+  clbench_print_speedup(&results[0], &results[1]);
+
+  char* benchOut = getenv("BENCH_OUT");
+  if (benchOut != NULL && !clbench_write(benchOut, results, 2)) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", benchOut);
+  }
+  return run.host->failures() > 0 ? 1 : 0;
+}
+
+int
+main(int argc, char** argv)
+{
+  cltrace_config();
+
+  int vector_len = 1024;
+  char* vector_str = getenv("VECTOR");
+  if (vector_str != NULL) {
+    vector_len = atoi(vector_str);
+  }
+  printf("vector: %d\n", vector_len);
+  char* sweep_str = getenv("SWEEP");
+  struct SweepRange range;
+  bool sweep = false;
+  if (sweep_str != NULL) {
+    if (!clbench_parse_sweep(sweep_str, &range)) {
+      printf("not recognized sweep (min:max:factor, factor > 1)\n");
+      exit(1);
+    }
+    sweep = true;
+    vector_len = range.min;
+    printf("sweep: %ld..%ld (x%g)\n", range.min, range.max, range.factor);
+  }
+  char* check_str = getenv("CHECK");
+  bool check_res = false;
+  if (check_str != NULL && atoi(check_str) > 0) {
+    check_res = true;
+  }
+  printf("check results: %s\n", check_res > 0 ? "true" : "false");
+
+  enum clrt::HostIsa hostIsa;
+  int hostThreads;
+  if (!clrt::host_config(&hostIsa, &hostThreads)) {
+    printf("not recognized host isa (AUTO|SCALAR|AVX2|AVX512|NEON)\n");
+    exit(1);
+  }
+  clrt::HostEngine host(hostIsa, hostThreads);
+  struct clrt::VerifyConfig verify;
+  clrt::verify_config(&verify);
+  host.set_verify(verify);
+  char hostName[64];
+  host.name(hostName, sizeof(hostName));
+  printf("host: %s\n", hostName);
+
+  int deviceId = 0;
+  int platformId = 0;
+  char* platform_str = getenv("PLATFORM");
+  if (platform_str != NULL) {
+    platformId = atoi(platform_str);
+  }
+  char* device_str = getenv("DEVICE");
+  if (device_str != NULL) {
+    deviceId = atoi(device_str);
+  }
+  printf("using platform.device: %d.%d\n", platformId, deviceId);
+
+  char* memory_str = getenv("MEMORY");
+  enum MemoryMode memory = MEMORY_COPY;
+  if (memory_str != NULL && !clbuf_parse_mode(memory_str, &memory)) {
+    printf("not recognized memory (COPY|USE_HOST_PTR|ALLOC_HOST_PTR|SVM)\n");
+    exit(1);
+  }
+  printf("memory: %s\n", clbuf_mode_name(memory));
+
+  enum DataType dtype;
+  if (!cldtype_config(&dtype)) {
+    printf("not recognized dtype (f16|f32|f64)\n");
+    exit(1);
+  }
+  printf("dtype: %s\n", cldtype_name(dtype));
+
+  // Pipelined chunks instead of whole device vectors
+  int streamSets = 0;
+  size_t streamChunk = 0;
+  char* stream_str = getenv("STREAM");
+  if (stream_str != NULL) {
+    streamSets = atoi(stream_str);
+    if (streamSets < 1 || streamSets > STREAM_MAX_SETS) {
+      printf("not recognized stream sets (1|2|3)\n");
+      exit(1);
+    }
+    char* chunk_str = getenv("STREAM_CHUNK");
+    if (chunk_str != NULL && atol(chunk_str) > 0) {
+      streamChunk = atol(chunk_str);
+    }
+  }
+
+  char* kernelfile;
+  if (argc >= 2) {
+    kernelfile = argv[1];
+  } else {
+    printf("usage: <kernel file.cl>\n");
+    exit(1);
+  }
+  enum Operation op;
+  char operation[7];
+  memcpy(operation, kernelfile, 6);
+  operation[6] = '\0';
+  if (strcmp(operation, "vecadd") == 0) {
+    op = OP_ADD;
+    printf("operation: vecadd\n");
+  } else if (strcmp(operation, "vecmul") == 0) {
+    op = OP_MUL;
+    printf("operation: vecmul\n");
+  } else {
+    printf("not recognized operation (vecmul|vecadd) in kernelfile\n");
+    exit(1);
+  }
+
+  // Many small jobs in one launch, on one device
+  if (strstr(kernelfile, ".batch.") != NULL) {
+    struct BatchConfig batch;
+    if (!clbatch_config(&batch)) {
+      printf("not recognized batch job length (min:max, with BATCH * max "
+             "elements at most INT_MAX)\n");
+      exit(1);
+    }
+    struct VectorsRun base = {};
+    base.op = op;
+    base.operation = operation;
+    base.check_res = check_res;
+    base.host = &host;
+    clbench_config(&base.iterations, &base.warmup);
+    if (!cltune_config(&base.localConfig)) {
+      printf("not recognized local work size (DRIVER|AUTO|<n>)\n");
+      exit(1);
+    }
+    return BatchMain(&base, platformId, deviceId, kernelfile, &batch);
+  }
+
+  // The vectors of another process, mapped or read
+  const char* input_spec;
+  const char* output_spec;
+  clshm_config(&input_spec, &output_spec);
+  if (input_spec != NULL) {
+    struct VectorsRun base = {};
+    base.op = op;
+    base.operation = operation;
+    base.check_res = check_res;
+    base.host = &host;
+    clbench_config(&base.iterations, &base.warmup);
+    return SharedMain(&base,
+                      platformId,
+                      deviceId,
+                      kernelfile,
+                      vector_len,
+                      input_spec,
+                      output_spec);
+  }
+
+  // The host engine instead of an OpenCL device
+  char* backend_str = getenv("BACKEND");
+  if (backend_str != NULL && strcmp(backend_str, "OPENCL") != 0) {
+    if (strcmp(backend_str, "HOST") != 0) {
+      printf("not recognized backend (OPENCL|HOST)\n");
+      exit(1);
+    }
+    if (dtype != DTYPE_F32) {
+      printf("host backend: DTYPE is ignored\n");
+    }
+    struct VectorsRun base = {};
+    base.op = op;
+    base.operation = operation;
+    base.host = &host;
+    clbench_config(&base.iterations, &base.warmup);
+    return HostMain(&base, vector_len, sweep ? &range : NULL);
+  }
+
+  enum MultiMode multiMode;
+  size_t calibrateLen;
+  if (!clmulti_config(&multiMode, &calibrateLen)) {
+    printf("not recognized multi-device mode (PLATFORM|ALL)\n");
+    exit(1);
+  }
+  if (multiMode != MULTI_OFF) {
+    int status = MultiMain(multiMode,
+                           platformId,
+                           kernelfile,
+                           op,
+                           operation,
+                           check_res,
+                           &host,
+                           vector_len,
+                           calibrateLen);
+    return host.failures() > 0 ? 1 : status;
+  }
+
+  cl_device_id device = clrt::select_device(platformId, deviceId, false);
+  if (device == NULL) {
+    printf("no device %d.%d\n", platformId, deviceId);
+    exit(1);
+  }
+  if (streamSets > 0 && dtype != DTYPE_F32) {
+    printf("stream: DTYPE ignored, chunks are float\n");
+    dtype = DTYPE_F32;
+  }
+  bool dtypeNative;
+  if (!cldtype_supported(device, dtype, &dtypeNative)) {
+    printf("%s is not supported by the device (cl_khr_fp64)\n",
+           cldtype_name(dtype));
+    exit(1);
+  }
+  if (dtype == DTYPE_F16) {
+    printf("f16: half storage, float compute (cl_khr_fp16: %s)\n",
+           dtypeNative ? "yes" : "no");
+  }
+  host.set_storage(dtype);
+
+  size_t max_wg_size;
+  CL_CHECK(clGetDeviceInfo(device,
+                           CL_DEVICE_MAX_WORK_GROUP_SIZE,
+                           sizeof(max_wg_size),
+                           &max_wg_size,
+                           NULL));
+  printf("max wg size: %ld\n", max_wg_size);
+
+  // Context, queue, programs and buffer pool of the device
+  enum QueueMode queueMode;
+  if (!clbench_queue_config(&queueMode)) {
+    printf("not recognized queue (BLOCKING|IN_ORDER|OUT_OF_ORDER)\n");
+    exit(1);
+  }
+  size_t poolArena;
+  int poolBench;
+  clrt::pool_config(&poolArena, &poolBench);
+  clrt::Runtime rt(device, &queueMode, poolArena);
+  cl_context context = rt.context();
+  printf("queue: %s\n", clbench_queue_name(queueMode));
+
+  struct VectorsRun run;
+  run.context = context;
+  run.device = device;
+  run.queue = rt.queue();
+  run.queueMode = queueMode;
+  run.op = op;
+  run.operation = operation;
+  run.dtype = dtype;
+  run.check_res = check_res;
+  run.host = &host;
+  clbench_config(&run.iterations, &run.warmup);
+  if (!cltune_config(&run.localConfig)) {
+    printf("not recognized local work size (DRIVER|AUTO|<n>)\n");
+    exit(1);
+  }
+
+  // Allocation latency of the buffers of each vector length, instead of a
+  // run
+  if (poolBench > 0) {
+    for (size_t len = vector_len; len != 0;
+         len = sweep ? clbench_sweep_next(&range, len) : 0) {
+      clrt::pool_bench(context,
+                       rt.queue(),
+                       len * cldtype_size(dtype),
+                       poolBench,
+                       run.iterations,
+                       poolArena);
+    }
+    return 0;
+  }
+
+  run.streamSets = streamSets;
+  run.hostA = run.hostB = run.hostC = NULL;
+  run.hostLen = 0;
+  if (streamSets > 0) {
+    // Chunks sized to fit every set on the device at once
+    cl_ulong maxAlloc, globalMem;
+    CL_CHECK(clGetDeviceInfo(device,
+                             CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+                             sizeof(maxAlloc),
+                             &maxAlloc,
+                             NULL));
+    CL_CHECK(clGetDeviceInfo(device,
+                             CL_DEVICE_GLOBAL_MEM_SIZE,
+                             sizeof(globalMem),
+                             &globalMem,
+                             NULL));
+    size_t fit = maxAlloc / sizeof(float);
+    if (globalMem / (streamSets * 3 * sizeof(float)) < fit) {
+      fit = globalMem / (streamSets * 3 * sizeof(float));
+    }
+    if (streamChunk == 0) {
+      streamChunk = STREAM_CHUNK_DEFAULT;
+    }
+    if (streamChunk > fit) {
+      printf("stream chunk %ld does not fit on the device: using %ld\n",
+             streamChunk,
+             fit);
+      streamChunk = fit;
+    }
+    run.streamChunk = streamChunk;
+    if (memory != MEMORY_COPY) {
+      printf("stream: MEMORY ignored, chunks are copied\n");
+    }
+    const cl_queue_properties qproperties[] = { CL_QUEUE_PROPERTIES,
+                                                CL_QUEUE_PROFILING_ENABLE,
+                                                0 };
+    for (int s = 0; s < streamSets; s++) {
+      struct StreamSet* set = &run.sets[s];
+      set->queue = clrt::Queue(CL_CHECK_ERR(clCreateCommandQueueWithProperties(
+        context, device, qproperties, &_err)));
+      set->a =
+        rt.pool().acquire(CL_MEM_READ_ONLY, streamChunk * sizeof(float));
+      set->b =
+        rt.pool().acquire(CL_MEM_READ_ONLY, streamChunk * sizeof(float));
+      set->c =
+        rt.pool().acquire(CL_MEM_WRITE_ONLY, streamChunk * sizeof(float));
+    }
+  } else {
+    // Memory buffers for each array
+    CL_CHECK(clbuf_create(&run.aBuf,
+                          context,
+                          memory,
+                          CL_MEM_READ_ONLY,
+                          vector_len * cldtype_size(dtype)));
+    CL_CHECK(clbuf_create(&run.bBuf,
+                          context,
+                          memory,
+                          CL_MEM_READ_ONLY,
+                          vector_len * cldtype_size(dtype)));
+    CL_CHECK(clbuf_create(&run.cBuf,
+                          context,
+                          memory,
+                          CL_MEM_WRITE_ONLY,
+                          vector_len * cldtype_size(dtype)));
+  }
+
+  struct VectorsKernel kern;
+  CreateVectorsKernel(&rt.programs(), &run, kernelfile, &kern);
+  // Same operation from another kernel file, to compare against
+  struct VectorsKernel base;
+  char* baselineStr = getenv("BASELINE");
+  if (baselineStr != NULL) {
+    if (strncmp(baselineStr, operation, strlen(operation)) != 0) {
+      printf("baseline %s is not a %s kernel\n", baselineStr, operation);
+      exit(1);
+    }
+    CreateVectorsKernel(&rt.programs(), &run, baselineStr, &base);
+  }
+
+  // With a baseline, its results follow the ones of the kernel
+  size_t nSizes = 1;
+  if (sweep) {
+    nSizes = 0;
+    for (size_t len = range.min; len != 0;
+         len = clbench_sweep_next(&range, len)) {
+      nSizes++;
+    }
+  }
+  size_t nResults = baselineStr != NULL ? 2 * nSizes : nSizes;
+  struct BenchResult* results =
+    (struct BenchResult*)malloc(sizeof(struct BenchResult) * nResults);
+  struct BenchResult* baseResults = &results[nSizes];
+  if (sweep) {
+    double* hostTimes = (double*)malloc(sizeof(double) * nSizes);
+    size_t i = 0;
+    for (size_t len = range.min; len != 0;
+         len = clbench_sweep_next(&range, len)) {
+      printf("=== vector: %ld ===\n", len);
+      Run(&run, &kern, len, &results[i]);
+      if (baselineStr != NULL) {
+        Run(&run, &base, len, &baseResults[i]);
+      }
+      hostTimes[i] = HostTime(&run, len);
+      i++;
+    }
+    printf("=== sweep ===\n");
+    clbench_print_sweep(results, hostTimes, nSizes);
+    free(hostTimes);
+  } else {
+    Run(&run, &kern, vector_len, &results[0]);
+    if (baselineStr != NULL) {
+      Run(&run, &base, vector_len, &baseResults[0]);
+    }
+  }
+  if (baselineStr != NULL) {
+    for (size_t i = 0; i < nSizes; i++) {
+      clbench_print_speedup(&results[i], &baseResults[i]);
+    }
+  }
+
+  char* benchOut = getenv("BENCH_OUT");
+  if (benchOut != NULL && !clbench_write(benchOut, results, nResults)) {
+    fprintf(stderr, "Failed to write benchmark results to %s\n", benchOut);
+  }
+  for (size_t i = 0; i < nResults; i++) {
+    free((void*)results[i].samples);
+  }
+  free(results);
+
+  // Clean up: the handles release themselves
+  CL_CHECK(clFinish(rt.queue()));
+  if (streamSets > 0) {
+    rt.pool().print_stats("stream");
+    free(run.hostA);
+    free(run.hostB);
+    free(run.hostC);
+  } else {
+    clbuf_release(&run.aBuf);
+    clbuf_release(&run.bBuf);
+    clbuf_release(&run.cBuf);
+  }
+
+  // CHECK failures make the run fail
+  return host.failures() > 0 ? 1 : 0;
+}